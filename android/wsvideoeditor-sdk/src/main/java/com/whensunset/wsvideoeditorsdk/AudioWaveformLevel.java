@@ -0,0 +1,26 @@
+package com.whensunset.wsvideoeditorsdk;
+
+import android.support.annotation.Keep;
+
+/**
+ * 素材某一级的音频波形，每 samplesPerPeak 个采样一个峰值，峰值归一化到 short 的范围
+ */
+public class AudioWaveformLevel {
+  public final int sampleRate;
+  public final long sampleCount;
+  public final int samplesPerPeak;
+  public final short[] minPeaks;
+  public final short[] maxPeaks;
+  public final short[] rmsPeaks;
+  
+  @Keep
+  AudioWaveformLevel(int sampleRate, long sampleCount, int samplesPerPeak, short[] minPeaks,
+      short[] maxPeaks, short[] rmsPeaks) {
+    this.sampleRate = sampleRate;
+    this.sampleCount = sampleCount;
+    this.samplesPerPeak = samplesPerPeak;
+    this.minPeaks = minPeaks;
+    this.maxPeaks = maxPeaks;
+    this.rmsPeaks = rmsPeaks;
+  }
+}
@@ -1,6 +1,7 @@
 package com.whensunset.wsvideoeditorsdk;
 
 import android.support.annotation.NonNull;
+import android.support.annotation.Nullable;
 
 import com.google.protobuf.InvalidProtocolBufferException;
 import com.whensunset.wsvideoeditorsdk.model.EditorProject;
@@ -65,6 +66,186 @@ public class WsMediaPlayer {
     seekNative(mNativePlayerAddress, currentTime);
   }
   
+  /**
+   * 开启代理文件预览，像素率超过阈值的素材会在后台转码成低分辨率的代理文件，只影响预览
+   *
+   * @param cacheDir 代理文件的缓存目录
+   * @param pixelRateThreshold 宽 * 高 * 帧率 超过这个值的素材才会生成代理文件
+   */
+  public void enableProxyMedia(@NonNull String cacheDir, double pixelRateThreshold) {
+    WSMediaLog.i(TAG, "enableProxyMedia mNativePlayerAddress:" + mNativePlayerAddress
+        + ",cacheDir:" + cacheDir + ",pixelRateThreshold:" + pixelRateThreshold);
+    synchronized (mLock) {
+      if (mNativePlayerAddress == 0) {
+        return;
+      }
+      enableProxyMediaNative(mNativePlayerAddress, cacheDir, pixelRateThreshold);
+    }
+  }
+  
+  /**
+   * 开启音频 PCM 缓存，短素材、循环素材和频繁 seek 的素材会在后台完整解码，之后 seek 不再需要解码
+   *
+   * @param tempDir 内存预算用完之后存放 mmap 临时文件的目录
+   * @param ramBudgetBytes 缓存可以使用的内存大小
+   */
+  public void enableAudioPcmCache(@NonNull String tempDir, long ramBudgetBytes) {
+    WSMediaLog.i(TAG, "enableAudioPcmCache mNativePlayerAddress:" + mNativePlayerAddress
+        + ",tempDir:" + tempDir + ",ramBudgetBytes:" + ramBudgetBytes);
+    synchronized (mLock) {
+      if (mNativePlayerAddress == 0) {
+        return;
+      }
+      enableAudioPcmCacheNative(mNativePlayerAddress, tempDir, ramBudgetBytes);
+    }
+  }
+  
+  /**
+   * 开启音频波形，project 里的素材会在后台分析出多级波形，之后 setProject 新加的素材也会自动分析
+   *
+   * @param cacheDir 波形文件的缓存目录，同一个文件只分析一次
+   */
+  public void enableAudioWaveform(@NonNull String cacheDir) {
+    WSMediaLog.i(TAG, "enableAudioWaveform mNativePlayerAddress:" + mNativePlayerAddress
+        + ",cacheDir:" + cacheDir);
+    synchronized (mLock) {
+      if (mNativePlayerAddress == 0) {
+        return;
+      }
+      enableAudioWaveformNative(mNativePlayerAddress, cacheDir);
+    }
+  }
+  
+  /**
+   * 分析不在 project 里的文件的波形，已经请求过的话什么都不做，需要先 enableAudioWaveform
+   */
+  public void requestAudioWaveform(@NonNull String path) {
+    synchronized (mLock) {
+      if (mNativePlayerAddress == 0) {
+        return;
+      }
+      requestAudioWaveformNative(mNativePlayerAddress, path);
+    }
+  }
+  
+  /**
+   * 取适合当前缩放的一级波形，不会阻塞
+   *
+   * @param samplesPerPixel 一个像素对应的采样数，返回每个像素至少一个峰值的最粗的一级
+   * @return 还没分析完、没有开启音频波形或者播放器已经释放的时候返回 null
+   */
+  @Nullable
+  public AudioWaveformLevel getAudioWaveform(@NonNull String path, double samplesPerPixel) {
+    synchronized (mLock) {
+      if (mNativePlayerAddress == 0) {
+        return null;
+      }
+      return getAudioWaveformNative(mNativePlayerAddress, path, samplesPerPixel);
+    }
+  }
+  
+  /**
+   * 设置播放速度，范围 0.25 ~ 4.0，音频变速不变调，视频按照变速后的时钟丢帧或者重复帧
+   *
+   * @param playbackRate 播放速度，1.0 为原速
+   */
+  public void setPlaybackRate(double playbackRate) {
+    WSMediaLog.i(TAG, "setPlaybackRate mNativePlayerAddress:" + mNativePlayerAddress
+        + ",playbackRate:" + playbackRate);
+    synchronized (mLock) {
+      if (mNativePlayerAddress == 0) {
+        return;
+      }
+      setPlaybackRateNative(mNativePlayerAddress, playbackRate);
+    }
+  }
+  
+  /**
+   * 循环播放 [loopStart, loopEnd)，播放到 loopEnd 的时候无缝接着播 loopStart，不会停下来重新缓冲
+   *
+   * @param loopStart 循环开始位置，单位秒
+   * @param loopEnd 循环结束位置，单位秒，不大于 loopStart 的时候不循环
+   */
+  public void setLoopRegion(double loopStart, double loopEnd) {
+    WSMediaLog.i(TAG, "setLoopRegion mNativePlayerAddress:" + mNativePlayerAddress
+        + ",loopStart:" + loopStart + ",loopEnd:" + loopEnd);
+    synchronized (mLock) {
+      if (mNativePlayerAddress == 0) {
+        return;
+      }
+      setLoopRegionNative(mNativePlayerAddress, loopStart, loopEnd);
+    }
+  }
+  
+  public void clearLoopRegion() {
+    WSMediaLog.i(TAG, "clearLoopRegion mNativePlayerAddress:" + mNativePlayerAddress);
+    synchronized (mLock) {
+      if (mNativePlayerAddress == 0) {
+        return;
+      }
+      clearLoopRegionNative(mNativePlayerAddress);
+    }
+  }
+  
+  /**
+   * seek 耗时统计，单位毫秒，用来衡量拖动进度条的体验
+   *
+   * @return 依次是：第一帧耗时的 次数、p50、p90、p99、最大值，音视频都准备好的耗时的 次数、p50、p90、p99、最大值，
+   * 被合并掉的 seek 次数；播放器已经释放的时候返回 null
+   */
+  public double[] getSeekStats() {
+    synchronized (mLock) {
+      if (mNativePlayerAddress == 0) {
+        return null;
+      }
+      return getSeekStatsNative(mNativePlayerAddress);
+    }
+  }
+  
+  /**
+   * 第一帧耗时统计，单位毫秒，还没画出第一帧的时候是 -1
+   *
+   * @return 依次是：第一次 setProject 到画出第一帧的耗时、第一次 attach 到画出第一帧的耗时、
+   * 第一帧是否是缓存的封面帧 (1 或者 0)；播放器已经释放的时候返回 null
+   */
+  public double[] getFirstFrameStats() {
+    synchronized (mLock) {
+      if (mNativePlayerAddress == 0) {
+        return null;
+      }
+      return getFirstFrameStatsNative(mNativePlayerAddress);
+    }
+  }
+  
+  /**
+   * 第一次 attach 之前提前解码，默认开着，关掉之后 attach 了才开始解码。用来对比第一帧耗时，
+   * 要在第一次 setProject 之前调用
+   */
+  public void setSpeculativeDecodeEnabled(boolean enabled) {
+    WSMediaLog.i(TAG, "setSpeculativeDecodeEnabled mNativePlayerAddress:" + mNativePlayerAddress
+        + ",enabled:" + enabled);
+    synchronized (mLock) {
+      if (mNativePlayerAddress == 0) {
+        return;
+      }
+      setSpeculativeDecodeEnabledNative(mNativePlayerAddress, enabled);
+    }
+  }
+  
+  /**
+   * 用缓存的封面帧当第一帧，默认开着，关掉之后既不读也不写缓存。用来对比第一帧耗时
+   */
+  public void setPosterFrameCacheEnabled(boolean enabled) {
+    WSMediaLog.i(TAG, "setPosterFrameCacheEnabled mNativePlayerAddress:" + mNativePlayerAddress
+        + ",enabled:" + enabled);
+    synchronized (mLock) {
+      if (mNativePlayerAddress == 0) {
+        return;
+      }
+      setPosterFrameCacheEnabledNative(mNativePlayerAddress, enabled);
+    }
+  }
+  
   /**
    * 将 Project 设置给底层，基本上不耗时
    *
@@ -265,4 +446,33 @@ public class WsMediaPlayer {
   private native boolean isPlayingNative(long mNativePlayerAddress);
   
   private native double getCurrentTimeNative(long mNativePlayerAddress);
+  
+  private native void enableProxyMediaNative(long mNativePlayerAddress, String cacheDir,
+      double pixelRateThreshold);
+  
+  private native void enableAudioPcmCacheNative(long mNativePlayerAddress, String tempDir,
+      long ramBudgetBytes);
+  
+  private native void enableAudioWaveformNative(long mNativePlayerAddress, String cacheDir);
+  
+  private native void requestAudioWaveformNative(long mNativePlayerAddress, String path);
+  
+  private native AudioWaveformLevel getAudioWaveformNative(long mNativePlayerAddress, String path,
+      double samplesPerPixel);
+  
+  private native void setPlaybackRateNative(long mNativePlayerAddress, double playbackRate);
+  
+  private native void setLoopRegionNative(long mNativePlayerAddress, double loopStart,
+      double loopEnd);
+  
+  private native void clearLoopRegionNative(long mNativePlayerAddress);
+  
+  private native double[] getSeekStatsNative(long mNativePlayerAddress);
+  
+  private native double[] getFirstFrameStatsNative(long mNativePlayerAddress);
+  
+  private native void setSpeculativeDecodeEnabledNative(long mNativePlayerAddress,
+      boolean enabled);
+  
+  private native void setPosterFrameCacheEnabledNative(long mNativePlayerAddress, boolean enabled);
 }
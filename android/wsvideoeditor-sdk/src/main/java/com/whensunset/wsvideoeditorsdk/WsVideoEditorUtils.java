@@ -2,8 +2,11 @@ package com.whensunset.wsvideoeditorsdk;
 
 import android.os.Looper;
 import android.support.annotation.Keep;
+import android.support.annotation.NonNull;
 import android.util.Log;
 
+import com.whensunset.wsvideoeditorsdk.model.EditorProject;
+
 public class WsVideoEditorUtils {
 
   private static final String TAG = "WsVideoEditorUtils";
@@ -45,5 +48,23 @@ public class WsVideoEditorUtils {
     }
   }
   
+  /**
+   * 把 project 的 [startSec, startSec + durationSec) 区间的音频混音之后写成 16 位 WAV 文件，
+   * 和预览走同一套解码混音流程，但是不依赖播放设备，以 CPU 能达到的最快速度运行，耗时，不要在主线程调用
+   *
+   * @param project 已经 load 过的 project
+   * @return 比实时快多少倍，小于 0 为错误码
+   */
+  public static double mixDownAudioToWav(@NonNull EditorProject project, @NonNull String wavPath,
+      double startSec, double durationSec) {
+    double ret = mixDownAudioToWavNative(project.toByteArray(), wavPath, startSec, durationSec);
+    Log.i(TAG, "mixDownAudioToWav wavPath:" + wavPath + ",startSec:" + startSec + ",durationSec:"
+        + durationSec + ",ret:" + ret);
+    return ret;
+  }
+  
   public static native void initJniNative();
+  
+  private static native double mixDownAudioToWavNative(byte[] project, String wavPath,
+      double startSec, double durationSec);
 }
@@ -12,6 +12,7 @@ import com.whensunset.wsvideoeditorsdk.util.WSMediaLog;
 
 import java.lang.annotation.Retention;
 import java.lang.annotation.RetentionPolicy;
+import java.util.ArrayDeque;
 
 public class AudioPlayByAudioTrack {
   private static final String TAG = "AudioPlayByAudioTrack";
@@ -47,7 +48,7 @@ public class AudioPlayByAudioTrack {
   public static final long START_TIME_STATE_NEED_SYNC_MAX_DIFF = 100_000;
 
   /**
-   * Represents states of the {@link #mStartMediaTimeUs} value.
+   * Represents states of the {@link #mSpeedSegments} start media time.
    */
   @Retention(RetentionPolicy.SOURCE)
   @IntDef({START_NOT_SET, START_IN_SYNC, START_NEED_SYNC})
@@ -72,7 +73,11 @@ public class AudioPlayByAudioTrack {
   private int mOutputPcmFrameSize;
   private @StartMediaTimeState
   int mStartMediaTimeState;
-  private long mStartMediaTimeUs;
+  /**
+   * Written frames grouped by playback speed, the last one is being written, the first one is
+   * being played.
+   */
+  private final ArrayDeque<SpeedSegment> mSpeedSegments = new ArrayDeque<>();
   private long mWrittenPcmBytes;
   private boolean mIsPlaying = false;
 
@@ -261,7 +266,7 @@ public class AudioPlayByAudioTrack {
   }
 
   @Keep
-  public int writeAudioTrack(byte[] audioData, int size, long audioDataTimeUs) {
+  public int writeAudioTrack(byte[] audioData, int size, long audioDataTimeUs, float speed) {
     synchronized (mLock) {
       if (!isInitialized()) {
         try {
@@ -294,26 +299,32 @@ public class AudioPlayByAudioTrack {
       }
       if (mStartMediaTimeState == START_NOT_SET) {
         WSMediaLog.e(TAG, "mStartMediaTimeState == START_NOT_SET");
-        mStartMediaTimeUs = Math.max(0, audioDataTimeUs);
+        mSpeedSegments.clear();
+        mSpeedSegments.add(new SpeedSegment(0, Math.max(0, audioDataTimeUs), speed));
+        mStartMediaTimeState = START_IN_SYNC;
+      } else if (mSpeedSegments.getLast().speed != speed) {
+        // frames already written keep playing at the old speed
+        WSMediaLog.i(TAG, "Speed changed " + mSpeedSegments.getLast().speed + " -> " + speed);
+        mSpeedSegments.add(new SpeedSegment(getWrittenFrames(), audioDataTimeUs, speed));
         mStartMediaTimeState = START_IN_SYNC;
       } else {
+        SpeedSegment segment = mSpeedSegments.getLast();
         // Sanity check that presentationTimeUs is consistent with the expected value.
-        long expectedPresentationTimeUs =
-            mStartMediaTimeUs + framesToDurationUs(getWrittenFrames());
+        long expectedPresentationTimeUs = segment.mediaTimeUsAt(getWrittenFrames());
         if (mStartMediaTimeState == START_IN_SYNC && Math.abs(expectedPresentationTimeUs - audioDataTimeUs) > START_TIME_STATE_NEED_SYNC_MAX_DIFF) {
           WSMediaLog.w(TAG, "Discontinuity detected [expected " + expectedPresentationTimeUs + ","
               + " got " + audioDataTimeUs + "] written " + getWrittenFrames() + ", " +
-              "mStartMediaTimeUs: " + mStartMediaTimeUs);
+              "startMediaTimeUs: " + segment.startMediaTimeUs);
           mStartMediaTimeState = START_NEED_SYNC;
         }
         if (mStartMediaTimeState == START_NEED_SYNC) {
           // Adjust startMediaTimeUs to be consistent with the current buffer's start time and the
           // number of bytes submitted.
           long diff = audioDataTimeUs - expectedPresentationTimeUs;
-          mStartMediaTimeUs += (audioDataTimeUs - expectedPresentationTimeUs);
+          segment.startMediaTimeUs += (audioDataTimeUs - expectedPresentationTimeUs);
           mStartMediaTimeState = START_IN_SYNC;
           WSMediaLog.w(TAG, "Discontinuity try to sync [expect " + expectedPresentationTimeUs +
-              ", got " + audioDataTimeUs + " diff " + diff + ", mStartMediaTimeUs: " + mStartMediaTimeUs + "]");
+              ", got " + audioDataTimeUs + " diff " + diff + ", startMediaTimeUs: " + segment.startMediaTimeUs + "]");
         }
       }
     }
@@ -344,6 +355,7 @@ public class AudioPlayByAudioTrack {
   private void reset() {
     mWrittenPcmBytes = 0;
     mStartMediaTimeState = START_NOT_SET;
+    mSpeedSegments.clear();
     if (isInitialized()) {
       if (mPositionTracker.isPlaying()) {
         mPositionTracker.pause();
@@ -372,14 +384,45 @@ public class AudioPlayByAudioTrack {
       return CURRENT_POSITION_NOT_SET;
     }
     long positionUs = mPositionTracker.getCurrentPositionUs();
-    positionUs = Math.min(positionUs, framesToDurationUs(getWrittenFrames()));
-    return mStartMediaTimeUs + positionUs;
+    synchronized (mLock) {
+      if (mSpeedSegments.isEmpty()) {
+        return CURRENT_POSITION_NOT_SET;
+      }
+      long playedFrames = Math.min(durationUsToFrames(positionUs), getWrittenFrames());
+      // drop the segments that have been played out
+      SpeedSegment playing = mSpeedSegments.pollFirst();
+      while (!mSpeedSegments.isEmpty() && mSpeedSegments.peekFirst().startFrames <= playedFrames) {
+        playing = mSpeedSegments.pollFirst();
+      }
+      mSpeedSegments.addFirst(playing);
+      return playing.mediaTimeUsAt(playedFrames);
+    }
   }
 
   private long getWrittenFrames() {
     return mWrittenPcmBytes / mOutputPcmFrameSize;
   }
 
+  /**
+   * Frames written from {@link #startFrames} on cover {@link #speed} times their duration of media
+   * time, starting at {@link #startMediaTimeUs}.
+   */
+  private final class SpeedSegment {
+    final long startFrames;
+    long startMediaTimeUs;
+    final float speed;
+
+    SpeedSegment(long startFrames, long startMediaTimeUs, float speed) {
+      this.startFrames = startFrames;
+      this.startMediaTimeUs = startMediaTimeUs;
+      this.speed = speed;
+    }
+
+    long mediaTimeUsAt(long frames) {
+      return startMediaTimeUs + (long) (framesToDurationUs(frames - startFrames) * speed);
+    }
+  }
+
   private final class InitializationException extends Exception {
     /**
      * The underlying {@link AudioTrack}'s state, if applicable.
@@ -48,7 +48,7 @@ namespace whensunset {
                 j_method_id_initAudioTrack_ = env->GetMethodID(clazz(), "initAudioTrack", "(II)I");
                 assert(j_method_id_initAudioTrack_);
                 j_method_id_writeAudioTrack_ = env->GetMethodID(clazz(), "writeAudioTrack",
-                                                                "([BIJ)I");
+                                                                "([BIJF)I");
                 assert(j_method_id_writeAudioTrack_);
                 j_method_id_pauseAudioTrack_ = env->GetMethodID(clazz(), "pauseAudioTrack", "()V");
                 assert(j_method_id_pauseAudioTrack_);
@@ -91,9 +91,11 @@ namespace whensunset {
                     memset(buff_.get(), 0, buff_size_);
 
                     double render_pos = ref_clock_->GetRenderPos();
+                    double playback_rate = 1.0;
                     int got_length = 0;
                     if (get_buff_func_) {
-                        get_buff_func_(&got_length, buff_.get(), buff_size_, &render_pos);
+                        get_buff_func_(&got_length, buff_.get(), buff_size_, &render_pos,
+                                       &playback_rate);
                         if (got_length == 0) {
                             lk.unlock();
                             // Didn't get anything, buff_ will be memset to 0
@@ -110,7 +112,8 @@ namespace whensunset {
                     lk.unlock();
                     int bytes_written = env->CallIntMethod(audioplay_by_audiotrack_service_(),
                                                            j_method_id_writeAudioTrack_,
-                                                           jarray, buff_size_, playback_pos_us);
+                                                           jarray, buff_size_, playback_pos_us,
+                                                           static_cast<jfloat>(playback_rate));
                     lk.lock();
                     if (bytes_written < buff_size_) {
                         // we use stereo s16, so it needs 4 bytes one sample
@@ -158,15 +161,13 @@ namespace whensunset {
                         j_method_id_getCurrentPositionUsAudioTrack_);
                 playback_pts = audio_track_time_us / 1000000.0;
 
-                if (playback_pts > -TIME_EPS && project.media_asset_size() > 0) {
-                    render_pos_sec = playback_pts;
+                if (playback_pts > -TIME_EPS && project.media_asset_size() > 0 && ref_clock_) {
+                    // the track position moves in output bursts, the clock interpolates between them
+                    ref_clock_->Sync(playback_pts);
+                    render_pos_sec = ref_clock_->GetRenderPos();
                 }
             }
 
-
-            if (ref_clock_) {
-                ref_clock_->SetPts(render_pos_sec);
-            }
             if (player_time_message_center_) {
                 player_time_message_center_->AddMessage(render_pos_sec);
             }
@@ -209,6 +210,9 @@ namespace whensunset {
             if (is_inited_) {
                 is_playing_ = false;
             }
+            if (ref_clock_) {
+                ref_clock_->Pause();
+            }
             AttachCurrentThreadIfNeeded attached;
             JNIEnv *env = attached.jni();
             env->CallVoidMethod(audioplay_by_audiotrack_service_(), j_method_id_pauseAudioTrack_);
@@ -2,6 +2,7 @@
 #include "ws_video_editor_sdk_android_jni.pb.h"
 #include "native_ws_media_player.h"
 #include "ws_editor_video_sdk_utils.h"
+#include "jni_helper.h"
 
 using namespace whensunset::wsvideoeditor;
 
@@ -102,3 +103,168 @@ extern "C" JNIEXPORT jdouble JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMedi
     NativeWSMediaPlayer *native_player = reinterpret_cast<NativeWSMediaPlayer *>(address);
     return native_player->current_time();
 }
+
+extern "C" JNIEXPORT void JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_enableProxyMediaNative
+        (JNIEnv *env, jobject, jlong address, jstring cache_dir, jdouble pixel_rate_threshold) {
+    NativeWSMediaPlayer *native_player = reinterpret_cast<NativeWSMediaPlayer *>(address);
+    const char *cache_dir_chars = env->GetStringUTFChars(cache_dir, nullptr);
+    if (!cache_dir_chars) {
+        return;
+    }
+    std::string cache_dir_str(cache_dir_chars);
+    env->ReleaseStringUTFChars(cache_dir, cache_dir_chars);
+    native_player->EnableProxyMedia(cache_dir_str, pixel_rate_threshold);
+}
+
+extern "C" JNIEXPORT void JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_enableAudioPcmCacheNative
+        (JNIEnv *env, jobject, jlong address, jstring temp_dir, jlong ram_budget_bytes) {
+    NativeWSMediaPlayer *native_player = reinterpret_cast<NativeWSMediaPlayer *>(address);
+    const char *temp_dir_chars = env->GetStringUTFChars(temp_dir, nullptr);
+    if (!temp_dir_chars) {
+        return;
+    }
+    std::string temp_dir_str(temp_dir_chars);
+    env->ReleaseStringUTFChars(temp_dir, temp_dir_chars);
+    native_player->EnableAudioPcmCache(temp_dir_str, ram_budget_bytes);
+}
+
+extern "C" JNIEXPORT void JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_enableAudioWaveformNative
+        (JNIEnv *env, jobject, jlong address, jstring cache_dir) {
+    NativeWSMediaPlayer *native_player = reinterpret_cast<NativeWSMediaPlayer *>(address);
+    const char *cache_dir_chars = env->GetStringUTFChars(cache_dir, nullptr);
+    if (!cache_dir_chars) {
+        return;
+    }
+    std::string cache_dir_str(cache_dir_chars);
+    env->ReleaseStringUTFChars(cache_dir, cache_dir_chars);
+    native_player->EnableAudioWaveform(cache_dir_str);
+}
+
+extern "C" JNIEXPORT void JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_requestAudioWaveformNative
+        (JNIEnv *env, jobject, jlong address, jstring path) {
+    NativeWSMediaPlayer *native_player = reinterpret_cast<NativeWSMediaPlayer *>(address);
+    const char *path_chars = env->GetStringUTFChars(path, nullptr);
+    if (!path_chars) {
+        return;
+    }
+    std::string path_str(path_chars);
+    env->ReleaseStringUTFChars(path, path_chars);
+    native_player->RequestAudioWaveform(path_str);
+}
+
+static jshortArray NewPeaksArray(JNIEnv *env, const std::vector<int16_t> &peaks) {
+    jint size = static_cast<jint>(peaks.size());
+    jshortArray ret = env->NewShortArray(size);
+    if (ret) {
+        env->SetShortArrayRegion(ret, 0, size, reinterpret_cast<const jshort *>(peaks.data()));
+    }
+    return ret;
+}
+
+extern "C" JNIEXPORT jobject JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_getAudioWaveformNative
+        (JNIEnv *env, jobject, jlong address, jstring path, jdouble samples_per_pixel) {
+    NativeWSMediaPlayer *native_player = reinterpret_cast<NativeWSMediaPlayer *>(address);
+    const char *path_chars = env->GetStringUTFChars(path, nullptr);
+    if (!path_chars) {
+        return nullptr;
+    }
+    std::string path_str(path_chars);
+    env->ReleaseStringUTFChars(path, path_chars);
+    std::shared_ptr<const AudioWaveform> waveform = native_player->GetAudioWaveform(path_str);
+    if (!waveform) {
+        return nullptr;
+    }
+    const AudioWaveformLevel *level = waveform->LevelForSamplesPerPixel(samples_per_pixel);
+    if (!level) {
+        return nullptr;
+    }
+    LocalRef<jclass> level_class(env, env->FindClass(
+            "com/whensunset/wsvideoeditorsdk/AudioWaveformLevel"));
+    if (!level_class()) {
+        return nullptr;
+    }
+    jmethodID constructor = env->GetMethodID(level_class(), "<init>", "(IJI[S[S[S)V");
+    if (!constructor) {
+        return nullptr;
+    }
+    LocalRef<jshortArray> min_peaks(env, NewPeaksArray(env, level->min_peaks));
+    LocalRef<jshortArray> max_peaks(env, NewPeaksArray(env, level->max_peaks));
+    LocalRef<jshortArray> rms_peaks(env, NewPeaksArray(env, level->rms_peaks));
+    if (!min_peaks() || !max_peaks() || !rms_peaks()) {
+        return nullptr;
+    }
+    return env->NewObject(level_class(), constructor, static_cast<jint>(waveform->sample_rate),
+                          static_cast<jlong>(waveform->nb_samples),
+                          static_cast<jint>(level->samples_per_peak), min_peaks(), max_peaks(),
+                          rms_peaks());
+}
+
+extern "C" JNIEXPORT void JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_setPlaybackRateNative
+        (JNIEnv *env, jobject, jlong address, jdouble playback_rate) {
+    NativeWSMediaPlayer *native_player = reinterpret_cast<NativeWSMediaPlayer *>(address);
+    native_player->SetPlaybackRate(playback_rate);
+}
+
+extern "C" JNIEXPORT void JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_setLoopRegionNative
+        (JNIEnv *env, jobject, jlong address, jdouble loop_start, jdouble loop_end) {
+    NativeWSMediaPlayer *native_player = reinterpret_cast<NativeWSMediaPlayer *>(address);
+    native_player->SetLoopRegion(loop_start, loop_end);
+}
+
+extern "C" JNIEXPORT void JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_clearLoopRegionNative
+        (JNIEnv *env, jobject, jlong address) {
+    NativeWSMediaPlayer *native_player = reinterpret_cast<NativeWSMediaPlayer *>(address);
+    native_player->ClearLoopRegion();
+}
+
+extern "C" JNIEXPORT jdoubleArray JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_getSeekStatsNative
+        (JNIEnv *env, jobject, jlong address) {
+    NativeWSMediaPlayer *native_player = reinterpret_cast<NativeWSMediaPlayer *>(address);
+    SeekStats stats = native_player->seek_stats();
+    const whensunset::base::LatencyHistogram *histograms[] = {&stats.first_frame_latency,
+                                                              &stats.ready_latency};
+    // 布局和 WsMediaPlayer.getSeekStats 的注释一致
+    jdouble values[11];
+    int index = 0;
+    for (const whensunset::base::LatencyHistogram *histogram : histograms) {
+        values[index++] = histogram->count();
+        values[index++] = histogram->PercentileMs(0.5);
+        values[index++] = histogram->PercentileMs(0.9);
+        values[index++] = histogram->PercentileMs(0.99);
+        values[index++] = histogram->max_ms();
+    }
+    values[index++] = stats.coalesced_count;
+    jdoubleArray ret = env->NewDoubleArray(index);
+    if (!ret) {
+        return nullptr;
+    }
+    env->SetDoubleArrayRegion(ret, 0, index, values);
+    return ret;
+}
+
+extern "C" JNIEXPORT jdoubleArray JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_getFirstFrameStatsNative
+        (JNIEnv *env, jobject, jlong address) {
+    NativeWSMediaPlayer *native_player = reinterpret_cast<NativeWSMediaPlayer *>(address);
+    FirstFrameStats stats = native_player->first_frame_stats();
+    // 布局和 WsMediaPlayer.getFirstFrameStats 的注释一致
+    jdouble values[] = {stats.set_project_to_first_frame_ms, stats.attach_to_first_frame_ms,
+                        stats.from_poster_frame ? 1.0 : 0.0};
+    jdoubleArray ret = env->NewDoubleArray(3);
+    if (!ret) {
+        return nullptr;
+    }
+    env->SetDoubleArrayRegion(ret, 0, 3, values);
+    return ret;
+}
+
+extern "C" JNIEXPORT void JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_setSpeculativeDecodeEnabledNative
+        (JNIEnv *env, jobject, jlong address, jboolean enabled) {
+    NativeWSMediaPlayer *native_player = reinterpret_cast<NativeWSMediaPlayer *>(address);
+    native_player->SetSpeculativeDecodeEnabled(enabled);
+}
+
+extern "C" JNIEXPORT void JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_setPosterFrameCacheEnabledNative
+        (JNIEnv *env, jobject, jlong address, jboolean enabled) {
+    NativeWSMediaPlayer *native_player = reinterpret_cast<NativeWSMediaPlayer *>(address);
+    native_player->SetPosterFrameCacheEnabled(enabled);
+}
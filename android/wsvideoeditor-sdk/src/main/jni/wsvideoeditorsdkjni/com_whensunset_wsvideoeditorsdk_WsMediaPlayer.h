@@ -103,6 +103,102 @@ JNIEXPORT jboolean JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_is
 JNIEXPORT jdouble JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_getCurrentTimeNative
   (JNIEnv *, jobject, jlong);
 
+/*
+ * Class:     com_whensunset_wsvideoeditorsdk_WsMediaPlayer
+ * Method:    enableProxyMediaNative
+ * Signature: (JLjava/lang/String;D)V
+ */
+JNIEXPORT void JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_enableProxyMediaNative
+  (JNIEnv *, jobject, jlong, jstring, jdouble);
+
+/*
+ * Class:     com_whensunset_wsvideoeditorsdk_WsMediaPlayer
+ * Method:    enableAudioPcmCacheNative
+ * Signature: (JLjava/lang/String;J)V
+ */
+JNIEXPORT void JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_enableAudioPcmCacheNative
+  (JNIEnv *, jobject, jlong, jstring, jlong);
+
+/*
+ * Class:     com_whensunset_wsvideoeditorsdk_WsMediaPlayer
+ * Method:    enableAudioWaveformNative
+ * Signature: (JLjava/lang/String;)V
+ */
+JNIEXPORT void JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_enableAudioWaveformNative
+  (JNIEnv *, jobject, jlong, jstring);
+
+/*
+ * Class:     com_whensunset_wsvideoeditorsdk_WsMediaPlayer
+ * Method:    requestAudioWaveformNative
+ * Signature: (JLjava/lang/String;)V
+ */
+JNIEXPORT void JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_requestAudioWaveformNative
+  (JNIEnv *, jobject, jlong, jstring);
+
+/*
+ * Class:     com_whensunset_wsvideoeditorsdk_WsMediaPlayer
+ * Method:    getAudioWaveformNative
+ * Signature: (JLjava/lang/String;D)Lcom/whensunset/wsvideoeditorsdk/AudioWaveformLevel;
+ */
+JNIEXPORT jobject JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_getAudioWaveformNative
+  (JNIEnv *, jobject, jlong, jstring, jdouble);
+
+/*
+ * Class:     com_whensunset_wsvideoeditorsdk_WsMediaPlayer
+ * Method:    setPlaybackRateNative
+ * Signature: (JD)V
+ */
+JNIEXPORT void JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_setPlaybackRateNative
+  (JNIEnv *, jobject, jlong, jdouble);
+
+/*
+ * Class:     com_whensunset_wsvideoeditorsdk_WsMediaPlayer
+ * Method:    setLoopRegionNative
+ * Signature: (JDD)V
+ */
+JNIEXPORT void JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_setLoopRegionNative
+  (JNIEnv *, jobject, jlong, jdouble, jdouble);
+
+/*
+ * Class:     com_whensunset_wsvideoeditorsdk_WsMediaPlayer
+ * Method:    clearLoopRegionNative
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_clearLoopRegionNative
+  (JNIEnv *, jobject, jlong);
+
+/*
+ * Class:     com_whensunset_wsvideoeditorsdk_WsMediaPlayer
+ * Method:    getSeekStatsNative
+ * Signature: (J)[D
+ */
+JNIEXPORT jdoubleArray JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_getSeekStatsNative
+  (JNIEnv *, jobject, jlong);
+
+/*
+ * Class:     com_whensunset_wsvideoeditorsdk_WsMediaPlayer
+ * Method:    getFirstFrameStatsNative
+ * Signature: (J)[D
+ */
+JNIEXPORT jdoubleArray JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_getFirstFrameStatsNative
+  (JNIEnv *, jobject, jlong);
+
+/*
+ * Class:     com_whensunset_wsvideoeditorsdk_WsMediaPlayer
+ * Method:    setSpeculativeDecodeEnabledNative
+ * Signature: (JZ)V
+ */
+JNIEXPORT void JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_setSpeculativeDecodeEnabledNative
+  (JNIEnv *, jobject, jlong, jboolean);
+
+/*
+ * Class:     com_whensunset_wsvideoeditorsdk_WsMediaPlayer
+ * Method:    setPosterFrameCacheEnabledNative
+ * Signature: (JZ)V
+ */
+JNIEXPORT void JNICALL Java_com_whensunset_wsvideoeditorsdk_WsMediaPlayer_setPosterFrameCacheEnabledNative
+  (JNIEnv *, jobject, jlong, jboolean);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,6 +1,7 @@
 #include "com_whensunset_wsvideoeditorsdk_WsVideoEditorUtils.h"
 
 #include "ws_editor_video_sdk_utils.h"
+#include <wsvideoeditorsdk/audio_decode/audio_decode_service.h>
 
 using namespace whensunset::wsvideoeditor;
 
@@ -8,3 +9,24 @@ JNIEXPORT void JNICALL Java_com_whensunset_wsvideoeditorsdk_WsVideoEditorUtils_i
         (JNIEnv *, jclass) {
     InitSDK();
 }
+
+JNIEXPORT jdouble JNICALL Java_com_whensunset_wsvideoeditorsdk_WsVideoEditorUtils_mixDownAudioToWavNative
+        (JNIEnv *env, jclass, jbyteArray buffer, jstring wav_path, jdouble start_sec,
+         jdouble duration_sec) {
+    model::EditorProject project;
+    jbyte *buffer_elements = env->GetByteArrayElements(buffer, 0);
+    if (!buffer_elements) {
+        return AVERROR(ENOMEM);
+    }
+    project.ParseFromArray(buffer_elements, env->GetArrayLength(buffer));
+    env->ReleaseByteArrayElements(buffer, buffer_elements, 0);
+    const char *wav_path_chars = env->GetStringUTFChars(wav_path, nullptr);
+    if (!wav_path_chars) {
+        return AVERROR(ENOMEM);
+    }
+    std::string wav_path_str(wav_path_chars);
+    env->ReleaseStringUTFChars(wav_path, wav_path_chars);
+    AudioMixDownStats stats;
+    int ret = MixDownAudioToWav(project, wav_path_str, start_sec, duration_sec, &stats);
+    return ret < 0 ? ret : stats.realtime_factor;
+}
@@ -15,6 +15,14 @@ extern "C" {
 JNIEXPORT void JNICALL Java_com_whensunset_wsvideoeditorsdk_WsVideoEditorUtils_initJniNative
   (JNIEnv *, jclass);
 
+/*
+ * Class:     com_whensunset_wsvideoeditorsdk_WsVideoEditorUtils
+ * Method:    mixDownAudioToWavNative
+ * Signature: ([BLjava/lang/String;DD)D
+ */
+JNIEXPORT jdouble JNICALL Java_com_whensunset_wsvideoeditorsdk_WsVideoEditorUtils_mixDownAudioToWavNative
+  (JNIEnv *, jclass, jbyteArray, jstring, jdouble, jdouble);
+
 #ifdef __cplusplus
 }
 #endif
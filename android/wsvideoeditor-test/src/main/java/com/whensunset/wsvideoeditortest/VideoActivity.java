@@ -4,6 +4,7 @@ import android.Manifest;
 import android.app.Activity;
 import android.os.Bundle;
 import android.support.annotation.Nullable;
+import android.util.Log;
 import android.view.View;
 import android.widget.Button;
 
@@ -13,13 +14,38 @@ import com.whensunset.wsvideoeditorsdk.WsVideoEditorUtils;
 import com.whensunset.wsvideoeditorsdk.model.EditorProject;
 import com.whensunset.wsvideoeditorsdk.model.MediaAsset;
 
+import java.util.Arrays;
+
 import pub.devrel.easypermissions.EasyPermissions;
 
 public class VideoActivity extends Activity {
+  
+  /**
+   * 第一帧耗时测量，ttff.sh 用 am start 带上这些参数启动：ttff_runs 大于 0 的时候不正常播放，
+   * 而是依次创建 ttff_runs 个播放器，每个都 setProject 之后等 attach_delay_ms 再 attach（模拟 surface
+   * 创建的耗时），画出第一帧之后用 TTFF_TAG 打印 getFirstFrameStats 的结果再释放掉。
+   * 进程里的第一个播放器没有封面帧缓存，之后的都能命中
+   */
+  private static final String TTFF_TAG = "WsTTFF";
+  private static final String EXTRA_TTFF_RUNS = "ttff_runs";
+  private static final String EXTRA_SPECULATIVE_DECODE = "speculative_decode";
+  private static final String EXTRA_POSTER_FRAME_CACHE = "poster_frame_cache";
+  private static final String EXTRA_ATTACH_DELAY_MS = "attach_delay_ms";
+  private static final int TTFF_POLL_INTERVAL_MS = 16;
+  private static final int TTFF_TIMEOUT_MS = 5000;
 
   private WsMediaPlayerView mPreviewView;
   private WsMediaPlayer mPlayer = null;
   private Button playBtn;
+  private EditorProject mProject;
+  
+  private int mTtffRuns;
+  private boolean mSpeculativeDecode;
+  private boolean mPosterFrameCache;
+  private int mAttachDelayMs;
+  private int mTtffRunIndex;
+  private long mTtffRunStartTime;
+  private double[] mAttachToFirstFrameMs;
 
   private void updatePlayStateShow() {
     if (mPlayer != null) {
@@ -55,17 +81,20 @@ public class VideoActivity extends Activity {
       MediaAsset.Builder trackAssetBuilder = MediaAsset.newBuilder();
       trackAssetBuilder.setAssetId(System.currentTimeMillis()).setAssetPath("/sdcard/test.mp4").setVolume(1.0);
       videoEditorProjectBuilder.addMediaAsset(trackAssetBuilder.build()).setBlurPaddingArea(true);
-
-      mPlayer = new WsMediaPlayer();
-      mPlayer.setProject(videoEditorProjectBuilder.build());
-
-      try {
-        mPlayer.loadProject();
-      } catch (Exception e) {
-        e.printStackTrace();
-        throw new RuntimeException(e);
+      mProject = videoEditorProjectBuilder.build();
+      
+      mTtffRuns = getIntent().getIntExtra(EXTRA_TTFF_RUNS, 0);
+      mSpeculativeDecode = getIntent().getBooleanExtra(EXTRA_SPECULATIVE_DECODE, true);
+      mPosterFrameCache = getIntent().getBooleanExtra(EXTRA_POSTER_FRAME_CACHE, true);
+      mAttachDelayMs = getIntent().getIntExtra(EXTRA_ATTACH_DELAY_MS, 100);
+      if (mTtffRuns > 0) {
+        mAttachToFirstFrameMs = new double[mTtffRuns];
+        mTtffRunIndex = 0;
+        startTtffRun();
+        return;
       }
 
+      mPlayer = createPlayer();
       mPreviewView.setPreviewPlayer(mPlayer);
       mPlayer.play();
 
@@ -88,6 +117,76 @@ public class VideoActivity extends Activity {
     }
   }
 
+  private WsMediaPlayer createPlayer() {
+    WsMediaPlayer player = new WsMediaPlayer();
+    player.setSpeculativeDecodeEnabled(mSpeculativeDecode);
+    player.setPosterFrameCacheEnabled(mPosterFrameCache);
+    player.setProject(mProject);
+    try {
+      player.loadProject();
+    } catch (Exception e) {
+      e.printStackTrace();
+      throw new RuntimeException(e);
+    }
+    return player;
+  }
+  
+  private void startTtffRun() {
+    mPlayer = createPlayer();
+    mTtffRunStartTime = System.currentTimeMillis();
+    mPreviewView.postDelayed(new Runnable() {
+      @Override
+      public void run() {
+        if (mPlayer != null) {
+          mPreviewView.setPreviewPlayer(mPlayer);
+          pollFirstFrameStats();
+        }
+      }
+    }, mAttachDelayMs);
+  }
+  
+  private void pollFirstFrameStats() {
+    if (mPlayer == null) {
+      return;
+    }
+    double[] stats = mPlayer.getFirstFrameStats();
+    boolean timeout = System.currentTimeMillis() - mTtffRunStartTime > TTFF_TIMEOUT_MS;
+    if (stats != null && stats[0] < 0 && !timeout) {
+      mPreviewView.postDelayed(new Runnable() {
+        @Override
+        public void run() {
+          pollFirstFrameStats();
+        }
+      }, TTFF_POLL_INTERVAL_MS);
+      return;
+    }
+    if (stats == null || stats[0] < 0) {
+      Log.i(TTFF_TAG, "run:" + mTtffRunIndex + " timeout");
+      mAttachToFirstFrameMs[mTtffRunIndex] = -1;
+    } else {
+      Log.i(TTFF_TAG, "run:" + mTtffRunIndex + " speculative_decode:" + mSpeculativeDecode
+          + " poster_frame_cache:" + mPosterFrameCache + " set_project_to_first_frame_ms:"
+          + stats[0] + " attach_to_first_frame_ms:" + stats[1] + " from_poster_frame:"
+          + (stats[2] > 0));
+      mAttachToFirstFrameMs[mTtffRunIndex] = stats[1];
+    }
+    mPreviewView.setPreviewPlayer(null);
+    mPlayer.release();
+    mPlayer = null;
+    if (++mTtffRunIndex < mTtffRuns) {
+      startTtffRun();
+      return;
+    }
+    // 第一次是冷启动，封面帧缓存还是空的，单独列出来，其余的取中位数
+    double[] warmRuns = Arrays.copyOfRange(mAttachToFirstFrameMs, 1, mTtffRuns);
+    Arrays.sort(warmRuns);
+    Log.i(TTFF_TAG, "summary speculative_decode:" + mSpeculativeDecode + " poster_frame_cache:"
+        + mPosterFrameCache + " attach_delay_ms:" + mAttachDelayMs + " runs:" + mTtffRuns
+        + " cold_attach_to_first_frame_ms:" + mAttachToFirstFrameMs[0]
+        + " warm_median_attach_to_first_frame_ms:"
+        + (warmRuns.length > 0 ? warmRuns[warmRuns.length / 2] : -1));
+  }
+  
   @Override
   protected void onDestroy() {
     if (mPlayer != null) {
@@ -0,0 +1,32 @@
+#!/bin/bash
+# 在连着的手机上对比第一帧耗时，需要 /sdcard/test.mp4 和已经安装好的 wsvideoeditor-test:
+#   ./ttff.sh [每种配置的次数，默认 5] [attach 之前等待的毫秒数，默认 100]
+# 提前解码和封面帧缓存的四种开关组合各冷启动一次进程，进程里第一次打开没有封面帧缓存，
+# 之后的都能命中，最后打印每种组合的冷启动耗时和之后几次的中位数
+RUNS=${1:-5}
+ATTACH_DELAY_MS=${2:-100}
+ACTIVITY=com.whensunset.wsvideoeditortest/.VideoActivity
+
+for speculative in true false; do
+  for poster in true false; do
+    adb logcat -c
+    adb shell am start -S -W -n $ACTIVITY --ei ttff_runs "$RUNS" \
+        --ez speculative_decode $speculative --ez poster_frame_cache $poster \
+        --ei attach_delay_ms "$ATTACH_DELAY_MS" > /dev/null
+    summary=""
+    for _ in $(seq 1 60); do
+      summary=$(adb logcat -d -s WsTTFF:I | grep "summary")
+      if [ -n "$summary" ]; then
+        break
+      fi
+      sleep 1
+    done
+    adb logcat -d -s WsTTFF:I | grep "run:"
+    if [ -z "$summary" ]; then
+      echo "speculative_decode:$speculative poster_frame_cache:$poster timeout"
+    else
+      echo "$summary"
+    fi
+  done
+done
+adb shell am force-stop ${ACTIVITY%%/*}
@@ -0,0 +1,173 @@
+// Mixes down a project of generated WAV clips through AudioDecodeService, at 1x and through the
+// time stretcher, and checks that ScratchBufferAllocationCount() stops growing inside every clip
+// once its decoder has warmed up. Also reports how much faster than real time the mix-down runs.
+#include "audio_decode_service.h"
+#include "audio_wav_writer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace whensunset::wsvideoeditor;
+
+namespace {
+    // the first chunks of a clip open its decoder and size its buffers, the stretcher mixes
+    // ahead of its output, so the next clip's decoder warms up before the output gets there
+    const double kWarmUpSec = 1.0;
+    const double kLookAheadSec = 0.5;
+
+    struct ClipFile {
+        int channels;
+        int sample_rate;
+        double duration;
+        // a zero duration clip uses the whole file
+        double clip_start;
+        double clip_duration;
+    };
+
+    // native format, resampled and upmixed, and a clipped range that starts with a seek
+    const ClipFile kClips[] = {
+            {2, 44100, 8.0, 0.0, 0.0},
+            {1, 48000, 8.0, 0.0, 0.0},
+            {2, 22050, 8.0, 1.0, 6.0},
+    };
+
+    int failures = 0;
+
+    int WriteSineWav(const std::string &path, const ClipFile &clip, double frequency) {
+        AudioWavWriter writer;
+        int ret = writer.Open(path, clip.channels, clip.sample_rate);
+        if (ret < 0) {
+            return ret;
+        }
+        std::vector<int16_t> samples(clip.channels * clip.sample_rate / 10);
+        int64_t total = static_cast<int64_t>(clip.duration * clip.sample_rate);
+        for (int64_t written = 0; written < total;) {
+            int frames = static_cast<int>(std::min<int64_t>(clip.sample_rate / 10, total - written));
+            for (int i = 0; i < frames; ++i) {
+                int16_t value = static_cast<int16_t>(
+                        8000.0 * sin(2.0 * M_PI * frequency * (written + i) / clip.sample_rate));
+                for (int c = 0; c < clip.channels; ++c) {
+                    samples[i * clip.channels + c] = value;
+                }
+            }
+            ret = writer.Write(reinterpret_cast<const uint8_t *>(samples.data()),
+                               frames * clip.channels * 2);
+            if (ret < 0) {
+                return ret;
+            }
+            written += frames;
+        }
+        return writer.Close();
+    }
+
+    void RunMixDown(const model::EditorProject &project, double rate,
+                    const std::vector<double> &clip_starts, double duration) {
+        AudioDecodeService service;
+        service.SetPlaybackRate(rate);
+        int bytes_per_second = service.dst_channels() * 2 * service.dst_sample_rate();
+
+        // allocation count after every chunk, keyed by the track position the chunk ends at
+        std::vector<double> chunk_end_pos;
+        std::vector<int64_t> chunk_allocations;
+        int64_t output_bytes = 0;
+        int64_t allocations_before = whensunset::base::ScratchBufferAllocationCount().load();
+        AudioMixDownStats stats;
+        int ret = service.MixDown(
+                project, 0.0, duration,
+                [&](const uint8_t *data, int size) {
+                    output_bytes += size;
+                    chunk_end_pos.push_back(rate * output_bytes / bytes_per_second);
+                    chunk_allocations.push_back(
+                            whensunset::base::ScratchBufferAllocationCount().load());
+                    return 0;
+                }, &stats);
+        if (ret < 0) {
+            ++failures;
+            printf("FAIL MixDown rate:%.2f ret:%d\n", rate, ret);
+            return;
+        }
+
+        for (int clip = 0; clip < clip_starts.size(); ++clip) {
+            double stable_begin = clip_starts[clip] + kWarmUpSec;
+            double stable_end = (clip + 1 < clip_starts.size() ? clip_starts[clip + 1] : duration) -
+                                kLookAheadSec;
+            int64_t first = -1;
+            int64_t last = -1;
+            for (int i = 0; i < chunk_end_pos.size(); ++i) {
+                if (chunk_end_pos[i] <= stable_begin || chunk_end_pos[i] >= stable_end) {
+                    continue;
+                }
+                if (first < 0) {
+                    first = chunk_allocations[i];
+                }
+                last = chunk_allocations[i];
+            }
+            if (first < 0 || last != first) {
+                ++failures;
+                printf("FAIL rate:%.2f clip:%d allocations grew from %lld to %lld in [%.1f, %.1f) s\n",
+                       rate, clip, static_cast<long long>(first), static_cast<long long>(last),
+                       stable_begin, stable_end);
+            }
+        }
+        printf("rate:%.2f chunks:%d scratch allocations:%lld realtime factor:%.1fx\n", rate,
+               static_cast<int>(chunk_end_pos.size()),
+               static_cast<long long>(whensunset::base::ScratchBufferAllocationCount().load() -
+                                      allocations_before), stats.realtime_factor);
+    }
+}
+
+int main() {
+#if LIBAVFORMAT_VERSION_MAJOR < 58
+    av_register_all();
+#endif
+    char temp_dir[] = "/tmp/ws_audio_mix_XXXXXX";
+    if (!mkdtemp(temp_dir)) {
+        printf("mkdtemp failed\n");
+        return 1;
+    }
+
+    model::EditorProject project;
+    std::vector<std::string> paths;
+    std::vector<double> clip_starts;
+    double duration = 0.0;
+    for (int i = 0; i < sizeof(kClips) / sizeof(kClips[0]); ++i) {
+        const ClipFile &clip = kClips[i];
+        std::string path = std::string(temp_dir) + "/clip" + std::to_string(i) + ".wav";
+        if (WriteSineWav(path, clip, 220.0 * (i + 1)) < 0) {
+            printf("WriteSineWav failed path:%s\n", path.c_str());
+            return 1;
+        }
+        paths.push_back(path);
+
+        model::MediaAsset *asset = project.add_media_asset();
+        asset->set_asset_id(i + 1);
+        asset->set_asset_path(path);
+        asset->set_volume(1.0);
+        asset->mutable_media_asset_file_holder()->set_duration(clip.duration);
+        if (clip.clip_duration > 0.0) {
+            model::TimeRange *range = asset->add_clipped_time_range();
+            range->set_start(clip.clip_start);
+            range->set_duration(clip.clip_duration);
+        }
+        clip_starts.push_back(duration);
+        duration += clip.clip_duration > 0.0 ? clip.clip_duration : clip.duration;
+    }
+
+    RunMixDown(project, 1.0, clip_starts, duration);
+    RunMixDown(project, 1.5, clip_starts, duration);
+
+    for (const std::string &path : paths) {
+        unlink(path.c_str());
+    }
+    rmdir(temp_dir);
+    if (failures > 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("scratch allocations stay flat after warm-up in every clip\n");
+    return 0;
+}
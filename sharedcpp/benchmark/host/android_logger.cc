@@ -0,0 +1,25 @@
+#include "android_logger.h"
+#include <cstdarg>
+#include <cstdio>
+
+namespace whensunset {
+    namespace wsvideoeditor {
+        namespace android_logger {
+            void Init() {}
+
+            int LogPrint(int priority, const char *tag, const char *fmt, ...) {
+                // benchmark 只关心警告和错误
+                if (priority < ANDROID_LOG_WARN) {
+                    return 0;
+                }
+                va_list args;
+                va_start(args, fmt);
+                fprintf(stderr, "%s: ", tag);
+                int ret = vfprintf(stderr, fmt, args);
+                fputc('\n', stderr);
+                va_end(args);
+                return ret;
+            }
+        }
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef SHAREDCPP_WS_VIDEO_EDITOR_BENCHMARK_HOST_ANDROID_LOGGER_H
+#define SHAREDCPP_WS_VIDEO_EDITOR_BENCHMARK_HOST_ANDROID_LOGGER_H
+
+// 开发机上代替 jni 目录里的 android_logger.h，platform_logger.h 的 LOG 宏打印到 stderr
+
+enum {
+    ANDROID_LOG_VERBOSE = 2,
+    ANDROID_LOG_DEBUG,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR,
+};
+
+namespace whensunset {
+    namespace wsvideoeditor {
+        namespace android_logger {
+            void Init();
+
+            int LogPrint(int, const char *, const char *, ...);
+        }
+    }
+}
+#endif
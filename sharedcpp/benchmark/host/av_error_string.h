@@ -0,0 +1,19 @@
+#ifndef SHAREDCPP_WS_VIDEO_EDITOR_BENCHMARK_HOST_AV_ERROR_STRING_H
+#define SHAREDCPP_WS_VIDEO_EDITOR_BENCHMARK_HOST_AV_ERROR_STRING_H
+
+// ffmpeg 的 av_err2str 用了 C 的复合字面量，NDK 的 clang 当扩展接受，开发机上的 gcc 编不过。
+// 编译时用 -include 先引入这个文件，换成临时对象里的数组，生命周期一样到整个表达式结束
+
+extern "C" {
+#include <libavutil/error.h>
+};
+
+struct AvErrorStringBuffer {
+    char data[AV_ERROR_MAX_STRING_SIZE];
+};
+
+#undef av_err2str
+#define av_err2str(errnum) \
+    av_make_error_string(AvErrorStringBuffer().data, AV_ERROR_MAX_STRING_SIZE, errnum)
+
+#endif
@@ -0,0 +1,244 @@
+// Converts every pixel format LibyuvI420Converter supports to YUV420P, checks the result against
+// sws_scale and against a scalar BT.601 reference built from the same RGB image, and reports
+// LibyuvI420Converter against the SWS_FAST_BILINEAR path it replaced.
+#include "libyuv_i420_converter.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include <libswscale/swscale.h>
+};
+
+using namespace whensunset::wsvideoeditor;
+
+namespace {
+    const int kWidth = 1920;
+    const int kHeight = 1080;
+    const double kBenchmarkSec = 0.3;
+
+    // libyuv and swscale round and filter chroma differently, a wrong byte order or range is off
+    // by tens of levels on the gradient image
+    const double kMaxMeanDiff = 1.5;
+    const double kMaxScaledMeanDiff = 2.5;
+
+    struct FormatCase {
+        AVPixelFormat format;
+        const char *name;
+        bool is_rgb;
+        bool full_range;
+    };
+
+    const FormatCase kFormats[] = {
+            {AV_PIX_FMT_NV12,     "nv12",     false, false},
+            {AV_PIX_FMT_NV21,     "nv21",     false, false},
+            {AV_PIX_FMT_YUV422P,  "yuv422p",  false, false},
+            {AV_PIX_FMT_YUVJ422P, "yuvj422p", false, true},
+            {AV_PIX_FMT_YUV444P,  "yuv444p",  false, false},
+            {AV_PIX_FMT_YUVJ444P, "yuvj444p", false, true},
+            {AV_PIX_FMT_ARGB,     "argb",     true,  false},
+            {AV_PIX_FMT_0RGB,     "0rgb",     true,  false},
+            {AV_PIX_FMT_ABGR,     "abgr",     true,  false},
+            {AV_PIX_FMT_0BGR,     "0bgr",     true,  false},
+            {AV_PIX_FMT_BGRA,     "bgra",     true,  false},
+            {AV_PIX_FMT_BGR0,     "bgr0",     true,  false},
+            {AV_PIX_FMT_RGBA,     "rgba",     true,  false},
+            {AV_PIX_FMT_RGB0,     "rgb0",     true,  false},
+            {AV_PIX_FMT_RGB24,    "rgb24",    true,  false},
+            {AV_PIX_FMT_BGR24,    "bgr24",    true,  false},
+    };
+
+    int failures = 0;
+
+    void Check(bool ok, const char *what, const char *format, double value) {
+        if (!ok) {
+            ++failures;
+            printf("FAIL %s format:%s value:%.3f\n", what, format, value);
+        }
+    }
+
+    UniqueAVFramePtr AllocFrame(AVPixelFormat format, int width, int height) {
+        UniqueAVFramePtr frame(AllocVideoFrame(format, width, height), FreeAVFrame);
+        if (!frame) {
+            printf("AllocVideoFrame failed format:%d\n", format);
+            exit(1);
+        }
+        return frame;
+    }
+
+    bool SwsConvert(const AVFrame *src, AVFrame *dst, int flags) {
+        SwsContext *context = sws_getContext(src->width, src->height,
+                                             static_cast<AVPixelFormat>(src->format),
+                                             dst->width, dst->height,
+                                             static_cast<AVPixelFormat>(dst->format),
+                                             flags, NULL, NULL, NULL);
+        if (!context) {
+            return false;
+        }
+        int ret = sws_scale(context, src->data, src->linesize, 0, src->height, dst->data,
+                            dst->linesize);
+        sws_freeContext(context);
+        return ret > 0;
+    }
+
+    // smooth gradients with a little noise, close to camera footage and different in every channel
+    // so a swapped R and B shows up in the chroma
+    UniqueAVFramePtr CreateRgbaImage() {
+        UniqueAVFramePtr image = AllocFrame(AV_PIX_FMT_RGBA, kWidth, kHeight);
+        std::mt19937 random(42);
+        std::uniform_int_distribution<int> noise(-3, 3);
+        for (int y = 0; y < kHeight; ++y) {
+            uint8_t *row = image->data[0] + y * image->linesize[0];
+            for (int x = 0; x < kWidth; ++x) {
+                int r = 255 * x / kWidth;
+                int g = 255 * y / kHeight;
+                int b = 255 - 255 * (x + y) / (kWidth + kHeight);
+                row[x * 4 + 0] = static_cast<uint8_t>(std::min(255, std::max(0, r + noise(random))));
+                row[x * 4 + 1] = static_cast<uint8_t>(std::min(255, std::max(0, g + noise(random))));
+                row[x * 4 + 2] = static_cast<uint8_t>(std::min(255, std::max(0, b + noise(random))));
+                row[x * 4 + 3] = 255;
+            }
+        }
+        return image;
+    }
+
+    // limited range BT.601 from the RGBA image, chroma averaged over each 2x2 block
+    UniqueAVFramePtr CreateReferenceI420(const AVFrame *rgba) {
+        UniqueAVFramePtr reference = AllocFrame(AV_PIX_FMT_YUV420P, kWidth, kHeight);
+        for (int y = 0; y < kHeight; ++y) {
+            const uint8_t *row = rgba->data[0] + y * rgba->linesize[0];
+            for (int x = 0; x < kWidth; ++x) {
+                double r = row[x * 4], g = row[x * 4 + 1], b = row[x * 4 + 2];
+                reference->data[0][y * reference->linesize[0] + x] = static_cast<uint8_t>(
+                        lround(16.0 + (65.481 * r + 128.553 * g + 24.966 * b) / 255.0));
+            }
+        }
+        for (int y = 0; y < kHeight / 2; ++y) {
+            for (int x = 0; x < kWidth / 2; ++x) {
+                double r = 0.0, g = 0.0, b = 0.0;
+                for (int dy = 0; dy < 2; ++dy) {
+                    const uint8_t *pixel = rgba->data[0] + (y * 2 + dy) * rgba->linesize[0] + x * 8;
+                    r += pixel[0] + pixel[4];
+                    g += pixel[1] + pixel[5];
+                    b += pixel[2] + pixel[6];
+                }
+                r /= 4.0;
+                g /= 4.0;
+                b /= 4.0;
+                reference->data[1][y * reference->linesize[1] + x] = static_cast<uint8_t>(
+                        lround(128.0 + (-37.797 * r - 74.203 * g + 112.0 * b) / 255.0));
+                reference->data[2][y * reference->linesize[2] + x] = static_cast<uint8_t>(
+                        lround(128.0 + (112.0 * r - 93.786 * g - 18.214 * b) / 255.0));
+            }
+        }
+        return reference;
+    }
+
+    double PlaneMeanDiff(const AVFrame *a, const AVFrame *b, int plane) {
+        int width = plane == 0 ? a->width : (a->width + 1) / 2;
+        int height = plane == 0 ? a->height : (a->height + 1) / 2;
+        int64_t sum = 0;
+        for (int y = 0; y < height; ++y) {
+            const uint8_t *row_a = a->data[plane] + y * a->linesize[plane];
+            const uint8_t *row_b = b->data[plane] + y * b->linesize[plane];
+            for (int x = 0; x < width; ++x) {
+                sum += std::abs(row_a[x] - row_b[x]);
+            }
+        }
+        return static_cast<double>(sum) / (width * height);
+    }
+
+    void CheckPlanes(const AVFrame *actual, const AVFrame *expected, const char *what,
+                     const char *format, double max_mean_diff) {
+        for (int plane = 0; plane < 3; ++plane) {
+            double diff = PlaneMeanDiff(actual, expected, plane);
+            Check(diff <= max_mean_diff, what, format, diff);
+        }
+    }
+
+    template<typename Convert>
+    double BenchmarkMsPerFrame(Convert convert) {
+        int frames = 0;
+        auto begin = std::chrono::steady_clock::now();
+        double elapsed = 0.0;
+        do {
+            convert();
+            ++frames;
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        } while (elapsed < kBenchmarkSec);
+        return elapsed * 1e3 / frames;
+    }
+
+    void RunFormat(const FormatCase &format_case, const AVFrame *rgba, const AVFrame *reference) {
+        const char *name = format_case.name;
+        UniqueAVFramePtr src = AllocFrame(format_case.format, kWidth, kHeight);
+        // RGB to RGB only reorders bytes, SWS_POINT keeps the reference exact for the RGB formats
+        if (!SwsConvert(rgba, src.get(), SWS_POINT | SWS_ACCURATE_RND | SWS_BITEXACT)) {
+            Check(false, "sws_scale to source format", name, 0.0);
+            return;
+        }
+        // the J formats stay full range, the shader reads color_range from the frame
+        AVPixelFormat i420_format = format_case.full_range ? AV_PIX_FMT_YUVJ420P
+                                                           : AV_PIX_FMT_YUV420P;
+
+        LibyuvI420Converter converter;
+        UniqueAVFramePtr libyuv_i420 = AllocFrame(AV_PIX_FMT_YUV420P, kWidth, kHeight);
+        Check(converter.Convert(src.get(), libyuv_i420.get()) == 0, "LibyuvI420Converter::Convert",
+              name, 0.0);
+        UniqueAVFramePtr sws_i420 = AllocFrame(i420_format, kWidth, kHeight);
+        Check(SwsConvert(src.get(), sws_i420.get(), SWS_BILINEAR | SWS_ACCURATE_RND), "sws_scale",
+              name, 0.0);
+        CheckPlanes(libyuv_i420.get(), sws_i420.get(), "libyuv vs sws_scale", name, kMaxMeanDiff);
+        if (format_case.is_rgb) {
+            CheckPlanes(libyuv_i420.get(), reference, "libyuv vs BT.601 reference", name,
+                        kMaxMeanDiff);
+        }
+
+        // the texture is smaller than the frame, the converter scales while converting
+        UniqueAVFramePtr libyuv_half = AllocFrame(AV_PIX_FMT_YUV420P, kWidth / 2, kHeight / 2);
+        Check(converter.Convert(src.get(), libyuv_half.get()) == 0,
+              "LibyuvI420Converter::Convert half size", name, 0.0);
+        UniqueAVFramePtr sws_half = AllocFrame(i420_format, kWidth / 2, kHeight / 2);
+        Check(SwsConvert(src.get(), sws_half.get(), SWS_BILINEAR | SWS_ACCURATE_RND),
+              "sws_scale half size", name, 0.0);
+        CheckPlanes(libyuv_half.get(), sws_half.get(), "libyuv vs sws_scale half size", name,
+                    kMaxScaledMeanDiff);
+
+        // the old fallback: a cached SWS_FAST_BILINEAR context, only sws_scale is timed
+        SwsContext *sws_context = sws_getContext(kWidth, kHeight, format_case.format, kWidth,
+                                                 kHeight, AV_PIX_FMT_YUV420P, SWS_FAST_BILINEAR,
+                                                 NULL, NULL, NULL);
+        double sws_ms = BenchmarkMsPerFrame([&]() {
+            sws_scale(sws_context, src->data, src->linesize, 0, kHeight, sws_i420->data,
+                      sws_i420->linesize);
+        });
+        sws_freeContext(sws_context);
+        double libyuv_ms = BenchmarkMsPerFrame([&]() {
+            converter.Convert(src.get(), libyuv_i420.get());
+        });
+        double libyuv_half_ms = BenchmarkMsPerFrame([&]() {
+            converter.Convert(src.get(), libyuv_half.get());
+        });
+        printf("%-9s sws:%7.3f ms  libyuv:%7.3f ms (%.1fx)  libyuv half size:%7.3f ms\n", name,
+               sws_ms, libyuv_ms, sws_ms / libyuv_ms, libyuv_half_ms);
+    }
+}
+
+int main() {
+    UniqueAVFramePtr rgba = CreateRgbaImage();
+    UniqueAVFramePtr reference = CreateReferenceI420(rgba.get());
+    printf("%dx%d to yuv420p, ms per frame\n", kWidth, kHeight);
+    for (const FormatCase &format_case : kFormats) {
+        RunFormat(format_case, rgba.get(), reference.get());
+    }
+    if (failures > 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("all formats match sws_scale and the BT.601 reference\n");
+    return 0;
+}
@@ -0,0 +1,190 @@
+// Builds a 10k-asset EditorProject, checks PreviewTimeline's lookups and tick conversions against a
+// linear scan over the same assets and reports the cost of both lookups.
+#include "preview_timeline.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace whensunset::wsvideoeditor;
+using whensunset::base::MediaTicks;
+
+namespace {
+    const int kAssetCount = 10000;
+    const int kRandomQueries = 200000;
+    const double kBenchmarkSec = 0.2;
+
+    int failures = 0;
+
+    void Check(bool ok, const char *what, MediaTicks ticks, int64_t expected, int64_t actual) {
+        if (!ok) {
+            // the first few are enough to see what is wrong
+            if (++failures <= 10) {
+                printf("FAIL %s ticks:%lld expected:%lld actual:%lld\n", what,
+                       static_cast<long long>(ticks), static_cast<long long>(expected),
+                       static_cast<long long>(actual));
+            }
+        }
+    }
+
+    // covers the clipped range cases MediaAssetClippedRange clamps: no clip, clip past the file
+    // end, negative start, zero duration (rest of the file) and empty files
+    model::EditorProject BuildProject(std::mt19937 *random) {
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        model::EditorProject project;
+        for (int i = 0; i < kAssetCount; ++i) {
+            model::MediaAsset *asset = project.add_media_asset();
+            asset->set_asset_id(1000 + i);
+            double file_duration = 0.5 + 29.5 * unit(*random);
+            double kind = unit(*random);
+            if (kind < 0.02) {
+                file_duration = 0.0;
+            }
+            asset->mutable_media_asset_file_holder()->set_duration(file_duration);
+            if (kind < 0.1) {
+                continue;
+            }
+            model::TimeRange *range = asset->add_clipped_time_range();
+            range->set_id(i);
+            if (kind < 0.15) {
+                range->set_start(file_duration + 1.0);
+                range->set_duration(2.0);
+            } else if (kind < 0.2) {
+                range->set_start(-1.0);
+                range->set_duration(file_duration / 3.0);
+            } else if (kind < 0.3) {
+                range->set_start(file_duration * unit(*random));
+                range->set_duration(0.0);
+            } else {
+                double start = file_duration * 0.5 * unit(*random);
+                range->set_start(start);
+                range->set_duration((file_duration - start) * unit(*random) + 1.0 / 3.0);
+            }
+        }
+        return project;
+    }
+
+    // the timeline every lookup is checked against, one segment per asset without any index
+    struct LinearTimeline {
+        std::vector<MediaTicks> start;
+        std::vector<MediaTicks> end;
+        std::vector<MediaTicks> clipped_start;
+
+        explicit LinearTimeline(const model::EditorProject &project) {
+            MediaTicks ticks = 0;
+            for (int i = 0; i < project.media_asset_size(); ++i) {
+                model::TimeRange range = MediaAssetClippedRange(project.media_asset(i));
+                start.push_back(ticks);
+                ticks += whensunset::base::SecToTicks(range.duration());
+                end.push_back(ticks);
+                clipped_start.push_back(whensunset::base::SecToTicks(range.start()));
+            }
+        }
+
+        int SegmentIndex(MediaTicks ticks) const {
+            for (int i = 0; i < start.size(); ++i) {
+                if (ticks < end[i] && ticks + whensunset::base::kTimeEpsTicks > start[i]) {
+                    return i;
+                }
+            }
+            return static_cast<int>(start.size()) - 1;
+        }
+    };
+
+    void CheckQuery(const PreviewTimeline &timeline, const LinearTimeline &linear,
+                    MediaTicks ticks) {
+        int expected = linear.SegmentIndex(ticks);
+        int actual = timeline.GetSegmentIndexFromRenderTicks(ticks);
+        Check(expected == actual, "GetSegmentIndexFromRenderTicks", ticks, expected, actual);
+        MediaTicks asset_ticks = timeline.ProjectTicksToAssetTicks(ticks, expected);
+        Check(asset_ticks == ticks - linear.start[expected] + linear.clipped_start[expected],
+              "ProjectTicksToAssetTicks", ticks,
+              ticks - linear.start[expected] + linear.clipped_start[expected], asset_ticks);
+        MediaTicks project_ticks = timeline.AssetTicksToProjectTicks(asset_ticks, expected);
+        Check(project_ticks == ticks, "AssetTicksToProjectTicks round trip", ticks, ticks,
+              project_ticks);
+    }
+
+    template<typename Lookup>
+    double BenchmarkNsPerLookup(const std::vector<MediaTicks> &queries, Lookup lookup) {
+        int64_t lookups = 0;
+        int64_t sum = 0;
+        auto begin = std::chrono::steady_clock::now();
+        double elapsed = 0.0;
+        do {
+            for (MediaTicks ticks : queries) {
+                sum += lookup(ticks);
+            }
+            lookups += queries.size();
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        } while (elapsed < kBenchmarkSec);
+        // keeps the lookups from being optimized away
+        volatile int64_t sink = sum;
+        (void) sink;
+        return elapsed * 1e9 / lookups;
+    }
+}
+
+int main() {
+    std::mt19937 random(42);
+    model::EditorProject project = BuildProject(&random);
+
+    auto build_begin = std::chrono::steady_clock::now();
+    PreviewTimeline timeline(project);
+    double build_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - build_begin).count();
+    LinearTimeline linear(project);
+
+    Check(timeline.segment_count() == kAssetCount, "segment_count", 0, kAssetCount,
+          timeline.segment_count());
+    Check(timeline.duration_ticks() == linear.end.back(), "duration_ticks", 0, linear.end.back(),
+          timeline.duration_ticks());
+    for (int i = 0; i < kAssetCount; ++i) {
+        Check(timeline.MediaAssetStartPos(i) == whensunset::base::TicksToSec(linear.start[i]),
+              "MediaAssetStartPos", linear.start[i], linear.start[i],
+              whensunset::base::SecToTicks(timeline.MediaAssetStartPos(i)));
+    }
+
+    // every boundary and the ticks around it, where the eps tolerance decides the segment
+    std::vector<MediaTicks> boundary_offsets = {-whensunset::base::kTimeEpsTicks - 1,
+                                                -whensunset::base::kTimeEpsTicks,
+                                                -whensunset::base::kTimeEpsTicks + 1, -1, 0, 1,
+                                                whensunset::base::kTimeEpsTicks};
+    int boundary_queries = 0;
+    for (int i = 0; i < kAssetCount; ++i) {
+        for (MediaTicks offset : boundary_offsets) {
+            CheckQuery(timeline, linear, linear.start[i] + offset);
+            ++boundary_queries;
+        }
+    }
+    CheckQuery(timeline, linear, linear.end.back());
+    CheckQuery(timeline, linear, linear.end.back() + 1000000);
+
+    std::uniform_int_distribution<MediaTicks> any_ticks(0, linear.end.back() - 1);
+    std::vector<MediaTicks> queries(kRandomQueries);
+    for (MediaTicks &ticks : queries) {
+        ticks = any_ticks(random);
+    }
+    for (MediaTicks ticks : queries) {
+        CheckQuery(timeline, linear, ticks);
+    }
+
+    // the linear scan is too slow for the full query set, time it on a slice
+    std::vector<MediaTicks> linear_queries(queries.begin(), queries.begin() + 2000);
+    double binary_ns = BenchmarkNsPerLookup(queries, [&timeline](MediaTicks ticks) {
+        return timeline.GetSegmentIndexFromRenderTicks(ticks);
+    });
+    double linear_ns = BenchmarkNsPerLookup(linear_queries, [&linear](MediaTicks ticks) {
+        return linear.SegmentIndex(ticks);
+    });
+
+    printf("assets:%d duration:%.1f s build:%.3f ms\n", kAssetCount, timeline.duration(), build_ms);
+    printf("checked %d boundary and %d random queries\n", boundary_queries, kRandomQueries);
+    printf("segment lookup  binary:%.1f ns  linear:%.1f ns\n", binary_ns, linear_ns);
+    if (failures > 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("all lookups and conversions match the linear reference\n");
+    return 0;
+}
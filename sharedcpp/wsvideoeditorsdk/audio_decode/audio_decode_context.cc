@@ -2,8 +2,12 @@
 #include "av_utils.h"
 #include "constants.h"
 #include "platform_logger.h"
+#include <assert.h>
 #include <stdio.h>
 #include <cmath>
+#include <algorithm>
+#include <limits>
+#include <vector>
 
 #pragma clang diagnostic push
 // Deprecated FFmpeg APIs must be used for maintaining backwards compatibility with FFmpeg 3.0
@@ -18,6 +22,8 @@ namespace whensunset {
         const int kMinProbeSize = 1024;
         const int kMaxProbeSize = 1024 * 1024;
         const double kCorrectionDuration = 0.05;
+        // decoded before the seek target and thrown away, covers AAC priming and MDCT overlap
+        const double kSeekPreRollSec = 0.1;
         const char kMP4Demuxer[] = "mov,mp4,m4a,3gp,3g2,mj2";
 
         AudioDecodeContext::AudioDecodeContext(std::string tag) : format_ctx_(nullptr,
@@ -26,6 +32,7 @@ namespace whensunset {
                                                                              ReleaseAVCodecContext),
                                                                   swr_ctx_(nullptr,
                                                                            ReleaseSwrContext),
+                                                                  audio_frame_(nullptr, FreeAVFrame),
                                                                   tag_(tag) {
             audio_stream_index_ = -1;
             audio_stream_ = nullptr;
@@ -40,6 +47,7 @@ namespace whensunset {
             current_buffer_sec_ = 0.0;
             last_decode_ret_ = false;
             clipped_range_start_ = 0.0;
+            seek_target_sample_ = -1;
         }
 
         AudioDecodeContext::~AudioDecodeContext() {
@@ -183,21 +191,74 @@ namespace whensunset {
             return 0;
         }
 
+        // Stereo gains of every channel of src_layout, row major in the swr_set_matrix() layout.
+        // Unlike the swresample default there is no normalization: mono goes to both sides at
+        // full level instead of -3dB, see
+        // https://sound.stackexchange.com/questions/42709/why-does-ffmpegs-conversion-from-mono-to-stereo-lower-the-volume
+        // and https://trac.ffmpeg.org/wiki/AudioChannelManipulation
+        // The mix bus is float and ends in a limiter, so a loud downmix does not clip.
+        static void BuildStereoMixMatrix(uint64_t src_layout, std::vector<double> *matrix) {
+            int src_channels = av_get_channel_layout_nb_channels(src_layout);
+            matrix->assign(2 * src_channels, 0.0);
+            for (int i = 0; i < src_channels; ++i) {
+                uint64_t channel = av_channel_layout_extract_channel(src_layout, i);
+                double left = 0.0, right = 0.0;
+                if (src_channels == 1) {
+                    left = right = 1.0;
+                } else if (channel == AV_CH_FRONT_LEFT) {
+                    left = 1.0;
+                } else if (channel == AV_CH_FRONT_RIGHT) {
+                    right = 1.0;
+                } else if (channel == AV_CH_FRONT_CENTER) {
+                    left = right = M_SQRT1_2;
+                } else if (channel & (AV_CH_BACK_LEFT | AV_CH_SIDE_LEFT |
+                                      AV_CH_FRONT_LEFT_OF_CENTER | AV_CH_TOP_FRONT_LEFT |
+                                      AV_CH_TOP_BACK_LEFT | AV_CH_WIDE_LEFT |
+                                      AV_CH_SURROUND_DIRECT_LEFT | AV_CH_STEREO_LEFT)) {
+                    left = M_SQRT1_2;
+                } else if (channel & (AV_CH_BACK_RIGHT | AV_CH_SIDE_RIGHT |
+                                      AV_CH_FRONT_RIGHT_OF_CENTER | AV_CH_TOP_FRONT_RIGHT |
+                                      AV_CH_TOP_BACK_RIGHT | AV_CH_WIDE_RIGHT |
+                                      AV_CH_SURROUND_DIRECT_RIGHT | AV_CH_STEREO_RIGHT)) {
+                    right = M_SQRT1_2;
+                } else if (channel & (AV_CH_BACK_CENTER | AV_CH_TOP_CENTER |
+                                      AV_CH_TOP_FRONT_CENTER | AV_CH_TOP_BACK_CENTER)) {
+                    left = right = 0.5;
+                }
+                // LFE and unknown channels are dropped
+                (*matrix)[i] = left;
+                (*matrix)[src_channels + i] = right;
+            }
+        }
+
         int AudioDecodeContext::InitSwrContext() {
+            uint64_t src_layout = codec_ctx_->channel_layout;
+            if (!src_layout || av_get_channel_layout_nb_channels(src_layout) != src_channels_) {
+                src_layout = static_cast<uint64_t>(av_get_default_channel_layout(src_channels_));
+            }
             SwrContext *swr_ctx = swr_alloc_set_opts(nullptr,
                                                      av_get_default_channel_layout(dst_channels_),
                                                      dst_sample_fmt_, dst_sample_rate_,
-                                                     av_get_default_channel_layout(
-                                                             convert_src_channels_),
-                                                     src_sample_fmt_, src_sample_rate_, 0, nullptr);
+                                                     src_layout, src_sample_fmt_,
+                                                     src_sample_rate_, 0, nullptr);
             int ret = AVERROR(ENOMEM);
             if (swr_ctx) {
-                ret = swr_init(swr_ctx);
+                ret = 0;
+                if (dst_channels_ == 2 && src_channels_ != 2) {
+                    // channel mapping is folded into the resampler's own (SIMD) rematrix pass
+                    std::vector<double> matrix;
+                    BuildStereoMixMatrix(src_layout, &matrix);
+                    ret = swr_set_matrix(swr_ctx, matrix.data(), src_channels_);
+                }
+                if (ret >= 0) {
+                    ret = swr_init(swr_ctx);
+                }
             }
             if (ret < 0) {
                 LOGE("AudioDecodeContext swr_context init failed! dst ac: %d, af: %d, ar: %d, src ac: %d, af: %d, ar: %d",
-                     dst_channels_, dst_sample_fmt_, dst_sample_rate_, convert_src_channels_,
+                     dst_channels_, dst_sample_fmt_, dst_sample_rate_, src_channels_,
                      src_sample_fmt_, src_sample_rate_);
+                swr_free(&swr_ctx);
                 return ret;
             }
             swr_ctx_.reset(swr_ctx);
@@ -246,9 +307,17 @@ namespace whensunset {
                     continue;
                 }
 
-                UniqueAVFramePtr audio_frame = UniqueAVFramePtr(av_frame_alloc(), FreeAVFrame);
+                if (!audio_frame_) {
+                    audio_frame_.reset(av_frame_alloc());
+                    if (!audio_frame_) {
+                        av_packet_unref(&packet);
+                        return AVERROR(ENOMEM);
+                    }
+                }
+                AVFrame *audio_frame = audio_frame_.get();
+                av_frame_unref(audio_frame);
                 int got_frame;
-                ret = avcodec_decode_audio4(codec_ctx_.get(), audio_frame.get(), &got_frame,
+                ret = avcodec_decode_audio4(codec_ctx_.get(), audio_frame, &got_frame,
                                             &packet);
                 if (ret < 0) {
                     LOGE("AudioDecodeContext avcodec_decode_audio4 failed, ret: %d %s, path: %s",
@@ -278,61 +347,28 @@ namespace whensunset {
                     }
                 } else {
                     current_pkt_sec_ =
-                            av_frame_get_best_effort_timestamp(audio_frame.get()) * sec_per_sample;
+                            av_frame_get_best_effort_timestamp(audio_frame) * sec_per_sample;
                 }
 
                 // The packet is lost when got_frame is 0, should use its duration in order to avoid pts goes wrong
                 int nb_samples = got_frame ? audio_frame->nb_samples
                                            : static_cast<int>(packet.duration);
                 int dst_sample_count = nb_samples;
-                bool frame_valid = got_frame && (FrameDataValidation(audio_frame.get()) == 0);
-                convert_src_channels_ = src_channels_;
-
-                // mono to stereo should not use ffmpeg due to that ffmpeg will lower the volume in this case
-                // see: https://sound.stackexchange.com/questions/42709/why-does-ffmpegs-conversion-from-mono-to-stereo-lower-the-volume
-                // and https://trac.ffmpeg.org/wiki/AudioChannelManipulation
-                uint8_t *frame_data_stereo[2];
-                std::unique_ptr<uint8_t[]> frame_data_stereo_ptr(nullptr);
-                if (dst_channels_ == 2 && src_channels_ == 1) {
-                    convert_src_channels_ = dst_channels_;
-                    if (frame_valid) {
-                        int src_bytes_per_sample = av_get_bytes_per_sample(src_sample_fmt_);
-                        frame_data_stereo_ptr.reset(
-                                new(std::nothrow) uint8_t[src_bytes_per_sample * nb_samples * 2]);
-                        if (!frame_data_stereo_ptr) {
-                            LOGE("Out of native memory when trying to alloc planar frame_data_stereo %d bytes!",
-                                 src_bytes_per_sample * nb_samples * 2);
-                            av_packet_unref(&packet);
-                            return AVERROR(ENOMEM);
-                        }
-                        if (av_sample_fmt_is_planar(src_sample_fmt_)) {
-                            // planar
-                            frame_data_stereo[0] = frame_data_stereo_ptr.get();
-                            frame_data_stereo[1] =
-                                    frame_data_stereo_ptr.get() + src_bytes_per_sample * nb_samples;
-                            memcpy(frame_data_stereo[0], audio_frame->extended_data[0],
-                                   src_bytes_per_sample * nb_samples);
-                            memcpy(frame_data_stereo[1], audio_frame->extended_data[0],
-                                   src_bytes_per_sample * nb_samples);
-                        } else {
-                            // packed
-                            frame_data_stereo[0] = frame_data_stereo_ptr.get();
-                            frame_data_stereo[1] = nullptr;
-                            for (int i = 0; i < nb_samples; i++) {
-                                memcpy(frame_data_stereo[0] + 2 * i * src_bytes_per_sample,
-                                       audio_frame->extended_data[0] + i * src_bytes_per_sample,
-                                       src_bytes_per_sample);
-                                memcpy(frame_data_stereo[0] + (2 * i + 1) * src_bytes_per_sample,
-                                       audio_frame->extended_data[0] + i * src_bytes_per_sample,
-                                       src_bytes_per_sample);
-                            }
-                        }
-                    }
-                }
-
-                bool need_resample = src_sample_fmt_ != dst_sample_fmt_ ||
-                                     src_sample_rate_ != dst_sample_rate_ ||
-                                     convert_src_channels_ != dst_channels_;
+                bool frame_valid = got_frame && (FrameDataValidation(audio_frame) == 0);
+                // packed formats are one interleaved array, planar formats keep the planes back to
+                // back in decode_buff_, each buff_size_ / dst_channels_ bytes long
+                bool dst_planar = av_sample_fmt_is_planar(dst_sample_fmt_) != 0;
+
+                // mono in the planar dst format just needs its only plane copied to every
+                // channel, mono and packed mono have the same layout
+                bool copy_mono_plane = src_channels_ == 1 && dst_planar &&
+                                       src_sample_rate_ == dst_sample_rate_ &&
+                                       av_get_packed_sample_fmt(src_sample_fmt_) ==
+                                       av_get_packed_sample_fmt(dst_sample_fmt_);
+                bool need_resample = !copy_mono_plane &&
+                                     (src_sample_fmt_ != dst_sample_fmt_ ||
+                                      src_sample_rate_ != dst_sample_rate_ ||
+                                      src_channels_ != dst_channels_);
                 if (need_resample) {
                     if (!swr_ctx_) {
                         if (InitSwrContext() < 0) {
@@ -348,19 +384,15 @@ namespace whensunset {
 
                 int decoded_nb_bytes =
                         dst_sample_count * dst_channels_ * av_get_bytes_per_sample(dst_sample_fmt_);
-                decode_buff_.reset(new(std::nothrow) uint8_t[decoded_nb_bytes]);
-                if (!decode_buff_) {
+                uint8_t *sws_buff = decode_buff_.Reserve(decoded_nb_bytes);
+                if (!sws_buff) {
                     LOGE("Out of native memory when trying to alloc %d bytes!", decoded_nb_bytes);
                     av_packet_unref(&packet);
                     return AVERROR(ENOMEM);
                 }
-                // Because AV_SAMPLE_FMT_S16 is planar, so we just use 1D array
-                // we could use av_sample_fmt_is_planar() to check whether a sample format is planar or packed
-                assert(dst_sample_fmt_ == AV_SAMPLE_FMT_S16);
-                uint8_t *sws_buff = decode_buff_.get();
+                int dst_plane_size = decoded_nb_bytes / dst_channels_;
                 memset(sws_buff, 0, static_cast<size_t>(decoded_nb_bytes));
-                uint8_t **frame_data = frame_data_stereo_ptr ? frame_data_stereo
-                                                             : audio_frame->extended_data;
+                uint8_t **frame_data = audio_frame->extended_data;
                 if (!got_frame) {
                     LOGD("AudioDecodeContext avcodec_decode_audio4 got_frame is 0, return a zero-frame with %d bytes",
                          decoded_nb_bytes);
@@ -371,13 +403,32 @@ namespace whensunset {
                         return AVERROR_INVALIDDATA;
                     }
 
-                    int out_samples = swr_convert(swr_ctx_.get(), &sws_buff, decoded_nb_bytes,
+                    uint8_t *out_planes[AV_NUM_DATA_POINTERS] = {sws_buff};
+                    if (dst_planar) {
+                        for (int i = 1; i < dst_channels_ && i < AV_NUM_DATA_POINTERS; ++i) {
+                            out_planes[i] = sws_buff + i * dst_plane_size;
+                        }
+                    }
+                    int out_samples = swr_convert(swr_ctx_.get(), out_planes, dst_sample_count,
                                                   (const uint8_t **) frame_data, nb_samples);
                     if (out_samples <= 0) {
                         LOGW("swr_convert has no samples, count: %d", out_samples);
+                        out_samples = 0;
                     }
                     decoded_nb_bytes =
                             out_samples * dst_channels_ * av_get_bytes_per_sample(dst_sample_fmt_);
+                    if (dst_planar && out_samples < dst_sample_count) {
+                        // close the gaps so the planes stay back to back
+                        int out_plane_size = decoded_nb_bytes / dst_channels_;
+                        for (int i = 1; i < dst_channels_; ++i) {
+                            memmove(sws_buff + i * out_plane_size, out_planes[i], out_plane_size);
+                        }
+                    }
+                } else if (dst_planar) {
+                    for (int i = 0; i < dst_channels_; ++i) {
+                        memcpy(sws_buff + i * dst_plane_size,
+                               frame_data[copy_mono_plane ? 0 : i], dst_plane_size);
+                    }
                 } else {
                     memcpy(sws_buff, frame_data[0], decoded_nb_bytes);
                 }
@@ -394,8 +445,19 @@ namespace whensunset {
                 pos = duration_sec_ - TIME_EPS;
             }
 
+            if (pcm_cache_entry_) {
+                // cached samples are addressed directly, nothing to seek
+                current_pkt_sec_ = pos;
+                current_buffer_sec_ = pos;
+                return true;
+            }
+
+            // land on a packet before pos, GetAudio() decodes the pre-roll to prime the decoder
+            // and trims it away up to the exact target sample
+            double pre_roll_pos = fmax(0.0, pos - kSeekPreRollSec);
             // Do not need add audio_stream_->start_time!
-            int64_t timestamp = static_cast<int64_t >(pos / av_q2d(audio_stream_->time_base) + 0.5);
+            int64_t timestamp = static_cast<int64_t >(
+                    pre_roll_pos / av_q2d(audio_stream_->time_base) + 0.5);
 
             LOGI("AudioDecode::GetAudio Seek to timestamp: %lld, sec: %f, current: %f\n", timestamp,
                  pos, current_pkt_sec_);
@@ -406,9 +468,13 @@ namespace whensunset {
                 return false;
             }
             avcodec_flush_buffers(codec_ctx_.get());
+            // samples still buffered in the resampler belong to the old position
+            swr_ctx_.reset();
             buff_index_ = buff_size_;
-            current_pkt_sec_ = pos;
+            // accept every packet from the pre-roll on
+            current_pkt_sec_ = std::numeric_limits<double>::lowest();
             current_buffer_sec_ = pos;
+            seek_target_sample_ = static_cast<int64_t>(pos * dst_sample_rate_ + 0.5);
             last_decode_ret_ = false;
             return true;
         }
@@ -430,20 +496,28 @@ namespace whensunset {
                 return false;
             }
 
+            if (pcm_cache_entry_) {
+                return GetAudioFromPcmCache(pts_dst_stream_tb, dst_buff, len);
+            }
+
             int audio_size = 0;
+            bool dst_planar = av_sample_fmt_is_planar(dst_sample_fmt_) != 0;
+            // planar dst_buff holds dst_channels_ planes of len / dst_channels_ bytes
+            int dst_plane_size = len / dst_channels_;
+            int dst_written = 0;
             while (len > 0) {
                 if (buff_index_ >= buff_size_) {
                     // decode one frame
                     audio_size = DecodeOneAudioFrame();
                     if (audio_size <= 0) {
                         // if error occurred, just output silence
-                        decode_buff_.reset(new(std::nothrow) uint8_t[kMinAudioBufferSize]);
-                        if (!decode_buff_) {
+                        uint8_t *silence_buff = decode_buff_.Reserve(kMinAudioBufferSize);
+                        if (!silence_buff) {
                             LOGE("Out of native memory when try to alloc %d bytes!",
                                  kMinAudioBufferSize);
                             return false;
                         }
-                        memset(decode_buff_.get(), 0, kMinAudioBufferSize);
+                        memset(silence_buff, 0, kMinAudioBufferSize);
                         buff_size_ = kMinAudioBufferSize;
                         last_decode_ret_ = false;
                     } else {
@@ -455,6 +529,23 @@ namespace whensunset {
                 // buffer_size_ means the buffer size, buffer_index_ means buffer read position
                 // current_buffer_sec_ is the reading buffer position int the file
                 int bytes_per_sample = dst_channels_ * av_get_bytes_per_sample(dst_sample_fmt_);
+                if (seek_target_sample_ >= 0 && last_decode_ret_ && buff_index_ == 0) {
+                    // first frames after Seek(): drop the pre-roll, trim to the target sample
+                    int64_t frame_start_sample = static_cast<int64_t>(
+                            current_pkt_sec_ * dst_sample_rate_ + 0.5);
+                    int64_t frame_nb_samples = buff_size_ / bytes_per_sample;
+                    if (frame_start_sample + frame_nb_samples <= seek_target_sample_) {
+                        buff_index_ = buff_size_;
+                        continue; // DecodeOneAudioFrame()
+                    }
+                    if (seek_target_sample_ > frame_start_sample) {
+                        buff_index_ = static_cast<int>(seek_target_sample_ - frame_start_sample) *
+                                      bytes_per_sample;
+                    }
+                    seek_target_sample_ = -1;
+                    current_buffer_sec_ = current_pkt_sec_ +
+                                          (buff_index_ * 1.0 / bytes_per_sample) / dst_sample_rate_;
+                }
                 if (last_decode_ret_ &&
                     current_pkt_sec_ < clipped_range_start_ + kCorrectionDuration
                     && pts_dst_stream_tb / (double) dst_sample_rate_ - current_buffer_sec_ >
@@ -476,10 +567,19 @@ namespace whensunset {
                 }
 
                 int bytes_available = std::min(len, buff_size_ - buff_index_);
-                memcpy(dst_buff, decode_buff_.get() + buff_index_,
-                       static_cast<size_t>(bytes_available));
+                if (dst_planar) {
+                    int src_plane_size = buff_size_ / dst_channels_;
+                    for (int i = 0; i < dst_channels_; ++i) {
+                        memcpy(dst_buff + i * dst_plane_size + dst_written / dst_channels_,
+                               decode_buff_.data() + i * src_plane_size + buff_index_ / dst_channels_,
+                               static_cast<size_t>(bytes_available / dst_channels_));
+                    }
+                } else {
+                    memcpy(dst_buff + dst_written, decode_buff_.data() + buff_index_,
+                           static_cast<size_t>(bytes_available));
+                }
                 len -= bytes_available;
-                dst_buff += bytes_available;
+                dst_written += bytes_available;
                 buff_index_ += bytes_available;
                 if (last_decode_ret_) {
                     current_buffer_sec_ = current_pkt_sec_ +
@@ -488,6 +588,37 @@ namespace whensunset {
             }
             return last_decode_ret_;
         }
+
+        bool AudioDecodeContext::GetAudioFromPcmCache(int64_t pts_dst_stream_tb, uint8_t *dst_buff,
+                                                      int len) {
+            const AudioPcmCacheEntry *entry = pcm_cache_entry_.get();
+            int bytes_per_sample = av_get_bytes_per_sample(dst_sample_fmt_);
+            int64_t nb_samples = len / (bytes_per_sample * dst_channels_);
+            current_pkt_sec_ = pts_dst_stream_tb / (double) dst_sample_rate_;
+            current_buffer_sec_ = (pts_dst_stream_tb + nb_samples) / (double) dst_sample_rate_;
+            // past the cached audio, do not even form the source pointer
+            if (pts_dst_stream_tb < 0 || pts_dst_stream_tb >= entry->nb_samples) {
+                memset(dst_buff, 0, static_cast<size_t>(len));
+                return false;
+            }
+            int64_t nb_copy = std::min(nb_samples, entry->nb_samples - pts_dst_stream_tb);
+            if (entry->is_planar) {
+                int dst_plane_size = len / dst_channels_;
+                for (int i = 0; i < dst_channels_; ++i) {
+                    uint8_t *dst_plane = dst_buff + i * dst_plane_size;
+                    size_t copy_size = static_cast<size_t>(nb_copy * bytes_per_sample);
+                    memcpy(dst_plane, entry->plane(i) + pts_dst_stream_tb * bytes_per_sample,
+                           copy_size);
+                    memset(dst_plane + copy_size, 0, dst_plane_size - copy_size);
+                }
+            } else {
+                int sample_bytes_size = bytes_per_sample * dst_channels_;
+                size_t copy_size = static_cast<size_t>(nb_copy * sample_bytes_size);
+                memcpy(dst_buff, entry->data + pts_dst_stream_tb * sample_bytes_size, copy_size);
+                memset(dst_buff + copy_size, 0, len - copy_size);
+            }
+            return nb_copy > 0;
+        }
     }
 }
 
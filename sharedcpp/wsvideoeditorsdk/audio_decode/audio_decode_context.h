@@ -3,6 +3,8 @@
 
 #include <string>
 #include "av_utils.h"
+#include "scratch_buffer.h"
+#include "audio_pcm_cache.h"
 
 extern "C" {
 #include <libavformat/avformat.h>
@@ -74,6 +76,16 @@ namespace whensunset {
                 clipped_range_start_ = clipped_range_start;
             }
 
+            // Serves GetAudio() and Seek() from fully decoded PCM instead of the demuxer once
+            // set, entry must have the dst format of this context.
+            void set_pcm_cache_entry(std::shared_ptr<const AudioPcmCacheEntry> entry) {
+                pcm_cache_entry_ = std::move(entry);
+            }
+
+            bool has_pcm_cache_entry() {
+                return pcm_cache_entry_ != nullptr;
+            }
+
         private:
             bool FileHasAudio();
 
@@ -85,6 +97,8 @@ namespace whensunset {
 
             int FrameDataValidation(AVFrame *audio_frame);
 
+            bool GetAudioFromPcmCache(int64_t pts_dst_stream_tb, uint8_t *dst_buff, int len);
+
             std::string path_;
             double duration_sec_;
             std::unique_ptr<AVFormatContext, decltype(&ReleaseAVFormatContext)> format_ctx_;
@@ -100,18 +114,23 @@ namespace whensunset {
             AVSampleFormat dst_sample_fmt_;
 
             int src_channels_;
-            int convert_src_channels_;
             int src_sample_rate_;
             AVSampleFormat src_sample_fmt_;
 
             double current_pkt_sec_;
             double current_buffer_sec_;
 
-            std::unique_ptr<uint8_t[]> decode_buff_;
+            // scratch buffers reused across packets, see ScratchBuffer
+            base::ScratchBuffer decode_buff_;
+            UniqueAVFramePtr audio_frame_;
             int buff_size_;
             int buff_index_;
             double clipped_range_start_;
             bool last_decode_ret_;
+            // exact sample (dst sample rate, file time) the next output must start at after a
+            // Seek(), -1 once reached
+            int64_t seek_target_sample_;
+            std::shared_ptr<const AudioPcmCacheEntry> pcm_cache_entry_;
 
             std::string tag_;
         };
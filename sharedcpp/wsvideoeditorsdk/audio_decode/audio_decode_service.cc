@@ -2,28 +2,32 @@
 #include "platform_logger.h"
 #include "av_utils.h"
 #include "preview_timeline.h"
+#include "audio_mixer.h"
+#include "audio_wav_writer.h"
 #include <string>
 #include <algorithm>
+#include <chrono>
+#include <climits>
 
 namespace whensunset {
     namespace wsvideoeditor {
-
-        int
-        AudioMixerSimpleProcess(uint8_t *data_out, uint8_t *data1, uint8_t *data2, int sample_count,
-                                int dst_channels) {
-            int sample_bytes_size = av_get_bytes_per_sample(AV_SAMPLE_FMT_S16) * dst_channels;
-            short *dst = (short *) data_out;
-            short *src1 = (short *) data1;
-            short *src2 = (short *) data2;
-            for (int i = 0; i < sample_count * sample_bytes_size / 2; i++) {
-                dst[i] = std::max(SHRT_MIN,
-                                  std::min(SHRT_MAX, static_cast<int>(src1[i] * 1 + src2[i] * 1)));
-            }
-            return sample_count;
-        }
+        // decode quantum while the buffer is at least half full
+        const int kMinDecodeQuantumMs = 10;
+        // upper bound of one batch when refilling, keeps seek/volume changes responsive
+        const int kMaxDecodeQuantumMs = 80;
+        // assets up to this duration are always PCM cached when the cache is enabled
+        const double kPcmCacheMaxAssetDurationSec = 30.0;
+        // longer assets are PCM cached once seeked this many times
+        const int kPcmCacheSeekCountThreshold = 3;
+        // chunk size of an offline mix-down, big enough to amortize the per chunk overhead
+        const int kMixDownChunkMs = 100;
 
         AudioDecodeService::AudioDecodeService(int buffer_size) :
-                decoded_audio_buffer_(AUDIO_BUFFER_SIZE * buffer_size) {
+                decoded_audio_buffer_(AUDIO_BUFFER_SIZE * buffer_size,
+                                      av_get_bytes_per_sample(dst_sample_fmt_) * dst_channels_,
+                                      dst_sample_rate_),
+                mix_limiter_(dst_channels_, dst_sample_rate_),
+                time_stretcher_(dst_channels_, dst_sample_rate_) {
             internal_clock_.reset(new(std::nothrow) RefClock);
             if (!internal_clock_) {
                 abort();
@@ -39,15 +43,34 @@ namespace whensunset {
         }
 
         void
-        AudioDecodeService::SetProject(model::EditorProject project, double pos_sec) {
+        AudioDecodeService::SetProject(ProjectSnapshot project, double pos_sec) {
+            if (!project) {
+                return;
+            }
             {
                 std::lock_guard<std::mutex> lock(mutex_);
-                if (is_stopped_ || IsAudioAssetsChanged(project_, project)) {
+                ProjectDiff diff;
+                if (project_ != project) {
+                    ProjectFingerprint project_fingerprint = FingerprintProject(*project);
+                    diff = DiffProjects(project_fingerprint_, project_fingerprint);
+                    project_fingerprint_ = std::move(project_fingerprint);
+                }
+                if (is_stopped_ || !project_) {
                     asset_audio_updated_ = true;
+                    asset_audio_unchanged_before_ = 0.0;
+                    decoded_audio_buffer_.Clear();
+                } else if (diff.timeline_changed()) {
+                    // the decode thread decides whether the buffered audio is still valid
+                    if (!asset_audio_updated_) {
+                        asset_audio_unchanged_before_ = DBL_MAX;
+                    }
+                    asset_audio_updated_ = true;
+                    asset_audio_unchanged_before_ = std::min(asset_audio_unchanged_before_,
+                                                             diff.first_timeline_change_pos);
                 }
-                if (asset_audio_updated_ || pos_sec > -PTS_EPS) {
+                if (pos_sec > -PTS_EPS) {
                     decoded_audio_buffer_.Clear();
-                } else if (IsAudioVolumeChanged(project_, project)) {
+                } else if (!asset_audio_updated_ && !diff.volume_changed.empty()) {
                     asset_volume_updated_ = true;
                 }
                 project_ = project;
@@ -65,6 +88,39 @@ namespace whensunset {
             cv_.notify_all();
         }
 
+        void AudioDecodeService::EnablePcmCache(const std::string &temp_dir,
+                                                int64_t ram_budget_bytes) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (pcm_cache_) {
+                return;
+            }
+            pcm_cache_.reset(new(std::nothrow) AudioPcmCache(temp_dir, ram_budget_bytes));
+            if (!pcm_cache_) {
+                LOGE("AudioDecodeService::EnablePcmCache OOM");
+            }
+        }
+
+        void AudioDecodeService::SetPlaybackRate(double rate) {
+            rate = ClampPlaybackRate(rate);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (std::fabs(playback_rate_ - rate) < TIME_EPS) {
+                    return;
+                }
+                LOGI("AudioDecodeService::SetPlaybackRate rate:%f", rate);
+                playback_rate_ = rate;
+                // samples stretched with the old rate would delay the change by the buffer length
+                decoded_audio_buffer_.Clear();
+                position_change_request_.reset(new(std::nothrow) DecodePositionChangeRequest(
+                        internal_clock_->GetRenderPos()));
+                if (!position_change_request_) {
+                    return;
+                }
+                position_change_request_->from_playback_clock = true;
+            }
+            cv_.notify_all();
+        }
+
         void AudioDecodeService::ResetDecodePosition(double render_pos) {
             std::lock_guard<std::mutex> lock(mutex_);
             decoded_audio_buffer_.Clear();
@@ -76,6 +132,14 @@ namespace whensunset {
             cv_.notify_all();
         }
 
+        void AudioDecodeService::SetLoopRegion(double loop_start, double loop_end) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            LOGI("AudioDecodeService::SetLoopRegion loop_start:%f, loop_end:%f", loop_start,
+                 loop_end);
+            loop_start_ticks_ = base::SecToTicks(loop_start);
+            loop_end_ticks_ = base::SecToTicks(loop_end);
+        }
+
         void AudioDecodeService::Start() {
             std::lock_guard<std::mutex> start_stop_lk(start_stop_mutex_);
             {
@@ -83,7 +147,7 @@ namespace whensunset {
                 if (!is_stopped_ || is_released_) {
                     return;
                 }
-                if (project_.media_asset_size() == 0) {
+                if (!project_ || project_->media_asset_size() == 0) {
                     return;
                 }
 
@@ -108,92 +172,336 @@ namespace whensunset {
                 decode_thread_.join();
             }
             audio_decoders_.clear();
+            decoder_by_asset_id_.clear();
+            display_index_.clear();
         }
 
-        int AudioDecodeService::GetAudio(uint8_t *buff, int size, double *render_pos) {
-            std::unique_lock<std::mutex> lk(mutex_);
+        int AudioDecodeService::GetAudio(uint8_t *buff, int size, double *render_pos,
+                                         double *playback_rate) {
+            // called on the audio output thread, must not take mutex_
             memset(buff, 0, static_cast<size_t >(size));
 
-            int got_length = decoded_audio_buffer_.Get(buff, size, render_pos, false);
+            base::MediaTicks render_ticks = 0;
+            int got_length = decoded_audio_buffer_.Get(buff, size, &render_ticks, playback_rate);
 
             if (got_length > 0) {
-                internal_clock_->SetPts(*render_pos);
+                internal_clock_->SetTicks(render_ticks);
+                *render_pos = base::TicksToSec(render_ticks);
             }
-            int mix_len = size / 2;
-            short *dst = (short *) buff;
-            short *src = (short *) buff;
+            return got_length;
+        }
 
-            for (int t = 0; t < mix_len; t++) {
-                int mix_value = src[t] + dst[t];
-                mix_value = std::max(SHRT_MIN, std::min(SHRT_MAX, mix_value));
-                dst[t] = static_cast<short >(mix_value);
+        int AudioDecodeService::MixDown(const model::EditorProject &project, double start_sec,
+                                        double duration_sec, const AudioMixDownSink &sink,
+                                        AudioMixDownStats *stats) {
+            std::lock_guard<std::mutex> start_stop_lk(start_stop_mutex_);
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                if (!is_stopped_ || is_released_) {
+                    LOGE("AudioDecodeService::MixDown service is running or released");
+                    return AVERROR(EBUSY);
+                }
+                decode_pcm_cache_ = pcm_cache_;
+                decode_playback_rate_ = playback_rate_;
             }
-            return got_length;
+            if (duration_sec <= 0.0 || project.media_asset_size() == 0) {
+                return AVERROR(EINVAL);
+            }
+            auto begin_time = std::chrono::steady_clock::now();
+
+            UpdateAudioDecoders(project);
+            loop_armed_ = false;
+            buffer_loop_offset_ = 0;
+            SetBufferTrackPos(fmax(0.0, start_sec));
+            SeekAudioDecoder(buffer_track_pos());
+            mix_limiter_.Reset();
+            ResetTimeStretcher(buffer_track_pos());
+
+            int sample_bytes_size = av_get_bytes_per_sample(dst_sample_fmt_) * dst_channels_;
+            int chunk_samples = dst_sample_rate_ * kMixDownChunkMs / 1000;
+            int64_t output_samples = static_cast<int64_t>(
+                    round(duration_sec / decode_playback_rate_ * dst_sample_rate_));
+            // the limiter delays its output, render that much more and drop it from the front
+            int64_t skip_samples = mix_limiter_.latency_samples();
+            int64_t remaining_samples = output_samples + skip_samples;
+            int ret = 0;
+            while (remaining_samples > 0) {
+                int nb_samples = static_cast<int>(std::min<int64_t>(chunk_samples,
+                                                                    remaining_samples));
+                double track_pos = 0.0;
+                float *bus = nullptr;
+                if (decode_playback_rate_ == 1.0) {
+                    // split at every cut, StretchAudioChunk does the same for its mix chunks
+                    nb_samples = std::min(nb_samples, SamplesUntilClipBoundary());
+                    bus = MixAudioChunk(project, nb_samples);
+                } else {
+                    bus = StretchAudioChunk(project, nb_samples, &track_pos);
+                }
+                uint8_t *buff = chunk_buffer_.Reserve(nb_samples * sample_bytes_size);
+                if (!bus || !buff) {
+                    ret = AVERROR(ENOMEM);
+                    break;
+                }
+                const float *planes[AV_NUM_DATA_POINTERS];
+                for (int i = 0; i < dst_channels_; ++i) {
+                    planes[i] = bus + i * nb_samples;
+                }
+                mix_limiter_.ProcessToS16(planes, nb_samples, reinterpret_cast<int16_t *>(buff));
+
+                int drop_samples = static_cast<int>(std::min<int64_t>(skip_samples, nb_samples));
+                skip_samples -= drop_samples;
+                remaining_samples -= nb_samples;
+                if (nb_samples > drop_samples) {
+                    ret = sink(buff + drop_samples * sample_bytes_size,
+                               (nb_samples - drop_samples) * sample_bytes_size);
+                    if (ret < 0) {
+                        break;
+                    }
+                }
+            }
+
+            audio_decoders_.clear();
+            decoder_by_asset_id_.clear();
+            display_index_.clear();
+
+            double elapsed_sec = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - begin_time).count();
+            double rendered_sec = (output_samples - remaining_samples) /
+                                  static_cast<double>(dst_sample_rate_);
+            double realtime_factor = elapsed_sec > 0.0 ? rendered_sec / elapsed_sec : 0.0;
+            LOGI("AudioDecodeService::MixDown ret:%d, rendered_sec:%f, elapsed_sec:%f, "
+                 "realtime_factor:%f", ret, rendered_sec, elapsed_sec, realtime_factor);
+            if (stats) {
+                stats->rendered_sec = rendered_sec;
+                stats->elapsed_sec = elapsed_sec;
+                stats->realtime_factor = realtime_factor;
+            }
+            return ret < 0 ? ret : 0;
+        }
+
+        int MixDownAudioToWav(const model::EditorProject &project, const std::string &wav_path,
+                              double start_sec, double duration_sec, AudioMixDownStats *stats) {
+            std::unique_ptr<AudioDecodeService> audio_decode_service(
+                    new(std::nothrow) AudioDecodeService());
+            if (!audio_decode_service) {
+                LOGE("MixDownAudioToWav OOM");
+                return AVERROR(ENOMEM);
+            }
+            AudioWavWriter wav_writer;
+            int ret = wav_writer.Open(wav_path, audio_decode_service->dst_channels(),
+                                      audio_decode_service->dst_sample_rate());
+            if (ret < 0) {
+                return ret;
+            }
+            ret = audio_decode_service->MixDown(
+                    project, start_sec, duration_sec,
+                    [&wav_writer](const uint8_t *data, int size) {
+                        return wav_writer.Write(data, size);
+                    }, stats);
+            int close_ret = wav_writer.Close();
+            return ret < 0 ? ret : close_ret;
         }
 
         void AudioDecodeService::DecodeWorker() {
             SetCurrentThreadName("EditorTrackAudioDecode");
             do {
                 bool asset_audio_updated = false;
+                bool keep_buffer = false;
                 bool asset_volume_updated = false;
-                model::EditorProject project;
+                bool pcm_cache_enabled = false;
+                ProjectSnapshot project;
                 std::unique_ptr<DecodePositionChangeRequest> position_change_request(nullptr);
                 {
                     std::unique_lock<std::mutex> lk(mutex_);
-                    cv_.wait(lk,
-                             [this] { return project_.media_asset_size() > 0 || is_stopped_; });
+                    cv_.wait(lk, [this] {
+                        return (project_ && project_->media_asset_size() > 0) || is_stopped_;
+                    });
                     if (is_stopped_) {
                         break;
                     }
                     project = project_;
+                    pcm_cache_enabled = !decode_pcm_cache_ && pcm_cache_;
+                    decode_pcm_cache_ = pcm_cache_;
+                    decode_playback_rate_ = playback_rate_;
                     if (position_change_request_) {
                         position_change_request = std::move(position_change_request_);
+                    } else if (asset_audio_updated_ && buffer_loop_offset_ == 0 &&
+                               buffer_track_pos() < asset_audio_unchanged_before_ - PTS_EPS) {
+                        // the change starts after everything mixed so far, keep the buffer and
+                        // just swap the decoders. After a loop wrap the buffer may still hold
+                        // samples from before the wrap, so that case starts over
+                        asset_audio_updated = true;
+                        keep_buffer = true;
+                        asset_audio_updated_ = asset_volume_updated_ = false;
                     } else if (asset_audio_updated_) {
                         asset_audio_updated = asset_audio_updated_;
                         asset_audio_updated_ = asset_volume_updated_ = false;
                         decoded_audio_buffer_.Clear();
+                        mix_limiter_.Reset();
                         // reset buffer read position
-                        buffer_track_pos_ = internal_clock_->GetRenderPos();
                         position_change_request.reset(new(std::nothrow) DecodePositionChangeRequest(
-                                buffer_track_pos_));
+                                internal_clock_->GetRenderPos()));
 
                         if (!position_change_request) {
                             return;
                         }
+                        position_change_request->from_playback_clock = true;
                     } else if (asset_volume_updated_) {
                         asset_volume_updated = true;
                         asset_volume_updated_ = false;
                     }
+                    if (position_change_request) {
+                        decode_loop_start_ticks_ = loop_start_ticks_;
+                        decode_loop_end_ticks_ = loop_end_ticks_;
+                    }
+                }
+                if (pcm_cache_enabled) {
+                    for (const auto &audio_decoder : audio_decoders_) {
+                        RequestPcmCacheIfNeeded(audio_decoder.get());
+                    }
                 }
                 if (asset_audio_updated) {
-                    UpdateAudioDecoders(project);
+                    UpdateAudioDecoders(*project);
+                    if (keep_buffer) {
+                        // the other decoders already decode at the track position
+                        for (AssetAudioDecoder *audio_decoder : repositioned_decoders_) {
+                            SeekAudioDecoder(audio_decoder, buffer_track_pos());
+                        }
+                    }
                 } else if (asset_volume_updated) {
-                    UpdateAudioDecodersVolume(project);
+                    UpdateAudioDecodersVolume(*project);
                 }
                 if (position_change_request) {
-                    buffer_track_pos_ = position_change_request->render_pos;
-                    SeekAudioDecoder(buffer_track_pos_);
-                    internal_clock_->SetPts(buffer_track_pos_);
+                    if (position_change_request->from_playback_clock) {
+                        SetBufferTrackPosFromClock(position_change_request->render_pos);
+                    } else {
+                        SetBufferTrackPos(position_change_request->render_pos);
+                        buffer_loop_offset_ = 0;
+                        loop_armed_ = decode_loop_end_ticks_ > decode_loop_start_ticks_ &&
+                                      buffer_track_ticks() < decode_loop_end_ticks_;
+                    }
+                    SeekAudioDecoder(buffer_track_pos());
+                    internal_clock_->SetTicks(buffer_track_ticks() + buffer_loop_offset_);
                     decoded_audio_buffer_.Clear();
+                    mix_limiter_.Reset();
+                    ResetTimeStretcher(buffer_track_pos());
                     position_change_request.reset();
                 }
-                BufferOneAudioSample(project);
+                BufferOneAudioSample(*project);
             } while (true);
         }
 
+        void AudioDecodeService::SetBufferTrackPosFromClock(double clock_pos) {
+            base::MediaTicks track_ticks = base::SecToTicks(clock_pos) - buffer_loop_offset_;
+            base::MediaTicks loop_ticks = decode_loop_end_ticks_ - decode_loop_start_ticks_;
+            // the clock lags the mixing, it may not have reached the last wraps yet
+            while (buffer_loop_offset_ > 0 && loop_ticks > 0 &&
+                   track_ticks < decode_loop_start_ticks_) {
+                buffer_loop_offset_ -= loop_ticks;
+                track_ticks += loop_ticks;
+            }
+            buffer_track_anchor_ = track_ticks;
+            buffer_track_samples_ = 0;
+        }
+
+        int AudioDecodeService::SamplesUntilLoopEnd() const {
+            if (!loop_armed_) {
+                return INT_MAX;
+            }
+            int64_t loop_end_samples = base::TicksToSamples(
+                    decode_loop_end_ticks_ - buffer_track_anchor_, dst_sample_rate_);
+            return static_cast<int>(std::max<int64_t>(0, std::min<int64_t>(
+                    INT_MAX, loop_end_samples - buffer_track_samples_)));
+        }
+
+        int AudioDecodeService::SamplesUntilClipBoundary() const {
+            // a boundary within PTS_EPS counts as passed, FindActiveDecoders does the same
+            double track_pos = buffer_track_pos() + PTS_EPS;
+            auto pos_less = [](double pos, const AssetAudioDecoder *decoder) {
+                return pos < decoder->display_range_.start();
+            };
+            auto next = std::upper_bound(display_index_.begin(), display_index_.end(), track_pos,
+                                         pos_less);
+            double boundary = DBL_MAX;
+            if (next != display_index_.end()) {
+                boundary = (*next)->display_range_.start();
+            }
+            if (next != display_index_.begin()) {
+                const model::TimeRange &range = (*(next - 1))->display_range_;
+                double end = range.start() + range.duration();
+                if (end > track_pos) {
+                    boundary = std::min(boundary, end);
+                }
+            }
+            if (boundary == DBL_MAX) {
+                return INT_MAX;
+            }
+            int64_t boundary_samples = base::TicksToSamples(
+                    base::SecToTicks(boundary) - buffer_track_anchor_, dst_sample_rate_);
+            return static_cast<int>(std::max<int64_t>(1, std::min<int64_t>(
+                    INT_MAX, boundary_samples - buffer_track_samples_)));
+        }
+
+        void AudioDecodeService::WrapLoopIfNeeded() {
+            if (SamplesUntilLoopEnd() > 0) {
+                return;
+            }
+            buffer_loop_offset_ += decode_loop_end_ticks_ - decode_loop_start_ticks_;
+            SetBufferTrackPos(base::TicksToSec(decode_loop_start_ticks_));
+            // frequently seeked assets get PCM cached, so later wraps seek in O(1)
+            SeekAudioDecoder(buffer_track_pos());
+            LOGI("AudioDecodeService::WrapLoopIfNeeded buffer_loop_offset_:%lld",
+                 (long long) buffer_loop_offset_);
+        }
+
+        int AudioDecodeService::NextDecodeQuantumBytes() {
+            int sample_bytes_size = av_get_bytes_per_sample(dst_sample_fmt_) * dst_channels_;
+            int min_len = dst_sample_rate_ * kMinDecodeQuantumMs / 1000 * sample_bytes_size;
+            int max_len = dst_sample_rate_ * kMaxDecodeQuantumMs / 1000 * sample_bytes_size;
+            if (decoded_audio_buffer_.size() * 2 >= decoded_audio_buffer_.capacity()) {
+                return min_len;
+            }
+            // refilling: take all the free space in one block
+            int free_len = decoded_audio_buffer_.free_size() / sample_bytes_size * sample_bytes_size;
+            return std::max(min_len, std::min(max_len, free_len));
+        }
+
         void
         AudioDecodeService::BufferOneAudioSample(const model::EditorProject &project) {
-            int sample_bytes_size = av_get_bytes_per_sample(dst_sample_fmt_) * dst_channels_;
-            int len = dst_sample_rate_ / 100 * sample_bytes_size;
-            std::unique_ptr<uint8_t[]> buff(new(std::nothrow) uint8_t[len]);
+            int len = NextDecodeQuantumBytes();
+            uint8_t *buff = chunk_buffer_.Reserve(len);
             if (!buff) {
                 return;
             }
-            memset(buff.get(), 0, static_cast<size_t >(len));
-
-            double buffer_track_pos = buffer_track_pos_;
+            int sample_bytes_size = av_get_bytes_per_sample(dst_sample_fmt_) * dst_channels_;
+            int nb_samples = len / sample_bytes_size;
+
+            WrapLoopIfNeeded();
+            base::MediaTicks track_ticks = buffer_track_ticks() + buffer_loop_offset_;
+            double playback_rate = decode_playback_rate_;
+            float *bus = nullptr;
+            if (playback_rate == 1.0) {
+                // a chunk never crosses the loop end, the next one starts at the loop start
+                nb_samples = std::min(nb_samples, SamplesUntilLoopEnd());
+                nb_samples = std::min(nb_samples, SamplesUntilClipBoundary());
+                len = nb_samples * sample_bytes_size;
+                bus = MixAudioChunk(project, nb_samples);
+            } else {
+                double stretch_track_pos = 0.0;
+                bus = StretchAudioChunk(project, nb_samples, &stretch_track_pos);
+                track_ticks = base::SecToTicks(stretch_track_pos);
+            }
+            if (!bus) {
+                return;
+            }
 
-            GetAudioBufferInternal(project, buff.get(), len);
+            const float *planes[AV_NUM_DATA_POINTERS];
+            assert(dst_channels_ <= AV_NUM_DATA_POINTERS);
+            for (int i = 0; i < dst_channels_; ++i) {
+                planes[i] = bus + i * nb_samples;
+            }
+            assert(dst_sample_fmt_ == AV_SAMPLE_FMT_S16);
+            mix_limiter_.ProcessToS16(planes, nb_samples, reinterpret_cast<int16_t *>(buff));
 
             bool has_position_change_request = false;
             {
@@ -204,182 +512,215 @@ namespace whensunset {
             }
 
             if (!has_position_change_request) {
-                buffer_track_pos = fmax(buffer_track_pos, internal_clock_->GetRenderPos());
-                decoded_audio_buffer_.Put(buff.get(), len, buffer_track_pos);
+                // the limiter delays its output, in stretched samples
+                track_ticks = std::max<base::MediaTicks>(0, track_ticks - base::SecToTicks(
+                        mix_limiter_.latency_sec() * playback_rate));
+                decoded_audio_buffer_.Put(buff, len, track_ticks, playback_rate);
             }
         }
 
+        float *AudioDecodeService::StretchAudioChunk(const model::EditorProject &project,
+                                                     int nb_samples, double *track_pos) {
+            *track_pos = stretch_anchor_pos_ +
+                         stretch_output_samples_ * time_stretcher_.rate() / dst_sample_rate_;
+            int min_mix_samples = dst_sample_rate_ * kMinDecodeQuantumMs / 1000;
+            while (time_stretcher_.available_samples() < nb_samples) {
+                int missing = nb_samples - time_stretcher_.available_samples();
+                WrapLoopIfNeeded();
+                int mix_samples = std::max(min_mix_samples, static_cast<int>(
+                        std::ceil(missing * time_stretcher_.rate())));
+                mix_samples = std::min(mix_samples, SamplesUntilLoopEnd());
+                mix_samples = std::min(mix_samples, SamplesUntilClipBoundary());
+                float *mix_bus = MixAudioChunk(project, mix_samples);
+                if (!mix_bus) {
+                    return nullptr;
+                }
+                const float *mix_planes[AV_NUM_DATA_POINTERS];
+                for (int i = 0; i < dst_channels_; ++i) {
+                    mix_planes[i] = mix_bus + i * mix_samples;
+                }
+                time_stretcher_.PutSamples(mix_planes, mix_samples);
+            }
+
+            int stretch_len = nb_samples * dst_channels_ * av_get_bytes_per_sample(mix_sample_fmt_);
+            float *stretch_bus = reinterpret_cast<float *>(stretch_bus_.Reserve(stretch_len));
+            if (!stretch_bus) {
+                return nullptr;
+            }
+            float *stretch_planes[AV_NUM_DATA_POINTERS];
+            for (int i = 0; i < dst_channels_; ++i) {
+                stretch_planes[i] = stretch_bus + i * nb_samples;
+            }
+            time_stretcher_.ReceiveSamples(stretch_planes, nb_samples);
+            stretch_output_samples_ += nb_samples;
+            return stretch_bus;
+        }
+
+        void AudioDecodeService::ResetTimeStretcher(double track_pos) {
+            time_stretcher_.Reset(decode_playback_rate_);
+            stretch_anchor_pos_ = track_pos + base::TicksToSec(buffer_loop_offset_);
+            stretch_output_samples_ = 0;
+        }
+
         void AudioDecodeService::SeekAudioDecoder(double track_pos) {
             if (audio_decoders_.size() == 0) {
                 return;
             }
-            for (const auto &audio_decoder_ptr : audio_decoders_) {
-                AssetAudioDecoder *const audio_decoder = audio_decoder_ptr.get();
-                double seek_sec = track_pos;
-                double offset = audio_decoder->display_range_.start();
-                // get offset from the start of display range
-                seek_sec = fmax(0.0, seek_sec - offset);
-                // make sure the offset is inside asset duration in repeat mode
-                if (audio_decoder->is_repeat_) {
-                    double duration = audio_decoder->clipped_range_.duration();
-                    while (seek_sec > duration) {
-                        seek_sec -= duration;
-                    }
+            for (const auto &audio_decoder : audio_decoders_) {
+                SeekAudioDecoder(audio_decoder.get(), track_pos);
+            }
+        }
+
+        void AudioDecodeService::SeekAudioDecoder(AssetAudioDecoder *audio_decoder,
+                                                  double track_pos) {
+            ++audio_decoder->seek_count_;
+            RequestPcmCacheIfNeeded(audio_decoder);
+            double seek_sec = track_pos;
+            double offset = audio_decoder->display_range_.start();
+            // get offset from the start of display range
+            seek_sec = fmax(0.0, seek_sec - offset);
+            // make sure the offset is inside asset duration in repeat mode
+            if (audio_decoder->is_repeat_) {
+                double duration = audio_decoder->clipped_range_.duration();
+                while (seek_sec > duration) {
+                    seek_sec -= duration;
                 }
-                // get position in audio asset
-                seek_sec = seek_sec + audio_decoder->clipped_range_.start();
-                audio_decoder->audio_decode_ctx_->Seek(seek_sec);
             }
+            // get position in audio asset
+            seek_sec = seek_sec + audio_decoder->clipped_range_.start();
+            audio_decoder->audio_decode_ctx_->Seek(seek_sec);
         }
 
-        void
-        AudioDecodeService::GetAudioBufferInternal(const model::EditorProject &project,
-                                                        uint8_t *buff, int len) {
-            int sample_bytes_size = av_get_bytes_per_sample(dst_sample_fmt_) * dst_channels_;
-            int need_nb_samples = len / sample_bytes_size;
+        void AudioDecodeService::RequestPcmCacheIfNeeded(AssetAudioDecoder *audio_decoder) {
+            if (!decode_pcm_cache_ || audio_decoder->pcm_cache_requested_) {
+                return;
+            }
+            if (!audio_decoder->is_repeat_
+                && audio_decoder->audio_decode_ctx_->duration_sec() > kPcmCacheMaxAssetDurationSec
+                && audio_decoder->seek_count_ < kPcmCacheSeekCountThreshold) {
+                return;
+            }
+            audio_decoder->pcm_cache_requested_ = true;
+            decode_pcm_cache_->Request(audio_decoder->asset_path_, dst_channels_, dst_sample_rate_,
+                                       mix_sample_fmt_);
+        }
+
+        void AudioDecodeService::AttachPcmCacheIfReady(AssetAudioDecoder *audio_decoder) {
+            AudioDecodeContext *audio_decode_ctx = audio_decoder->audio_decode_ctx_.get();
+            if (!decode_pcm_cache_ || !audio_decoder->pcm_cache_requested_
+                || audio_decode_ctx->has_pcm_cache_entry()) {
+                return;
+            }
+            std::shared_ptr<const AudioPcmCacheEntry> entry = decode_pcm_cache_->Lookup(
+                    audio_decoder->asset_path_, dst_channels_, dst_sample_rate_, mix_sample_fmt_);
+            if (entry) {
+                audio_decode_ctx->set_pcm_cache_entry(std::move(entry));
+            }
+        }
 
-            memset(buff, 0, static_cast<size_t >(len));
+        float *AudioDecodeService::MixAudioChunk(const model::EditorProject &project,
+                                                 int need_nb_samples) {
+            int mix_len = need_nb_samples * dst_channels_ * av_get_bytes_per_sample(mix_sample_fmt_);
+
+            float *mix_bus = reinterpret_cast<float *>(mix_bus_.Reserve(mix_len));
+            if (!mix_bus) {
+                return nullptr;
+            }
+            memset(mix_bus, 0, static_cast<size_t >(mix_len));
 
-            bool first_audio_track_found = false;
             bool get_audio_ret = true;
-            double buffer_track_pos = buffer_track_pos_;
-            double buffer_track_pos_after_got = buffer_track_pos_;
+            double track_pos = buffer_track_pos();
             double cur_get_sec = 0;
             double start_offset = 0.0;
 
             auto decode_audio_frame = [&](AssetAudioDecoder *const audio_decoder) {
                 AudioDecodeContext *audio_decode_ctx = audio_decoder->audio_decode_ctx_.get();
                 // real get position of audio decoder should add output_delay
-                std::unique_ptr<uint8_t[]> sub_buff{new(std::nothrow) uint8_t[len]};
+                uint8_t *sub_buff = audio_decoder->scratch_buffer_.Reserve(mix_len);
                 if (!sub_buff) {
                     return;
                 }
-                memset(sub_buff.get(), 0, static_cast<size_t >(len));
+                memset(sub_buff, 0, static_cast<size_t >(mix_len));
                 get_audio_ret = true;
 
                 start_offset = audio_decoder->display_range_.start();
 
-                while (1) {
-                    // Get samples from audio decoder
-                    // Calculate the true position in the original audio asset
-                    std::unique_ptr<uint8_t[]> original_audio_buff(new(std::nothrow) uint8_t[len]);
-                    if (!original_audio_buff) {
-                        break;
-                    }
-                    memset(original_audio_buff.get(), 0, static_cast<size_t >(len));
-                    cur_get_sec -= start_offset;
-                    cur_get_sec = fmax(0.0, cur_get_sec);
-                    int64_t cur_get_pos = static_cast<long>(cur_get_sec *
-                                                            audio_decode_ctx->dst_sample_rate());
-                    int64_t clipped_start_pos = static_cast<int >(round(
-                            audio_decoder->clipped_range_.start() *
-                            audio_decode_ctx->dst_sample_rate()));
-                    int64_t clipped_end_pos = static_cast<int >(round(
-                            (audio_decoder->clipped_range_.start() +
-                             audio_decoder->clipped_range_.duration())
-                            * audio_decode_ctx->dst_sample_rate()));
-                    int64_t clipped_len = clipped_end_pos - clipped_start_pos;
-                    // if repeated, cur_get_pos need % clipped_len
-                    if (audio_decoder->is_repeat_) {
-                        double duration = audio_decoder->clipped_range_.duration();
-                        int loop_count = 0;
-                        while (cur_get_sec >= duration - TIME_EPS) {
-                            cur_get_sec -= duration;
-                            loop_count++;
-                        }
-                        // seek if loop count changed
-                        if (audio_decoder->current_loop_count_ != loop_count) {
-                            // position in audio asset
-                            cur_get_sec = cur_get_sec + audio_decoder->clipped_range_.start();
-                            audio_decode_ctx->Seek(cur_get_sec);
-                            audio_decoder->current_loop_count_ = loop_count;
-                        }
-                        cur_get_pos %= clipped_len;
+                // Get samples from audio decoder
+                // Calculate the true position in the original audio asset
+                cur_get_sec -= start_offset;
+                cur_get_sec = fmax(0.0, cur_get_sec);
+                int64_t cur_get_pos = static_cast<long>(cur_get_sec *
+                                                        audio_decode_ctx->dst_sample_rate());
+                int64_t clipped_start_pos = static_cast<int >(round(
+                        audio_decoder->clipped_range_.start() *
+                        audio_decode_ctx->dst_sample_rate()));
+                int64_t clipped_end_pos = static_cast<int >(round(
+                        (audio_decoder->clipped_range_.start() +
+                         audio_decoder->clipped_range_.duration())
+                        * audio_decode_ctx->dst_sample_rate()));
+                int64_t clipped_len = clipped_end_pos - clipped_start_pos;
+                // if repeated, cur_get_pos need % clipped_len
+                if (audio_decoder->is_repeat_) {
+                    double duration = audio_decoder->clipped_range_.duration();
+                    int loop_count = 0;
+                    while (cur_get_sec >= duration - TIME_EPS) {
+                        cur_get_sec -= duration;
+                        loop_count++;
                     }
-                    get_audio_ret = audio_decode_ctx->GetAudio(cur_get_pos + clipped_start_pos,
-                                                               original_audio_buff.get(), len);
-
-                    if (!get_audio_ret) {
-                        break;
+                    // seek if loop count changed
+                    if (audio_decoder->current_loop_count_ != loop_count) {
+                        // position in audio asset
+                        cur_get_sec = cur_get_sec + audio_decoder->clipped_range_.start();
+                        audio_decode_ctx->Seek(cur_get_sec);
+                        audio_decoder->current_loop_count_ = loop_count;
                     }
-                    // not audio processor, just break
-                    memcpy(sub_buff.get(), original_audio_buff.get(), len);
-                    break;
+                    cur_get_pos %= clipped_len;
                 }
+                // decode straight into the mix scratch buffer
+                get_audio_ret = audio_decode_ctx->GetAudio(cur_get_pos + clipped_start_pos,
+                                                           sub_buff, mix_len);
 
                 if (!get_audio_ret) {
                     return;
                 }
 
-                if (get_audio_ret && !first_audio_track_found) {
-                    // only origin track assets can only affect clock
-                    first_audio_track_found = true;
-                    buffer_track_pos_after_got = audio_decode_ctx->current_buffer_sec() +
-                                                 audio_decoder->display_range_.start()
-                                                 - audio_decoder->clipped_range_.start();
-                }
-
-                AudioMixerSimpleProcess(buff, buff, sub_buff.get(), need_nb_samples, dst_channels_);
+                // bus and sub_buff have the same planar layout, so all planes mix in one pass
+                AudioMixAccumulateFloat(mix_bus, reinterpret_cast<const float *>(sub_buff),
+                                        need_nb_samples * dst_channels_,
+                                        AudioMixGainFromVolume(audio_decoder->volume_));
             };
 
-            for (int i = 0; i < audio_decoders_.size(); i++) {
-                // 4 cases we need to ignore the audio asset:
-                // 1st: not wanted type
-                // 2nd: volume == 0.0
-                AssetAudioDecoder *const audio_decoder = audio_decoders_[i].get();
-
-                // 3rd: not in display range. (Notice: display range should use render_pos_)
-                if (buffer_track_pos >= audio_decoder->display_range_.start() +
-                                        audio_decoder->display_range_.duration() - PTS_EPS
-                    || buffer_track_pos < audio_decoder->display_range_.start() - PTS_EPS) {
-                    continue;
-                }
-                // 4th: is in display range, but is not repeated and out of audio file range.
-                cur_get_sec = buffer_track_pos;
+            FindActiveDecoders(track_pos, &active_decoders_);
+            for (AssetAudioDecoder *const audio_decoder : active_decoders_) {
+                // skip decoders that ran past the end of their clipped range
+                cur_get_sec = track_pos;
                 start_offset = audio_decoder->display_range_.start();
-                // use private clock in audio decode context
-                AudioDecodeContext *audio_decode_ctx = audio_decoder->audio_decode_ctx_.get();
                 if (!audio_decoder->is_repeat_
                     && cur_get_sec >= start_offset + audio_decoder->clipped_range_.duration()) {
                     continue;
                 }
-                // 5th: clipped range has no duration, will be seen as illegal asset
+                // a clipped range without duration is an illegal asset
                 if (audio_decoder->clipped_range_.duration() < TIME_EPS) {
                     continue;
                 }
 
+                AttachPcmCacheIfReady(audio_decoder);
                 decode_audio_frame(audio_decoder);
-
-                if (get_audio_ret && !first_audio_track_found) {
-                    // only origin track assets can only affect clock
-                    double buffer_track_pos_tmp;
-                    first_audio_track_found = true;
-                    buffer_track_pos_tmp = audio_decode_ctx->current_buffer_sec() +
-                                           audio_decoder->display_range_.start()
-                                           - audio_decoder->clipped_range_.start();
-                    // QuickFix: for 500w
-                    buffer_track_pos_ = fmax(buffer_track_pos_tmp, buffer_track_pos_);
-                }
             }
 
-            if (!first_audio_track_found) {
-                // not got track audio, also need to forward buffer_track_pos_
-                buffer_track_pos_after_got += ((double) need_nb_samples) / dst_sample_rate_;
-            }
-            buffer_track_pos_ = std::max(buffer_track_pos_, fmax(0.0, buffer_track_pos_after_got));
+            // decoders seek sample accurately and return exactly the requested samples, so the
+            // track position just advances by the chunk
+            buffer_track_samples_ += need_nb_samples;
+            return mix_bus;
         }
 
         void AudioDecodeService::UpdateAudioDecodersVolume(
                 const model::EditorProject &project) {
             for (int i = 0; i < project.media_asset_size(); ++i) {
-                auto asset = project.media_asset(i);
-                auto decoder = std::find_if(audio_decoders_.begin(), audio_decoders_.end(),
-                                            [&asset](
-                                                    const std::unique_ptr<AssetAudioDecoder> &decoder) {
-                                                return decoder->asset_id_ == asset.asset_id();
-                                            });
-                if (decoder != audio_decoders_.end()) {
-                    (*decoder)->volume_ = asset.volume();
+                const model::MediaAsset &asset = project.media_asset(i);
+                auto decoder = decoder_by_asset_id_.find(asset.asset_id());
+                if (decoder != decoder_by_asset_id_.end()) {
+                    decoder->second->volume_ = asset.volume();
                 }
             }
         }
@@ -387,8 +728,9 @@ namespace whensunset {
         bool
         AudioDecodeService::UpdateAudioDecoders(const model::EditorProject &project) {
             ClearInvalidDecoders(project);
+            display_index_.clear();
+            repositioned_decoders_.clear();
             double start_sec = 0.0;
-            PreviewTimeline timeline(project);
             for (int i = 0; i < project.media_asset_size(); i++) {
                 const model::MediaAsset &asset = project.media_asset(i);
                 std::string audio_path;
@@ -397,7 +739,7 @@ namespace whensunset {
                 if (asset.has_media_asset_file_holder()) {
                     src_file_duration = asset.media_asset_file_holder().duration();
                 }
-                clipped_duration = src_file_duration;
+                clipped_duration = MediaAssetClippedRange(asset).duration();
 
                 if (src_file_duration < TIME_EPS && clipped_duration < TIME_EPS) {
                     continue;
@@ -405,10 +747,10 @@ namespace whensunset {
 
                 audio_path = asset.asset_path();
 
-                AssetAudioDecoder *asset_audio_decoder = nullptr;
-                int insert_pos = FindInsertDecoderPosition(project, i);
-                asset_audio_decoder = AddAudioDecoder(audio_path, &asset, src_file_duration,
-                                                      insert_pos);
+                bool is_new_decoder = decoder_by_asset_id_.find(asset.asset_id()) ==
+                                      decoder_by_asset_id_.end();
+                AssetAudioDecoder *asset_audio_decoder = AddAudioDecoder(audio_path, &asset,
+                                                                         src_file_duration);
 
                 if (!asset_audio_decoder) {
                     start_sec += clipped_duration;
@@ -419,36 +761,51 @@ namespace whensunset {
                     src_file_duration = asset_audio_decoder->audio_decode_ctx_->duration_sec();
                 }
 
-                clipped_duration = src_file_duration;
+                model::TimeRange clipped_range = MediaAssetClippedRange(asset);
+                if (src_file_duration > TIME_EPS && clipped_range.duration() < TIME_EPS) {
+                    clipped_range.set_start(0.0);
+                    clipped_range.set_duration(src_file_duration);
+                }
+                clipped_duration = clipped_range.duration();
 
                 model::TimeRange display_range;
                 display_range.set_start(start_sec);
                 display_range.set_duration(clipped_duration);
+                if (is_new_decoder || asset_audio_decoder->clipped_range_ != clipped_range
+                    || asset_audio_decoder->display_range_ != display_range) {
+                    repositioned_decoders_.push_back(asset_audio_decoder);
+                }
+                asset_audio_decoder->clipped_range_ = clipped_range;
+                asset_audio_decoder->audio_decode_ctx_->set_clipped_range_start(
+                        clipped_range.start());
                 asset_audio_decoder->display_range_ = display_range;
+                // start_sec only grows, so the index stays sorted without sorting it
+                display_index_.push_back(asset_audio_decoder);
                 asset_audio_decoder->volume_ = asset.volume();
                 asset_audio_decoder->is_repeat_ = false;
+                RequestPcmCacheIfNeeded(asset_audio_decoder);
 
                 start_sec += clipped_duration;
             }
-
             return true;
         }
 
         void
         AudioDecodeService::ClearInvalidDecoders(const model::EditorProject &project) {
+            std::unordered_map<uint64_t, const std::string *> project_asset_paths;
+            for (const model::MediaAsset &asset : project.media_asset()) {
+                project_asset_paths[asset.asset_id()] = &asset.asset_path();
+            }
             auto iter = audio_decoders_.begin();
             while (iter != audio_decoders_.end()) {
-                bool should_remove = true;
                 // found it in track assets
-                for (model::MediaAsset asset : project.media_asset()) {
-                    if (asset.asset_id() == (*iter)->asset_id_
-                        && asset.asset_path() == (*iter)->asset_path_
-                        && (*iter)->audio_decode_ctx_) {
-                        should_remove = false;
-                    }
-                }
+                auto found = project_asset_paths.find((*iter)->asset_id_);
+                bool should_remove = found == project_asset_paths.end()
+                                     || *found->second != (*iter)->asset_path_
+                                     || !(*iter)->audio_decode_ctx_;
 
                 if (should_remove) {
+                    decoder_by_asset_id_.erase((*iter)->asset_id_);
                     iter = audio_decoders_.erase(iter);
                 } else {
                     ++iter;
@@ -456,29 +813,30 @@ namespace whensunset {
             }
         }
 
-        int
-        AudioDecodeService::FindInsertDecoderPosition(const model::EditorProject &project,
-                                                           int track_index) {
-            if (track_index == 0) {
-                return 0;
+        void AudioDecodeService::FindActiveDecoders(double track_pos,
+                                                    std::vector<AssetAudioDecoder *> *active) {
+            active->clear();
+            // display ranges are back to back, so only the last one starting at or before
+            // track_pos and the ones starting within PTS_EPS after it can contain track_pos
+            auto pos_less = [](double pos, const AssetAudioDecoder *decoder) {
+                return pos < decoder->display_range_.start();
+            };
+            auto iter = std::upper_bound(display_index_.begin(), display_index_.end(), track_pos,
+                                         pos_less);
+            if (iter != display_index_.begin()) {
+                --iter;
             }
-
-            model::MediaAsset asset_prev = project.media_asset(track_index - 1);
-
-            int insert_pos = 1;
-            auto iter = audio_decoders_.begin();
-            while (iter != audio_decoders_.end()) {
-
-                if (asset_prev.asset_id() == (*iter)->asset_id_
-                    && asset_prev.asset_path() == (*iter)->asset_path_
-                    && (*iter)->audio_decode_ctx_) {
-                    return insert_pos;
+            for (; iter != display_index_.end(); ++iter) {
+                AssetAudioDecoder *audio_decoder = *iter;
+                if (audio_decoder->display_range_.start() - PTS_EPS > track_pos) {
+                    break;
                 }
-
-                ++insert_pos;
-                ++iter;
+                if (track_pos >= audio_decoder->display_range_.start() +
+                                 audio_decoder->display_range_.duration() - PTS_EPS) {
+                    continue;
+                }
+                active->push_back(audio_decoder);
             }
-            return insert_pos;
         }
     }
 }
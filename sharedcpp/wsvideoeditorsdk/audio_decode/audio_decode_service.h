@@ -1,8 +1,10 @@
 #ifndef SHAREDCPP_WS_VIDEO_EDITOR_AUDIO_DECODE_SERVICE_H
 #define SHAREDCPP_WS_VIDEO_EDITOR_AUDIO_DECODE_SERVICE_H
 
+#include <functional>
 #include <memory>
 #include <vector>
+#include <unordered_map>
 #include <thread>
 #include <mutex>
 #include <cmath>
@@ -11,8 +13,15 @@
 #include "constants.h"
 #include "prebuilt_protobuf/ws_video_editor_sdk.pb.h"
 #include "ref_clock.h"
+#include "project_snapshot.h"
+#include "project_diff.h"
+#include "media_time.h"
 #include "audio_sample_ring_buffer.h"
+#include "scratch_buffer.h"
 #include "audio_decode_context.h"
+#include "audio_mixer.h"
+#include "audio_pcm_cache.h"
+#include "audio_time_stretcher.h"
 
 namespace whensunset {
     namespace wsvideoeditor {
@@ -27,6 +36,22 @@ namespace whensunset {
             model::TimeRange display_range_;
             model::TimeRange clipped_range_;
             std::unique_ptr<AudioDecodeContext> audio_decode_ctx_;
+            // samples of this decoder for the chunk being mixed
+            base::ScratchBuffer scratch_buffer_;
+            // seeks since the decoder was added, frequently seeked assets get a PCM cache
+            int seek_count_ = 0;
+            bool pcm_cache_requested_ = false;
+        };
+
+        // Receives the mixed interleaved dst format samples of AudioDecodeService::MixDown(),
+        // a negative return stops the mix-down with that error.
+        typedef std::function<int(const uint8_t *data, int size)> AudioMixDownSink;
+
+        struct AudioMixDownStats {
+            double rendered_sec = 0.0;
+            double elapsed_sec = 0.0;
+            // rendered_sec / elapsed_sec, how many times faster than real time
+            double realtime_factor = 0.0;
         };
 
         class AudioDecodeService {
@@ -42,12 +67,45 @@ namespace whensunset {
 
             void ResetDecodePosition(double render_pos);
 
-            void SetProject(model::EditorProject project, double pos_sec = -1.0);
+            // Loops [loop_start, loop_end) of the track from the next ResetDecodePosition() or
+            // SetProject() with a position before loop_end, loop_end <= loop_start turns it off.
+            // Mixing wraps from loop_end to loop_start inside the buffer, positions handed out by
+            // GetAudio() keep growing by the loop length, so the audio output never flushes.
+            void SetLoopRegion(double loop_start, double loop_end);
+
+            // the same snapshot again only repositions, nothing is compared
+            void SetProject(ProjectSnapshot project, double pos_sec = -1.0);
+
+            // playback_rate gets the rate the returned samples were stretched with
+            int GetAudio(uint8_t *buff, int size, double *render_pos,
+                         double *playback_rate = nullptr);
+
+            // Plays the project at rate (clamped to [kMinPlaybackRate, kMaxPlaybackRate]) with
+            // the pitch kept, buffered samples are dropped and decoding restarts at the clock.
+            void SetPlaybackRate(double rate);
+
+            // Decodes short, looping and frequently seeked assets into a PCM cache in the
+            // background, the cache spills to mmap'd files under temp_dir once the RAM budget is
+            // used up. Cached assets seek in O(1) and are served by memcpy.
+            void EnablePcmCache(const std::string &temp_dir,
+                                int64_t ram_budget_bytes = kDefaultPcmCacheRamBudget);
+
+            // Renders [start_sec, start_sec + duration_sec) of project through the same decoders,
+            // mixer, time stretcher and limiter as playback, but on the calling thread and as fast
+            // as the CPU allows, handing every chunk to sink. The service must be stopped, it is
+            // left stopped with no decoders open. Returns 0 or a negative AVERROR.
+            int MixDown(const model::EditorProject &project, double start_sec, double duration_sec,
+                        const AudioMixDownSink &sink, AudioMixDownStats *stats = nullptr);
+
+            int dst_channels() const {
+                return dst_channels_;
+            }
 
-            int GetAudio(uint8_t *buff, int size, double *render_pos);
+            int dst_sample_rate() const {
+                return dst_sample_rate_;
+            }
 
             int GetBufferedDataSize() {
-                std::lock_guard<std::mutex> lk(mutex_);
                 return decoded_audio_buffer_.size();
             }
 
@@ -71,7 +129,14 @@ namespace whensunset {
 
             bool asset_volume_updated_ = false;
 
-            model::EditorProject project_;
+            // the pending asset update leaves the mix before this track position untouched, so
+            // audio already mixed up to there can stay buffered
+            double asset_audio_unchanged_before_ = 0.0;
+
+            ProjectSnapshot project_;
+
+            // fingerprint of project_, diffed against the next SetProject
+            ProjectFingerprint project_fingerprint_;
 
             std::unique_ptr<DecodePositionChangeRequest> position_change_request_;
 
@@ -81,13 +146,110 @@ namespace whensunset {
 
             int dst_sample_rate_ = 44100;
 
+            // decoders resample straight to the float planar mix bus, only the limiter output
+            // is converted to dst_sample_fmt_
+            AVSampleFormat mix_sample_fmt_ = AV_SAMPLE_FMT_FLTP;
+
             std::unique_ptr<RefClock> internal_clock_;
 
+            // guarded by mutex_, decode_playback_rate_ is the decode thread's copy
+            double playback_rate_ = 1.0;
+
+            double decode_playback_rate_ = 1.0;
+
+            // guarded by mutex_, decode_loop_*_ are the decode thread's copies
+            base::MediaTicks loop_start_ticks_ = 0;
+
+            base::MediaTicks loop_end_ticks_ = 0;
+
+            base::MediaTicks decode_loop_start_ticks_ = 0;
+
+            base::MediaTicks decode_loop_end_ticks_ = 0;
+
+            // the track position has not passed the loop end since the last reposition
+            bool loop_armed_ = false;
+
+            // loop lengths wrapped since the last reposition, added to the buffered positions
+            base::MediaTicks buffer_loop_offset_ = 0;
+
+            // guarded by mutex_, decode_pcm_cache_ is the decode thread's copy
+            std::shared_ptr<AudioPcmCache> pcm_cache_;
+
+            std::shared_ptr<AudioPcmCache> decode_pcm_cache_;
+
             std::vector<std::unique_ptr<AssetAudioDecoder>> audio_decoders_;
 
-            whensunset::base::AudioSampleRingBuffer<uint8_t> decoded_audio_buffer_;
+            std::unordered_map<uint64_t, AssetAudioDecoder *> decoder_by_asset_id_;
+
+            // audio_decoders_ in timeline order, filled by UpdateAudioDecoders. Assets are laid
+            // out back to back, so the display ranges are sorted and do not overlap
+            std::vector<AssetAudioDecoder *> display_index_;
+
+            // active decoders of the chunk being mixed, reused to avoid allocation
+            std::vector<AssetAudioDecoder *> active_decoders_;
+
+            // decoders the last UpdateAudioDecoders inserted or retimed, their decode position
+            // no longer matches the track until they are seeked
+            std::vector<AssetAudioDecoder *> repositioned_decoders_;
+
+            whensunset::base::AudioSampleRingBuffer decoded_audio_buffer_;
+
+            // track position of the next sample to mix, as samples mixed since an anchor: the
+            // total is converted once, so the position does not drift over long playback
+            base::MediaTicks buffer_track_anchor_ = 0;
+
+            int64_t buffer_track_samples_ = 0;
 
-            double buffer_track_pos_ = 0.0;
+            base::MediaTicks buffer_track_ticks() const {
+                return buffer_track_anchor_ + base::SamplesToTicks(buffer_track_samples_,
+                                                                   dst_sample_rate_);
+            }
+
+            double buffer_track_pos() const {
+                return base::TicksToSec(buffer_track_ticks());
+            }
+
+            void SetBufferTrackPos(double track_pos) {
+                buffer_track_anchor_ = base::SecToTicks(track_pos);
+                buffer_track_samples_ = 0;
+            }
+
+            // Repositions the track at a playback clock position, which includes the loop
+            // lengths wrapped so far: the track gets the position inside the loop and
+            // buffer_loop_offset_ the rest.
+            void SetBufferTrackPosFromClock(double clock_pos);
+
+            // Samples left before the track reaches the loop end, INT_MAX when not looping.
+            int SamplesUntilLoopEnd() const;
+
+            // Samples left before the track reaches the next display range start or end, INT_MAX
+            // after the last one. The active decoders are looked up once per chunk, so a chunk
+            // must not cross a cut.
+            int SamplesUntilClipBoundary() const;
+
+            // Moves the track back to the loop start once it reached the loop end, the decoders
+            // seek there while the buffer still holds the samples before the wrap.
+            void WrapLoopIfNeeded();
+
+            // mixed chunk handed to decoded_audio_buffer_, only used on the decode thread
+            base::ScratchBuffer chunk_buffer_;
+
+            // float planar sum of all decoders for the chunk being mixed
+            base::ScratchBuffer mix_bus_;
+
+            AudioLookAheadLimiter mix_limiter_;
+
+            // only used when decode_playback_rate_ is not 1.0
+            AudioTimeStretcher time_stretcher_;
+
+            // stretched chunk handed to mix_limiter_
+            base::ScratchBuffer stretch_bus_;
+
+            // track position of the first sample out of time_stretcher_ since its last reset, plus
+            // the loop offset of that moment, so it keeps growing across loop wraps
+            double stretch_anchor_pos_ = 0.0;
+
+            int64_t stretch_output_samples_ = 0;
 
             void DecodeWorker();
 
@@ -99,31 +261,46 @@ namespace whensunset {
 
             void ClearInvalidDecoders(const model::EditorProject &project);
 
-            int
-            FindInsertDecoderPosition(const model::EditorProject &project, int track_index);
+            // Fills active with the decoders whose display range contains track_pos, in O(log n + k)
+            void FindActiveDecoders(double track_pos, std::vector<AssetAudioDecoder *> *active);
 
             void BufferOneAudioSample(const model::EditorProject &project);
 
-            void
-            GetAudioBufferInternal(const model::EditorProject &project,
-                                   uint8_t *buff, int len);
+            // Bytes to decode in the next BufferOneAudioSample(), picked from the buffer level:
+            // big batches while refilling after a seek, kMinDecodeQuantumMs near steady state.
+            int NextDecodeQuantumBytes();
+
+            // Mixes nb_samples of all active decoders at buffer_track_pos() into mix_bus_ and
+            // advances the track position, returns the planar bus or nullptr on OOM.
+            float *MixAudioChunk(const model::EditorProject &project, int nb_samples);
+
+            // Mixes as much of the track as time_stretcher_ needs for nb_samples output samples,
+            // returns them planar in stretch_bus_ and their track position in track_pos.
+            float *StretchAudioChunk(const model::EditorProject &project, int nb_samples,
+                                     double *track_pos);
 
-            void SeekAudioDecoder(double track_pos);;
+            void ResetTimeStretcher(double track_pos);
+
+            void SeekAudioDecoder(double track_pos);
+
+            void SeekAudioDecoder(AssetAudioDecoder *audio_decoder, double track_pos);
+
+            void RequestPcmCacheIfNeeded(AssetAudioDecoder *audio_decoder);
+
+            void AttachPcmCacheIfReady(AssetAudioDecoder *audio_decoder);
 
             template<typename T>
             AssetAudioDecoder *
-            AddAudioDecoder(std::string path, T *asset, double src_file_duration, int insert_pos) {
+            AddAudioDecoder(std::string path, T *asset, double src_file_duration) {
                 AssetAudioDecoder *asset_audio_decoder = nullptr;
                 if (asset->asset_path() == "") {
                     LOGE("tag: %s, AddAudioDecoder track asset path is empty, ignore it! id: %llu",
                          "", asset->asset_id());
                     return asset_audio_decoder;
                 }
-                for (const auto &audio_decoder : audio_decoders_) {
-                    if (audio_decoder->asset_id_ == asset->asset_id()) {
-                        asset_audio_decoder = audio_decoder.get();
-                        break;
-                    }
+                auto found = decoder_by_asset_id_.find(asset->asset_id());
+                if (found != decoder_by_asset_id_.end()) {
+                    asset_audio_decoder = found->second;
                 }
 
                 if (!asset_audio_decoder) {
@@ -150,14 +327,11 @@ namespace whensunset {
                     }
 
                     asset_audio_decoder->audio_decode_ctx_->set_dst_channels(dst_channels_);
-                    asset_audio_decoder->audio_decode_ctx_->set_dst_sample_fmt(dst_sample_fmt_);
+                    asset_audio_decoder->audio_decode_ctx_->set_dst_sample_fmt(mix_sample_fmt_);
                     asset_audio_decoder->audio_decode_ctx_->set_dst_sample_rate(dst_sample_rate_);
-                    if (insert_pos >= audio_decoders_.size()) {
-                        audio_decoders_.push_back(std::move(audio_decoder));
-                    } else {
-                        audio_decoders_.insert(audio_decoders_.begin() + insert_pos,
-                                               std::move(audio_decoder));
-                    }
+                    // mixing order comes from display_index_, so just append
+                    decoder_by_asset_id_[asset->asset_id()] = asset_audio_decoder;
+                    audio_decoders_.push_back(std::move(audio_decoder));
                 }
 
                 if (asset_audio_decoder) {
@@ -182,6 +356,11 @@ namespace whensunset {
 
         };
 
+        // Mixes the audio of project down to a 16 bit WAV file at wav_path with a stopped
+        // AudioDecodeService of its own, see AudioDecodeService::MixDown().
+        int MixDownAudioToWav(const model::EditorProject &project, const std::string &wav_path,
+                              double start_sec, double duration_sec,
+                              AudioMixDownStats *stats = nullptr);
     }
 }
 #endif
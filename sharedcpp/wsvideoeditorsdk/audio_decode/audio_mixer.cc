@@ -0,0 +1,410 @@
+#include "audio_mixer.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+// WS_AUDIO_MIXER_DISABLE_SIMD builds the scalar reference, the host benchmark compares against it
+#if defined(WS_AUDIO_MIXER_DISABLE_SIMD)
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define WS_AUDIO_MIXER_NEON 1
+#elif defined(__AVX__)
+#include <immintrin.h>
+#define WS_AUDIO_MIXER_AVX 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define WS_AUDIO_MIXER_SSE2 1
+#endif
+
+namespace whensunset {
+    namespace wsvideoeditor {
+
+        const float kS16Scale = 32767.0f;
+
+        float AudioMixGainFromVolume(double volume) {
+            if (!(volume > 0.0)) {
+                return 0.0f;
+            }
+            return static_cast<float>(volume);
+        }
+
+        static inline int16_t FloatToS16(float value) {
+            float scaled = value * kS16Scale;
+            if (scaled >= SHRT_MAX) {
+                return SHRT_MAX;
+            }
+            if (scaled <= SHRT_MIN) {
+                return SHRT_MIN;
+            }
+            return static_cast<int16_t>(scaled);
+        }
+
+#if WS_AUDIO_MIXER_NEON
+
+        static int AudioMixAccumulateFloatSimd(float *dst, const float *src, int sample_count,
+                                               float gain) {
+            int i = 0;
+            for (; i + 4 <= sample_count; i += 4) {
+                vst1q_f32(dst + i, vmlaq_n_f32(vld1q_f32(dst + i), vld1q_f32(src + i), gain));
+            }
+            return i;
+        }
+
+        static int StereoGainToS16Simd(const float *left, const float *right, const float *gain,
+                                       int nb_samples, int16_t *dst) {
+            int i = 0;
+            const float32x4_t scale = vdupq_n_f32(kS16Scale);
+            for (; i + 4 <= nb_samples; i += 4) {
+                float32x4_t g = vmulq_f32(vld1q_f32(gain + i), scale);
+                int32x4_t l = vcvtq_s32_f32(vmulq_f32(vld1q_f32(left + i), g));
+                int32x4_t r = vcvtq_s32_f32(vmulq_f32(vld1q_f32(right + i), g));
+                int16x4x2_t lr;
+                lr.val[0] = vqmovn_s32(l);
+                lr.val[1] = vqmovn_s32(r);
+                vst2_s16(dst + 2 * i, lr);
+            }
+            return i;
+        }
+
+        static int AudioPeakAccumulateSimd(const float *samples, int count, float *min_value,
+                                           float *max_value, double *sum_squares) {
+            int i = 0;
+            if (count < 4) {
+                return i;
+            }
+            float32x4_t min_v = vdupq_n_f32(*min_value);
+            float32x4_t max_v = vdupq_n_f32(*max_value);
+            float32x4_t sum_v = vdupq_n_f32(0.0f);
+            for (; i + 4 <= count; i += 4) {
+                float32x4_t v = vld1q_f32(samples + i);
+                min_v = vminq_f32(min_v, v);
+                max_v = vmaxq_f32(max_v, v);
+                sum_v = vmlaq_f32(sum_v, v, v);
+            }
+            float lanes[4];
+            vst1q_f32(lanes, min_v);
+            *min_value = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+            vst1q_f32(lanes, max_v);
+            *max_value = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+            vst1q_f32(lanes, sum_v);
+            *sum_squares += (double) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+            return i;
+        }
+
+        static int AudioDotProductSimd(const float *a, const float *b, int count, float *sum) {
+            int i = 0;
+            float32x4_t sum_v = vdupq_n_f32(0.0f);
+            for (; i + 4 <= count; i += 4) {
+                sum_v = vmlaq_f32(sum_v, vld1q_f32(a + i), vld1q_f32(b + i));
+            }
+            float lanes[4];
+            vst1q_f32(lanes, sum_v);
+            *sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+            return i;
+        }
+
+        static int AudioCrossFadeFloatSimd(float *dst, const float *fade_out, const float *fade_in,
+                                           const float *fade_in_gain, int count) {
+            int i = 0;
+            for (; i + 4 <= count; i += 4) {
+                float32x4_t out = vld1q_f32(fade_out + i);
+                float32x4_t diff = vsubq_f32(vld1q_f32(fade_in + i), out);
+                vst1q_f32(dst + i, vmlaq_f32(out, diff, vld1q_f32(fade_in_gain + i)));
+            }
+            return i;
+        }
+
+#elif WS_AUDIO_MIXER_AVX
+
+        static int AudioMixAccumulateFloatSimd(float *dst, const float *src, int sample_count,
+                                               float gain) {
+            int i = 0;
+            const __m256 g = _mm256_set1_ps(gain);
+            for (; i + 8 <= sample_count; i += 8) {
+                __m256 d = _mm256_loadu_ps(dst + i);
+                __m256 s = _mm256_loadu_ps(src + i);
+                _mm256_storeu_ps(dst + i, _mm256_add_ps(d, _mm256_mul_ps(s, g)));
+            }
+            return i;
+        }
+
+        static int StereoGainToS16Simd(const float *left, const float *right, const float *gain,
+                                       int nb_samples, int16_t *dst) {
+            int i = 0;
+            const __m128 scale = _mm_set1_ps(kS16Scale);
+            for (; i + 4 <= nb_samples; i += 4) {
+                __m128 g = _mm_mul_ps(_mm_loadu_ps(gain + i), scale);
+                __m128i l = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(left + i), g));
+                __m128i r = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(right + i), g));
+                // l0 l1 l2 l3 r0 r1 r2 r3 -> l0 r0 l1 r1 ...
+                __m128i packed = _mm_packs_epi32(l, r);
+                __m128i lr = _mm_unpacklo_epi16(packed, _mm_srli_si128(packed, 8));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2 * i), lr);
+            }
+            return i;
+        }
+
+        static int AudioPeakAccumulateSimd(const float *samples, int count, float *min_value,
+                                           float *max_value, double *sum_squares) {
+            int i = 0;
+            if (count < 4) {
+                return i;
+            }
+            __m128 min_v = _mm_set1_ps(*min_value);
+            __m128 max_v = _mm_set1_ps(*max_value);
+            __m128 sum_v = _mm_setzero_ps();
+            for (; i + 4 <= count; i += 4) {
+                __m128 v = _mm_loadu_ps(samples + i);
+                min_v = _mm_min_ps(min_v, v);
+                max_v = _mm_max_ps(max_v, v);
+                sum_v = _mm_add_ps(sum_v, _mm_mul_ps(v, v));
+            }
+            float lanes[4];
+            _mm_storeu_ps(lanes, min_v);
+            *min_value = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+            _mm_storeu_ps(lanes, max_v);
+            *max_value = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+            _mm_storeu_ps(lanes, sum_v);
+            *sum_squares += (double) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+            return i;
+        }
+
+        static int AudioDotProductSimd(const float *a, const float *b, int count, float *sum) {
+            int i = 0;
+            __m256 sum_v = _mm256_setzero_ps();
+            for (; i + 8 <= count; i += 8) {
+                sum_v = _mm256_add_ps(sum_v, _mm256_mul_ps(_mm256_loadu_ps(a + i),
+                                                           _mm256_loadu_ps(b + i)));
+            }
+            float lanes[8];
+            _mm256_storeu_ps(lanes, sum_v);
+            *sum = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) +
+                   ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+            return i;
+        }
+
+        static int AudioCrossFadeFloatSimd(float *dst, const float *fade_out, const float *fade_in,
+                                           const float *fade_in_gain, int count) {
+            int i = 0;
+            for (; i + 8 <= count; i += 8) {
+                __m256 out = _mm256_loadu_ps(fade_out + i);
+                __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(fade_in + i), out);
+                _mm256_storeu_ps(dst + i, _mm256_add_ps(
+                        out, _mm256_mul_ps(diff, _mm256_loadu_ps(fade_in_gain + i))));
+            }
+            return i;
+        }
+
+#elif WS_AUDIO_MIXER_SSE2
+
+        static int AudioMixAccumulateFloatSimd(float *dst, const float *src, int sample_count,
+                                               float gain) {
+            int i = 0;
+            const __m128 g = _mm_set1_ps(gain);
+            for (; i + 4 <= sample_count; i += 4) {
+                __m128 d = _mm_loadu_ps(dst + i);
+                __m128 s = _mm_loadu_ps(src + i);
+                _mm_storeu_ps(dst + i, _mm_add_ps(d, _mm_mul_ps(s, g)));
+            }
+            return i;
+        }
+
+        static int StereoGainToS16Simd(const float *left, const float *right, const float *gain,
+                                       int nb_samples, int16_t *dst) {
+            int i = 0;
+            const __m128 scale = _mm_set1_ps(kS16Scale);
+            for (; i + 4 <= nb_samples; i += 4) {
+                __m128 g = _mm_mul_ps(_mm_loadu_ps(gain + i), scale);
+                __m128i l = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(left + i), g));
+                __m128i r = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(right + i), g));
+                // l0 l1 l2 l3 r0 r1 r2 r3 -> l0 r0 l1 r1 ...
+                __m128i packed = _mm_packs_epi32(l, r);
+                __m128i lr = _mm_unpacklo_epi16(packed, _mm_srli_si128(packed, 8));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2 * i), lr);
+            }
+            return i;
+        }
+
+        static int AudioPeakAccumulateSimd(const float *samples, int count, float *min_value,
+                                           float *max_value, double *sum_squares) {
+            int i = 0;
+            if (count < 4) {
+                return i;
+            }
+            __m128 min_v = _mm_set1_ps(*min_value);
+            __m128 max_v = _mm_set1_ps(*max_value);
+            __m128 sum_v = _mm_setzero_ps();
+            for (; i + 4 <= count; i += 4) {
+                __m128 v = _mm_loadu_ps(samples + i);
+                min_v = _mm_min_ps(min_v, v);
+                max_v = _mm_max_ps(max_v, v);
+                sum_v = _mm_add_ps(sum_v, _mm_mul_ps(v, v));
+            }
+            float lanes[4];
+            _mm_storeu_ps(lanes, min_v);
+            *min_value = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+            _mm_storeu_ps(lanes, max_v);
+            *max_value = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+            _mm_storeu_ps(lanes, sum_v);
+            *sum_squares += (double) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+            return i;
+        }
+
+        static int AudioDotProductSimd(const float *a, const float *b, int count, float *sum) {
+            int i = 0;
+            __m128 sum_v = _mm_setzero_ps();
+            for (; i + 4 <= count; i += 4) {
+                sum_v = _mm_add_ps(sum_v, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+            }
+            float lanes[4];
+            _mm_storeu_ps(lanes, sum_v);
+            *sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+            return i;
+        }
+
+        static int AudioCrossFadeFloatSimd(float *dst, const float *fade_out, const float *fade_in,
+                                           const float *fade_in_gain, int count) {
+            int i = 0;
+            for (; i + 4 <= count; i += 4) {
+                __m128 out = _mm_loadu_ps(fade_out + i);
+                __m128 diff = _mm_sub_ps(_mm_loadu_ps(fade_in + i), out);
+                _mm_storeu_ps(dst + i, _mm_add_ps(
+                        out, _mm_mul_ps(diff, _mm_loadu_ps(fade_in_gain + i))));
+            }
+            return i;
+        }
+
+#else
+
+        static int AudioMixAccumulateFloatSimd(float *, const float *, int, float) {
+            return 0;
+        }
+
+        static int StereoGainToS16Simd(const float *, const float *, const float *, int,
+                                       int16_t *) {
+            return 0;
+        }
+
+        static int AudioPeakAccumulateSimd(const float *, int, float *, float *, double *) {
+            return 0;
+        }
+
+        static int AudioDotProductSimd(const float *, const float *, int, float *sum) {
+            *sum = 0.0f;
+            return 0;
+        }
+
+        static int AudioCrossFadeFloatSimd(float *, const float *, const float *, const float *,
+                                           int) {
+            return 0;
+        }
+
+#endif
+
+        void AudioMixAccumulateFloat(float *dst, const float *src, int sample_count, float gain) {
+            if (gain <= 0.0f || sample_count <= 0) {
+                return;
+            }
+            int i = AudioMixAccumulateFloatSimd(dst, src, sample_count, gain);
+            for (; i < sample_count; ++i) {
+                dst[i] += src[i] * gain;
+            }
+        }
+
+        void AudioPeakAccumulate(const float *samples, int count, float *min_value,
+                                 float *max_value, double *sum_squares) {
+            int i = AudioPeakAccumulateSimd(samples, count, min_value, max_value, sum_squares);
+            for (; i < count; ++i) {
+                *min_value = std::min(*min_value, samples[i]);
+                *max_value = std::max(*max_value, samples[i]);
+                *sum_squares += samples[i] * samples[i];
+            }
+        }
+
+        float AudioDotProduct(const float *a, const float *b, int count) {
+            float sum = 0.0f;
+            int i = AudioDotProductSimd(a, b, count, &sum);
+            for (; i < count; ++i) {
+                sum += a[i] * b[i];
+            }
+            return sum;
+        }
+
+        void AudioCrossFadeFloat(float *dst, const float *fade_out, const float *fade_in,
+                                 const float *fade_in_gain, int count) {
+            int i = AudioCrossFadeFloatSimd(dst, fade_out, fade_in, fade_in_gain, count);
+            for (; i < count; ++i) {
+                dst[i] = fade_out[i] + (fade_in[i] - fade_out[i]) * fade_in_gain[i];
+            }
+        }
+
+        AudioLookAheadLimiter::AudioLookAheadLimiter(int channels, int sample_rate,
+                                                     float threshold, double look_ahead_ms,
+                                                     double release_ms)
+                : channels_(channels), sample_rate_(sample_rate), threshold_(threshold) {
+            look_ahead_ = std::max(1, static_cast<int>(sample_rate * look_ahead_ms / 1000.0));
+            // full gain reduction is reachable within the look-ahead window
+            attack_step_ = 1.0f / look_ahead_;
+            release_coef_ = static_cast<float>(
+                    1.0 - std::exp(-1.0 / (sample_rate * release_ms / 1000.0)));
+            work_.resize(channels_);
+            Reset();
+        }
+
+        void AudioLookAheadLimiter::Reset() {
+            gain_ = 1.0f;
+            for (auto &channel : work_) {
+                channel.assign(look_ahead_, 0.0f);
+            }
+        }
+
+        void AudioLookAheadLimiter::ProcessToS16(const float *const *planes, int nb_samples,
+                                                 int16_t *dst) {
+            if (nb_samples <= 0) {
+                return;
+            }
+            int total = look_ahead_ + nb_samples;
+            for (int c = 0; c < channels_; ++c) {
+                work_[c].resize(total);
+                memcpy(work_[c].data() + look_ahead_, planes[c], nb_samples * sizeof(float));
+            }
+
+            // gain each sample needs on its own
+            gain_envelope_.resize(total);
+            float *envelope = gain_envelope_.data();
+            for (int i = 0; i < total; ++i) {
+                float peak = 0.0f;
+                for (int c = 0; c < channels_; ++c) {
+                    peak = std::max(peak, std::fabs(work_[c][i]));
+                }
+                envelope[i] = peak > threshold_ ? threshold_ / peak : 1.0f;
+            }
+            // ramp down ahead of every peak, at most look_ahead_ samples early
+            for (int i = total - 2; i >= 0; --i) {
+                envelope[i] = std::min(envelope[i], envelope[i + 1] + attack_step_);
+            }
+            // release towards unity gain, never above what the look-ahead asked for
+            for (int i = 0; i < nb_samples; ++i) {
+                gain_ = std::min(envelope[i], gain_ + (1.0f - gain_) * release_coef_);
+                envelope[i] = gain_;
+            }
+
+            int i = 0;
+            if (channels_ == 2) {
+                i = StereoGainToS16Simd(work_[0].data(), work_[1].data(), envelope, nb_samples,
+                                        dst);
+            }
+            for (; i < nb_samples; ++i) {
+                for (int c = 0; c < channels_; ++c) {
+                    dst[i * channels_ + c] = FloatToS16(work_[c][i] * envelope[i]);
+                }
+            }
+
+            // keep the tail as the delay line of the next block
+            for (int c = 0; c < channels_; ++c) {
+                memmove(work_[c].data(), work_[c].data() + nb_samples, look_ahead_ * sizeof(float));
+            }
+        }
+    }
+}
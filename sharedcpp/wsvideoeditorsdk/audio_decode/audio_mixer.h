@@ -0,0 +1,71 @@
+#ifndef SHAREDCPP_WS_VIDEO_EDITOR_AUDIO_MIXER_H
+#define SHAREDCPP_WS_VIDEO_EDITOR_AUDIO_MIXER_H
+
+#include <cstdint>
+#include <vector>
+
+namespace whensunset {
+    namespace wsvideoeditor {
+
+        // Converts an asset volume to a mix bus gain, negative volumes are muted.
+        float AudioMixGainFromVolume(double volume);
+
+        // dst[i] += src[i] * gain on the float mix bus, no clamping. Uses NEON/AVX/SSE when the
+        // target has them.
+        void AudioMixAccumulateFloat(float *dst, const float *src, int sample_count, float gain);
+
+        // Folds count samples into the running *min_value, *max_value and *sum_squares, used
+        // for waveform peaks. Uses NEON/AVX/SSE when the target has them.
+        void AudioPeakAccumulate(const float *samples, int count, float *min_value,
+                                 float *max_value, double *sum_squares);
+
+        // Sum of a[i] * b[i], used to find the best splice point when time-stretching. Uses
+        // NEON/AVX/SSE when the target has them.
+        float AudioDotProduct(const float *a, const float *b, int count);
+
+        // dst[i] = fade_out[i] + (fade_in[i] - fade_out[i]) * fade_in_gain[i], the overlap-add of
+        // two segments. dst may alias fade_out. Uses NEON/AVX/SSE when the target has them.
+        void AudioCrossFadeFloat(float *dst, const float *fade_out, const float *fade_in,
+                                 const float *fade_in_gain, int count);
+
+        // Look-ahead peak limiter between the float planar mix bus and the S16 interleaved output.
+        // Gain reduction ramps down over the look-ahead window before a peak and recovers
+        // exponentially afterwards, so the output never exceeds threshold without hard clipping.
+        // The output is delayed by latency_samples().
+        class AudioLookAheadLimiter {
+        public:
+            AudioLookAheadLimiter(int channels, int sample_rate, float threshold = 0.98f,
+                                  double look_ahead_ms = 2.0, double release_ms = 80.0);
+
+            // Forgets the delayed samples and the gain state, call it on seek.
+            void Reset();
+
+            // Consumes nb_samples from each plane and writes nb_samples delayed, limited and
+            // interleaved S16 samples to dst.
+            void ProcessToS16(const float *const *planes, int nb_samples, int16_t *dst);
+
+            int latency_samples() const {
+                return look_ahead_;
+            }
+
+            double latency_sec() const {
+                return look_ahead_ / static_cast<double>(sample_rate_);
+            }
+
+        private:
+            int channels_;
+            int sample_rate_;
+            float threshold_;
+            int look_ahead_;
+            float attack_step_;
+            float release_coef_;
+
+            float gain_ = 1.0f;
+
+            // per channel: look_ahead_ delayed samples followed by the block being processed
+            std::vector<std::vector<float>> work_;
+            std::vector<float> gain_envelope_;
+        };
+    }
+}
+#endif
@@ -0,0 +1,260 @@
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "audio_pcm_cache.h"
+#include "audio_decode_context.h"
+#include "platform_logger.h"
+#include "scratch_buffer.h"
+#include "ws_editor_video_sdk_utils.h"
+
+namespace whensunset {
+    namespace wsvideoeditor {
+
+        // samples decoded per AudioDecodeContext::GetAudio() call while filling an entry
+        const int kPcmCacheFillChunkSamples = 4096;
+
+        AudioPcmCacheEntry::~AudioPcmCacheEntry() {
+            if (!data) {
+                return;
+            }
+            if (is_mapped) {
+                munmap(data, static_cast<size_t>(size));
+            } else {
+                delete[] data;
+            }
+        }
+
+        AudioPcmCache::AudioPcmCache(const std::string &temp_dir, int64_t ram_budget_bytes,
+                                     int64_t mapped_budget_bytes)
+                : temp_dir_(temp_dir), ram_budget_bytes_(ram_budget_bytes),
+                  mapped_budget_bytes_(temp_dir.empty() ? 0 : mapped_budget_bytes) {
+            if (!temp_dir_.empty() && temp_dir_.back() != '/') {
+                temp_dir_ += "/";
+            }
+            fill_thread_ = std::thread(&AudioPcmCache::FillThreadMain, this);
+            LOGI("AudioPcmCache temp_dir:%s, ram_budget_bytes:%lld, mapped_budget_bytes:%lld",
+                 temp_dir_.c_str(), (long long) ram_budget_bytes_, (long long) mapped_budget_bytes_);
+        }
+
+        AudioPcmCache::~AudioPcmCache() {
+            Stop();
+            LOGI("~AudioPcmCache");
+        }
+
+        void AudioPcmCache::Stop() {
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                released_ = true;
+                pending_requests_.clear();
+            }
+            cv_.notify_all();
+            if (fill_thread_.joinable()) {
+                fill_thread_.join();
+            }
+        }
+
+        void AudioPcmCache::Request(const std::string &path, int channels, int sample_rate,
+                                    AVSampleFormat sample_fmt) {
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                if (released_ || path.empty() || requested_paths_.count(path)) {
+                    return;
+                }
+                requested_paths_.insert(path);
+                pending_requests_.push_back({path, channels, sample_rate, sample_fmt});
+                LOGI("AudioPcmCache::Request path:%s", path.c_str());
+            }
+            cv_.notify_all();
+        }
+
+        std::shared_ptr<const AudioPcmCacheEntry>
+        AudioPcmCache::Lookup(const std::string &path, int channels, int sample_rate,
+                              AVSampleFormat sample_fmt) {
+            std::lock_guard<std::mutex> lk(mutex_);
+            auto iter = entries_.find(path);
+            if (iter == entries_.end()) {
+                return nullptr;
+            }
+            std::shared_ptr<const AudioPcmCacheEntry> entry = *iter->second;
+            if (entry->channels != channels || entry->sample_rate != sample_rate
+                || entry->sample_fmt != sample_fmt) {
+                return nullptr;
+            }
+            lru_entries_.splice(lru_entries_.begin(), lru_entries_, iter->second);
+            return entry;
+        }
+
+        void AudioPcmCache::FillThreadMain() {
+            SetCurrentThreadName("EditorPcmCacheFill");
+            while (true) {
+                PendingRequest request;
+                {
+                    std::unique_lock<std::mutex> lk(mutex_);
+                    cv_.wait(lk, [this] {
+                        return released_ || !pending_requests_.empty();
+                    });
+                    if (released_) {
+                        break;
+                    }
+                    request = pending_requests_.front();
+                    pending_requests_.pop_front();
+                }
+
+                std::shared_ptr<AudioPcmCacheEntry> entry = Decode(request);
+                if (!entry) {
+                    continue;
+                }
+
+                std::lock_guard<std::mutex> lk(mutex_);
+                lru_entries_.push_front(entry);
+                entries_[request.path] = lru_entries_.begin();
+                LOGI("AudioPcmCache::FillThreadMain entry ready path:%s, bytes:%lld, mapped:%d",
+                     request.path.c_str(), (long long) entry->size, entry->is_mapped);
+            }
+            LOGI("AudioPcmCache::FillThreadMain end");
+        }
+
+        std::shared_ptr<AudioPcmCacheEntry>
+        AudioPcmCache::Decode(const PendingRequest &request) {
+            AudioDecodeContext decode_ctx("PcmCache");
+            int ret = decode_ctx.OpenFile(request.path);
+            if (ret < 0 || decode_ctx.duration_sec() <= 0.0) {
+                LOGE("AudioPcmCache::Decode open failed path:%s, ret:%d", request.path.c_str(), ret);
+                return nullptr;
+            }
+            decode_ctx.set_dst_channels(request.channels);
+            decode_ctx.set_dst_sample_rate(request.sample_rate);
+            decode_ctx.set_dst_sample_fmt(request.sample_fmt);
+
+            std::shared_ptr<AudioPcmCacheEntry> entry(new(std::nothrow) AudioPcmCacheEntry());
+            if (!entry) {
+                LOGE("AudioPcmCache::Decode OOM");
+                return nullptr;
+            }
+            entry->path = request.path;
+            entry->sample_fmt = request.sample_fmt;
+            entry->channels = request.channels;
+            entry->sample_rate = request.sample_rate;
+            entry->is_planar = av_sample_fmt_is_planar(request.sample_fmt) != 0;
+            entry->nb_samples = static_cast<int64_t>(
+                    ceil(decode_ctx.duration_sec() * request.sample_rate));
+            int bytes_per_sample = av_get_bytes_per_sample(request.sample_fmt);
+            int64_t size = entry->nb_samples * request.channels * bytes_per_sample;
+            entry->plane_size = entry->is_planar ? size / request.channels : size;
+            if (!Allocate(entry.get(), size)) {
+                LOGW("AudioPcmCache::Decode no budget left for path:%s, bytes:%lld",
+                     request.path.c_str(), (long long) size);
+                return nullptr;
+            }
+
+            base::ScratchBuffer chunk_buffer;
+            bool filled = true;
+            int chunk_sample_bytes = bytes_per_sample * (entry->is_planar ? 1 : request.channels);
+            for (int64_t pos = 0; pos < entry->nb_samples && !released_;
+                 pos += kPcmCacheFillChunkSamples) {
+                int nb = static_cast<int>(std::min<int64_t>(kPcmCacheFillChunkSamples,
+                                                            entry->nb_samples - pos));
+                int chunk_len = nb * request.channels * bytes_per_sample;
+                uint8_t *chunk = chunk_buffer.Reserve(chunk_len);
+                if (!chunk) {
+                    filled = false;
+                    break;
+                }
+                memset(chunk, 0, static_cast<size_t>(chunk_len));
+                // samples GetAudio refuses (before stream start) stay silent like when decoding live
+                decode_ctx.GetAudio(pos, chunk, chunk_len);
+                int planes = entry->is_planar ? request.channels : 1;
+                int chunk_plane_size = chunk_len / planes;
+                for (int i = 0; i < planes; ++i) {
+                    memcpy(entry->data + i * entry->plane_size + pos * chunk_sample_bytes,
+                           chunk + i * chunk_plane_size, static_cast<size_t>(chunk_plane_size));
+                }
+            }
+            if (!filled || released_) {
+                // give the budget back, the entry frees its data
+                std::lock_guard<std::mutex> lk(mutex_);
+                (entry->is_mapped ? mapped_used_bytes_ : ram_used_bytes_) -= entry->size;
+                return nullptr;
+            }
+            return entry;
+        }
+
+        bool AudioPcmCache::Allocate(AudioPcmCacheEntry *entry, int64_t size) {
+            bool is_mapped = false;
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                if (MakeRoomLocked(false, size)) {
+                    ram_used_bytes_ += size;
+                } else if (MakeRoomLocked(true, size)) {
+                    mapped_used_bytes_ += size;
+                    is_mapped = true;
+                } else {
+                    return false;
+                }
+            }
+
+            if (!is_mapped) {
+                entry->data = new(std::nothrow) uint8_t[size];
+                if (!entry->data) {
+                    LOGE("AudioPcmCache::Allocate OOM bytes:%lld", (long long) size);
+                    std::lock_guard<std::mutex> lk(mutex_);
+                    ram_used_bytes_ -= size;
+                    return false;
+                }
+                entry->size = size;
+                return true;
+            }
+
+            std::string file_template = temp_dir_ + "pcm_cache_XXXXXX";
+            std::vector<char> file_path(file_template.begin(), file_template.end());
+            file_path.push_back('\0');
+            int fd = mkstemp(file_path.data());
+            void *mapped = MAP_FAILED;
+            if (fd >= 0) {
+                // the mapping keeps the file alive, nothing is left behind after a crash
+                unlink(file_path.data());
+                if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+                    mapped = mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE,
+                                  MAP_SHARED, fd, 0);
+                }
+                close(fd);
+            }
+            if (mapped == MAP_FAILED) {
+                LOGE("AudioPcmCache::Allocate mmap failed path:%s, bytes:%lld",
+                     file_path.data(), (long long) size);
+                std::lock_guard<std::mutex> lk(mutex_);
+                mapped_used_bytes_ -= size;
+                return false;
+            }
+            entry->data = static_cast<uint8_t *>(mapped);
+            entry->size = size;
+            entry->is_mapped = true;
+            return true;
+        }
+
+        bool AudioPcmCache::MakeRoomLocked(bool is_mapped, int64_t size) {
+            int64_t &used_bytes = is_mapped ? mapped_used_bytes_ : ram_used_bytes_;
+            int64_t budget_bytes = is_mapped ? mapped_budget_bytes_ : ram_budget_bytes_;
+            if (size > budget_bytes) {
+                return false;
+            }
+            auto iter = lru_entries_.end();
+            while (used_bytes + size > budget_bytes && iter != lru_entries_.begin()) {
+                --iter;
+                if ((*iter)->is_mapped != is_mapped) {
+                    continue;
+                }
+                LOGI("AudioPcmCache evict path:%s", (*iter)->path.c_str());
+                used_bytes -= (*iter)->size;
+                entries_.erase((*iter)->path);
+                // evicted assets may be requested again
+                requested_paths_.erase((*iter)->path);
+                iter = lru_entries_.erase(iter);
+            }
+            return used_bytes + size <= budget_bytes;
+        }
+    }
+}
@@ -0,0 +1,122 @@
+#ifndef SHAREDCPP_WS_VIDEO_EDITOR_AUDIO_PCM_CACHE_H
+#define SHAREDCPP_WS_VIDEO_EDITOR_AUDIO_PCM_CACHE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+extern "C" {
+#include <libavutil/samplefmt.h>
+};
+
+namespace whensunset {
+    namespace wsvideoeditor {
+
+        const int64_t kDefaultPcmCacheRamBudget = 48 * 1024 * 1024;
+
+        const int64_t kDefaultPcmCacheMappedBudget = 256 * 1024 * 1024;
+
+        // Fully decoded and resampled audio of one asset, immutable once published.
+        // Samples start at position 0 of the file in the output sample rate, the same position
+        // AudioDecodeContext::GetAudio() takes.
+        struct AudioPcmCacheEntry {
+            ~AudioPcmCacheEntry();
+
+            const uint8_t *plane(int channel) const {
+                return data + (is_planar ? channel * plane_size : 0);
+            }
+
+            std::string path;
+            AVSampleFormat sample_fmt = AV_SAMPLE_FMT_NONE;
+            int channels = 0;
+            int sample_rate = 0;
+            bool is_planar = false;
+            int64_t nb_samples = 0;
+
+            // planar formats keep the planes back to back, plane_size bytes each
+            uint8_t *data = nullptr;
+            int64_t size = 0;
+            int64_t plane_size = 0;
+
+            // data is an mmap'd, already unlinked temp file instead of heap memory
+            bool is_mapped = false;
+        };
+
+        // Decodes requested audio assets on a background thread and keeps the PCM in RAM, or in
+        // mmap'd temp files under temp_dir once the RAM budget is used up. Both budgets evict
+        // least recently used entries; an evicted entry stays alive while a decoder still holds it.
+        class AudioPcmCache {
+        public:
+            AudioPcmCache(const std::string &temp_dir,
+                          int64_t ram_budget_bytes = kDefaultPcmCacheRamBudget,
+                          int64_t mapped_budget_bytes = kDefaultPcmCacheMappedBudget);
+
+            virtual ~AudioPcmCache();
+
+            // Queues path for decoding, does nothing if it was requested before.
+            void Request(const std::string &path, int channels, int sample_rate,
+                         AVSampleFormat sample_fmt);
+
+            // Returns the entry of path when it is ready and matches the format, else nullptr.
+            std::shared_ptr<const AudioPcmCacheEntry>
+            Lookup(const std::string &path, int channels, int sample_rate,
+                   AVSampleFormat sample_fmt);
+
+            void Stop();
+
+        private:
+            struct PendingRequest {
+                std::string path;
+                int channels;
+                int sample_rate;
+                AVSampleFormat sample_fmt;
+            };
+
+            void FillThreadMain();
+
+            std::shared_ptr<AudioPcmCacheEntry> Decode(const PendingRequest &request);
+
+            // Allocates size bytes from the RAM budget, or from the mapped budget when RAM is full.
+            bool Allocate(AudioPcmCacheEntry *entry, int64_t size);
+
+            // Drops least recently used entries of the given kind until size bytes fit.
+            bool MakeRoomLocked(bool is_mapped, int64_t size);
+
+            std::string temp_dir_;
+
+            int64_t ram_budget_bytes_;
+
+            int64_t mapped_budget_bytes_;
+
+            int64_t ram_used_bytes_ = 0;
+
+            int64_t mapped_used_bytes_ = 0;
+
+            std::mutex mutex_;
+
+            std::condition_variable cv_;
+
+            std::atomic<bool> released_{false};
+
+            std::deque<PendingRequest> pending_requests_;
+
+            std::unordered_set<std::string> requested_paths_;
+
+            // most recently used first
+            std::list<std::shared_ptr<const AudioPcmCacheEntry>> lru_entries_;
+
+            std::unordered_map<std::string,
+                    std::list<std::shared_ptr<const AudioPcmCacheEntry>>::iterator> entries_;
+
+            std::thread fill_thread_;
+        };
+    }
+}
+#endif
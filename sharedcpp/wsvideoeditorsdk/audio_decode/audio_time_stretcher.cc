@@ -0,0 +1,164 @@
+#include "audio_time_stretcher.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "audio_mixer.h"
+
+namespace whensunset {
+    namespace wsvideoeditor {
+
+        // length of the cross fade between two sequences
+        const double kStretchOverlapMs = 8.0;
+
+        // slow rates use long sequences and a wide search window to avoid a stuttering
+        // (phasey) sound, fast rates use short ones so fewer samples are dropped per splice
+        const double kStretchSlowSequenceMs = 125.0;
+        const double kStretchFastSequenceMs = 50.0;
+        const double kStretchSlowSeekMs = 25.0;
+        const double kStretchFastSeekMs = 15.0;
+        const double kStretchSlowRate = 0.5;
+        const double kStretchFastRate = 2.0;
+
+        double ClampPlaybackRate(double rate) {
+            if (!(rate > 0.0)) {
+                return 1.0;
+            }
+            return std::max(kMinPlaybackRate, std::min(kMaxPlaybackRate, rate));
+        }
+
+        // linear from slow_value at kStretchSlowRate to fast_value at kStretchFastRate
+        static double InterpolateForRate(double rate, double slow_value, double fast_value) {
+            double t = (rate - kStretchSlowRate) / (kStretchFastRate - kStretchSlowRate);
+            t = std::max(0.0, std::min(1.0, t));
+            return slow_value + (fast_value - slow_value) * t;
+        }
+
+        AudioTimeStretcher::AudioTimeStretcher(int channels, int sample_rate)
+                : channels_(channels), sample_rate_(sample_rate), input_(channels),
+                  output_(channels), mid_buffer_(channels) {
+            Reset(1.0);
+        }
+
+        void AudioTimeStretcher::Reset(double rate) {
+            rate_ = ClampPlaybackRate(rate);
+            double sequence_ms = InterpolateForRate(rate_, kStretchSlowSequenceMs,
+                                                    kStretchFastSequenceMs);
+            double seek_ms = InterpolateForRate(rate_, kStretchSlowSeekMs, kStretchFastSeekMs);
+            // multiple of 8 keeps the SIMD kernels off their scalar tails
+            overlap_length_ = std::max(8, static_cast<int>(sample_rate_ * kStretchOverlapMs / 1000.0)
+                                          / 8 * 8);
+            sequence_length_ = std::max(2 * overlap_length_,
+                                        static_cast<int>(sample_rate_ * sequence_ms / 1000.0));
+            seek_length_ = std::max(1, static_cast<int>(sample_rate_ * seek_ms / 1000.0));
+            nominal_skip_ = rate_ * (sequence_length_ - overlap_length_);
+            skip_fraction_ = 0.0;
+
+            for (int c = 0; c < channels_; ++c) {
+                input_[c].clear();
+                output_[c].clear();
+                mid_buffer_[c].clear();
+            }
+            mono_input_.clear();
+            mono_mid_buffer_.clear();
+            has_mid_buffer_ = false;
+
+            // raised cosine, fade in and fade out gains add up to one
+            fade_in_gain_.resize(overlap_length_);
+            for (int i = 0; i < overlap_length_; ++i) {
+                fade_in_gain_[i] = static_cast<float>(
+                        0.5 - 0.5 * std::cos(M_PI * (i + 0.5) / overlap_length_));
+            }
+        }
+
+        void AudioTimeStretcher::PutSamples(const float *const *planes, int nb_samples) {
+            if (nb_samples <= 0) {
+                return;
+            }
+            size_t begin = mono_input_.size();
+            mono_input_.resize(begin + nb_samples, 0.0f);
+            float *mono = mono_input_.data() + begin;
+            float channel_gain = 1.0f / channels_;
+            for (int c = 0; c < channels_; ++c) {
+                input_[c].insert(input_[c].end(), planes[c], planes[c] + nb_samples);
+                AudioMixAccumulateFloat(mono, planes[c], nb_samples, channel_gain);
+            }
+            ProcessSequences();
+        }
+
+        int AudioTimeStretcher::ReceiveSamples(float *const *planes, int nb_samples) {
+            int count = std::min(nb_samples, available_samples());
+            if (count <= 0) {
+                return 0;
+            }
+            for (int c = 0; c < channels_; ++c) {
+                memcpy(planes[c], output_[c].data(), count * sizeof(float));
+                output_[c].erase(output_[c].begin(), output_[c].begin() + count);
+            }
+            return count;
+        }
+
+        void AudioTimeStretcher::ProcessSequences() {
+            int copy_length = sequence_length_ - 2 * overlap_length_;
+            int need = std::max(seek_length_ + sequence_length_,
+                                static_cast<int>(std::ceil(nominal_skip_ + skip_fraction_)));
+            while (static_cast<int>(mono_input_.size()) >= need) {
+                int offset = has_mid_buffer_ ? SeekBestOverlapOffset() : 0;
+                for (int c = 0; c < channels_; ++c) {
+                    const float *in = input_[c].data() + offset;
+                    size_t out_begin = output_[c].size();
+                    output_[c].resize(out_begin + sequence_length_ - overlap_length_);
+                    float *out = output_[c].data() + out_begin;
+                    if (has_mid_buffer_) {
+                        AudioCrossFadeFloat(out, mid_buffer_[c].data(), in, fade_in_gain_.data(),
+                                            overlap_length_);
+                    } else {
+                        memcpy(out, in, overlap_length_ * sizeof(float));
+                    }
+                    memcpy(out + overlap_length_, in + overlap_length_, copy_length * sizeof(float));
+                    mid_buffer_[c].assign(in + sequence_length_ - overlap_length_,
+                                          in + sequence_length_);
+                }
+                const float *mono = mono_input_.data() + offset;
+                mono_mid_buffer_.assign(mono + sequence_length_ - overlap_length_,
+                                        mono + sequence_length_);
+                has_mid_buffer_ = true;
+
+                skip_fraction_ += nominal_skip_;
+                int skip = static_cast<int>(skip_fraction_);
+                skip_fraction_ -= skip;
+                for (int c = 0; c < channels_; ++c) {
+                    input_[c].erase(input_[c].begin(), input_[c].begin() + skip);
+                }
+                mono_input_.erase(mono_input_.begin(), mono_input_.begin() + skip);
+                need = std::max(seek_length_ + sequence_length_,
+                                static_cast<int>(std::ceil(nominal_skip_ + skip_fraction_)));
+            }
+        }
+
+        int AudioTimeStretcher::SeekBestOverlapOffset() {
+            const float *reference = mono_mid_buffer_.data();
+            const float *input = mono_input_.data();
+            // energy of the candidate window, slid along instead of recomputed
+            double energy = 0.0;
+            for (int i = 0; i < overlap_length_; ++i) {
+                energy += input[i] * input[i];
+            }
+            int best_offset = 0;
+            double best_score = -1e30;
+            for (int offset = 0; offset < seek_length_; ++offset) {
+                if (offset > 0) {
+                    float removed = input[offset - 1];
+                    float added = input[offset + overlap_length_ - 1];
+                    energy = std::max(0.0, energy - removed * removed + added * added);
+                }
+                double correlation = AudioDotProduct(reference, input + offset, overlap_length_);
+                double score = correlation / std::sqrt(energy + 1e-9);
+                if (score > best_score) {
+                    best_score = score;
+                    best_offset = offset;
+                }
+            }
+            return best_offset;
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef SHAREDCPP_WS_VIDEO_EDITOR_AUDIO_TIME_STRETCHER_H
+#define SHAREDCPP_WS_VIDEO_EDITOR_AUDIO_TIME_STRETCHER_H
+
+#include <vector>
+
+namespace whensunset {
+    namespace wsvideoeditor {
+
+        const double kMinPlaybackRate = 0.25;
+
+        const double kMaxPlaybackRate = 4.0;
+
+        // Clamps rate into [kMinPlaybackRate, kMaxPlaybackRate], anything invalid plays at 1.0.
+        double ClampPlaybackRate(double rate);
+
+        // Pitch preserving tempo change on the float planar mix bus (WSOLA).
+        //
+        // The input is cut into sequences that are overlap-added back together. Every next
+        // sequence starts rate * (sequence - overlap) input samples after the previous one, moved
+        // inside a small seek window to where it correlates best with the tail of the previous
+        // one, so the splices stay in phase. Output sample n corresponds to input sample
+        // n * rate on average, off by at most the seek window.
+        class AudioTimeStretcher {
+        public:
+            AudioTimeStretcher(int channels, int sample_rate);
+
+            // Drops all buffered samples and starts over at rate.
+            void Reset(double rate);
+
+            // Appends nb_samples from each plane.
+            void PutSamples(const float *const *planes, int nb_samples);
+
+            // Moves up to nb_samples stretched samples to planes, returns how many were moved.
+            int ReceiveSamples(float *const *planes, int nb_samples);
+
+            int available_samples() const {
+                return static_cast<int>(output_[0].size());
+            }
+
+            double rate() const {
+                return rate_;
+            }
+
+        private:
+            void ProcessSequences();
+
+            // Offset in [0, seek_length_) of the input that continues mid_buffer_ best.
+            int SeekBestOverlapOffset();
+
+            int channels_;
+            int sample_rate_;
+            double rate_ = 1.0;
+
+            int overlap_length_ = 0;
+            int sequence_length_ = 0;
+            int seek_length_ = 0;
+            // input samples between two sequences, the fraction is carried to the next one
+            double nominal_skip_ = 0.0;
+            double skip_fraction_ = 0.0;
+
+            // per channel, plus a mono mix of the same samples for the correlation search
+            std::vector<std::vector<float>> input_;
+            std::vector<float> mono_input_;
+            std::vector<std::vector<float>> output_;
+
+            // overlap_length_ samples continuing the last sequence, faded out into the next one
+            std::vector<std::vector<float>> mid_buffer_;
+            std::vector<float> mono_mid_buffer_;
+            bool has_mid_buffer_ = false;
+
+            std::vector<float> fade_in_gain_;
+        };
+    }
+}
+#endif
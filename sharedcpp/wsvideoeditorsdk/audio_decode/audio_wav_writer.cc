@@ -0,0 +1,109 @@
+#include <cerrno>
+#include <cstring>
+#include "audio_wav_writer.h"
+#include "platform_logger.h"
+
+extern "C" {
+#include <libavutil/error.h>
+};
+
+namespace whensunset {
+    namespace wsvideoeditor {
+
+        const int kWavBitsPerSample = 16;
+
+        // RIFF sizes are 32 bit
+        const int64_t kWavMaxDataSize = 0xFFFFFFFFLL - 36;
+
+        static void PutLe16(uint8_t *dst, uint32_t value) {
+            dst[0] = static_cast<uint8_t>(value);
+            dst[1] = static_cast<uint8_t>(value >> 8);
+        }
+
+        static void PutLe32(uint8_t *dst, uint32_t value) {
+            PutLe16(dst, value & 0xFFFF);
+            PutLe16(dst + 2, value >> 16);
+        }
+
+        AudioWavWriter::~AudioWavWriter() {
+            Close();
+        }
+
+        int AudioWavWriter::Open(const std::string &path, int channels, int sample_rate) {
+            Close();
+            if (channels <= 0 || sample_rate <= 0) {
+                return AVERROR(EINVAL);
+            }
+            file_ = fopen(path.c_str(), "wb");
+            if (!file_) {
+                int ret = AVERROR(errno);
+                LOGE("AudioWavWriter::Open failed path:%s, ret:%d", path.c_str(), ret);
+                return ret;
+            }
+            channels_ = channels;
+            sample_rate_ = sample_rate;
+            data_size_ = 0;
+            return WriteHeader();
+        }
+
+        int AudioWavWriter::Write(const uint8_t *data, int size) {
+            if (!file_) {
+                return AVERROR(EINVAL);
+            }
+            if (size <= 0) {
+                return 0;
+            }
+            if (data_size_ + size > kWavMaxDataSize) {
+                LOGE("AudioWavWriter::Write file too big data_size:%lld", (long long) data_size_);
+                return AVERROR(EFBIG);
+            }
+            if (fwrite(data, 1, static_cast<size_t>(size), file_) != static_cast<size_t>(size)) {
+                LOGE("AudioWavWriter::Write failed size:%d", size);
+                return AVERROR(EIO);
+            }
+            data_size_ += size;
+            return 0;
+        }
+
+        int AudioWavWriter::Close() {
+            if (!file_) {
+                return 0;
+            }
+            int ret = 0;
+            if (fseek(file_, 0, SEEK_SET) != 0 || WriteHeader() < 0) {
+                ret = AVERROR(EIO);
+            }
+            if (fclose(file_) != 0 && ret == 0) {
+                ret = AVERROR(EIO);
+            }
+            file_ = nullptr;
+            if (ret < 0) {
+                LOGE("AudioWavWriter::Close failed to finish header ret:%d", ret);
+            }
+            return ret;
+        }
+
+        int AudioWavWriter::WriteHeader() {
+            int block_align = channels_ * kWavBitsPerSample / 8;
+            uint8_t header[44];
+            memcpy(header, "RIFF", 4);
+            PutLe32(header + 4, static_cast<uint32_t>(36 + data_size_));
+            memcpy(header + 8, "WAVEfmt ", 8);
+            PutLe32(header + 16, 16);
+            // PCM
+            PutLe16(header + 20, 1);
+            PutLe16(header + 22, static_cast<uint32_t>(channels_));
+            PutLe32(header + 24, static_cast<uint32_t>(sample_rate_));
+            PutLe32(header + 28, static_cast<uint32_t>(sample_rate_ * block_align));
+            PutLe16(header + 32, static_cast<uint32_t>(block_align));
+            PutLe16(header + 34, kWavBitsPerSample);
+            memcpy(header + 36, "data", 4);
+            PutLe32(header + 40, static_cast<uint32_t>(data_size_));
+            if (fwrite(header, 1, sizeof(header), file_) != sizeof(header)) {
+                LOGE("AudioWavWriter::WriteHeader failed");
+                return AVERROR(EIO);
+            }
+            return 0;
+        }
+    }
+}
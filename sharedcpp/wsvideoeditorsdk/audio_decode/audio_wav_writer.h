@@ -0,0 +1,40 @@
+#ifndef SHAREDCPP_WS_VIDEO_EDITOR_AUDIO_WAV_WRITER_H
+#define SHAREDCPP_WS_VIDEO_EDITOR_AUDIO_WAV_WRITER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace whensunset {
+    namespace wsvideoeditor {
+
+        // Writes interleaved S16 PCM to a canonical 44 byte header RIFF/WAVE file. The sizes in
+        // the header are patched on Close(), a file that is never closed has them left at 0.
+        class AudioWavWriter {
+        public:
+            AudioWavWriter() = default;
+
+            virtual ~AudioWavWriter();
+
+            int Open(const std::string &path, int channels, int sample_rate);
+
+            // size must be whole sample frames
+            int Write(const uint8_t *data, int size);
+
+            int Close();
+
+            int64_t data_size() const {
+                return data_size_;
+            }
+
+        private:
+            int WriteHeader();
+
+            FILE *file_ = nullptr;
+            int channels_ = 0;
+            int sample_rate_ = 0;
+            int64_t data_size_ = 0;
+        };
+    }
+}
+#endif
@@ -0,0 +1,318 @@
+#include <sys/stat.h>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "audio_waveform_service.h"
+#include "audio_decode_context.h"
+#include "audio_mixer.h"
+#include "platform_logger.h"
+#include "scratch_buffer.h"
+#include "ws_editor_video_sdk_utils.h"
+
+namespace whensunset {
+    namespace wsvideoeditor {
+
+        const int kWaveformSampleRate = 44100;
+        const int kWaveformChannels = 2;
+        const int kWaveformBaseSamplesPerPeak = 256;
+        const int kWaveformLevelFactor = 4;
+        const int kWaveformLevelCount = 6;
+        // samples decoded per AudioDecodeContext::GetAudio() call, a multiple of the base level
+        const int kWaveformChunkSamples = kWaveformBaseSamplesPerPeak * 64;
+
+        const char kPeaksFileMagic[4] = {'W', 'S', 'P', 'K'};
+        const uint32_t kPeaksFileVersion = 1;
+
+        struct PeaksFileHeader {
+            char magic[4];
+            uint32_t version;
+            uint32_t sample_rate;
+            uint32_t level_count;
+            int64_t nb_samples;
+        };
+
+        struct PeaksFileLevelHeader {
+            uint32_t samples_per_peak;
+            uint32_t peak_count;
+        };
+
+        static int16_t PeakToS16(float value) {
+            float scaled = value * SHRT_MAX;
+            return static_cast<int16_t>(std::max<float>(SHRT_MIN, std::min<float>(SHRT_MAX, scaled)));
+        }
+
+        const AudioWaveformLevel *
+        AudioWaveform::LevelForSamplesPerPixel(double samples_per_pixel) const {
+            const AudioWaveformLevel *best = nullptr;
+            for (const AudioWaveformLevel &level : levels) {
+                if (best == nullptr || level.samples_per_peak <= samples_per_pixel) {
+                    best = &level;
+                }
+            }
+            return best;
+        }
+
+        AudioWaveformService::AudioWaveformService(const std::string &cache_dir, int thread_count)
+                : cache_dir_(cache_dir) {
+            if (!cache_dir_.empty() && cache_dir_.back() != '/') {
+                cache_dir_ += "/";
+            }
+            for (int i = 0; i < std::max(1, thread_count); ++i) {
+                worker_threads_.push_back(std::thread(&AudioWaveformService::WorkerThreadMain, this));
+            }
+            LOGI("AudioWaveformService cache_dir:%s, thread_count:%d", cache_dir_.c_str(),
+                 thread_count);
+        }
+
+        AudioWaveformService::~AudioWaveformService() {
+            Stop();
+            LOGI("~AudioWaveformService");
+        }
+
+        void AudioWaveformService::Stop() {
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                released_ = true;
+                pending_paths_.clear();
+            }
+            cv_.notify_all();
+            for (std::thread &worker_thread : worker_threads_) {
+                if (worker_thread.joinable()) {
+                    worker_thread.join();
+                }
+            }
+        }
+
+        void AudioWaveformService::Request(const std::string &path) {
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                if (released_ || path.empty() || requested_paths_.count(path)) {
+                    return;
+                }
+                requested_paths_.insert(path);
+                pending_paths_.push_back(path);
+            }
+            cv_.notify_one();
+        }
+
+        std::shared_ptr<const AudioWaveform>
+        AudioWaveformService::GetWaveform(const std::string &path) {
+            std::lock_guard<std::mutex> lk(mutex_);
+            auto iter = waveforms_.find(path);
+            return iter == waveforms_.end() ? nullptr : iter->second;
+        }
+
+        void AudioWaveformService::WorkerThreadMain() {
+            SetCurrentThreadName("EditorWaveform");
+            while (true) {
+                std::string path;
+                {
+                    std::unique_lock<std::mutex> lk(mutex_);
+                    cv_.wait(lk, [this] {
+                        return released_ || !pending_paths_.empty();
+                    });
+                    if (released_) {
+                        break;
+                    }
+                    path = pending_paths_.front();
+                    pending_paths_.pop_front();
+                }
+
+                std::string peaks_path = PeaksPathFor(path);
+                std::shared_ptr<AudioWaveform> waveform(new(std::nothrow) AudioWaveform());
+                if (!waveform) {
+                    LOGE("AudioWaveformService::WorkerThreadMain OOM");
+                    continue;
+                }
+                if (peaks_path.empty() || !LoadPeaksFile(peaks_path, waveform.get())) {
+                    waveform = Analyze(path);
+                    if (!waveform) {
+                        continue;
+                    }
+                    if (!peaks_path.empty()) {
+                        SavePeaksFile(peaks_path, *waveform);
+                    }
+                }
+
+                std::lock_guard<std::mutex> lk(mutex_);
+                waveforms_[path] = waveform;
+                LOGI("AudioWaveformService::WorkerThreadMain waveform ready path:%s", path.c_str());
+            }
+        }
+
+        std::string AudioWaveformService::PeaksPathFor(const std::string &path) {
+            struct stat file_stat;
+            if (cache_dir_.empty() || stat(path.c_str(), &file_stat) != 0) {
+                return "";
+            }
+            std::string key = path + "_" + std::to_string((long long) file_stat.st_size) +
+                              "_" + std::to_string((long long) file_stat.st_mtime);
+            return cache_dir_ + "peaks_" + std::to_string(std::hash<std::string>()(key)) +
+                   ".wspeaks";
+        }
+
+        std::shared_ptr<AudioWaveform> AudioWaveformService::Analyze(const std::string &path) {
+            AudioDecodeContext decode_ctx("Waveform");
+            int ret = decode_ctx.OpenFile(path);
+            if (ret < 0 || decode_ctx.duration_sec() <= 0.0) {
+                LOGE("AudioWaveformService::Analyze open failed path:%s, ret:%d", path.c_str(), ret);
+                return nullptr;
+            }
+            decode_ctx.set_dst_channels(kWaveformChannels);
+            decode_ctx.set_dst_sample_rate(kWaveformSampleRate);
+            decode_ctx.set_dst_sample_fmt(AV_SAMPLE_FMT_FLTP);
+
+            std::shared_ptr<AudioWaveform> waveform(new(std::nothrow) AudioWaveform());
+            if (!waveform) {
+                LOGE("AudioWaveformService::Analyze OOM");
+                return nullptr;
+            }
+            waveform->sample_rate = kWaveformSampleRate;
+            waveform->nb_samples = static_cast<int64_t>(
+                    ceil(decode_ctx.duration_sec() * kWaveformSampleRate));
+            waveform->levels.resize(kWaveformLevelCount);
+
+            AudioWaveformLevel &base_level = waveform->levels[0];
+            base_level.samples_per_peak = kWaveformBaseSamplesPerPeak;
+            size_t base_peak_count = static_cast<size_t>(
+                    (waveform->nb_samples + kWaveformBaseSamplesPerPeak - 1) /
+                    kWaveformBaseSamplesPerPeak);
+            base_level.min_peaks.reserve(base_peak_count);
+            base_level.max_peaks.reserve(base_peak_count);
+            base_level.rms_peaks.reserve(base_peak_count);
+
+            base::ScratchBuffer chunk_buffer;
+            for (int64_t pos = 0; pos < waveform->nb_samples; pos += kWaveformChunkSamples) {
+                if (released_) {
+                    return nullptr;
+                }
+                int nb = static_cast<int>(std::min<int64_t>(kWaveformChunkSamples,
+                                                            waveform->nb_samples - pos));
+                int plane_len = nb * static_cast<int>(sizeof(float));
+                uint8_t *chunk = chunk_buffer.Reserve(plane_len * kWaveformChannels);
+                if (!chunk) {
+                    return nullptr;
+                }
+                memset(chunk, 0, static_cast<size_t>(plane_len * kWaveformChannels));
+                decode_ctx.GetAudio(pos, chunk, plane_len * kWaveformChannels);
+
+                for (int offset = 0; offset < nb; offset += kWaveformBaseSamplesPerPeak) {
+                    int count = std::min(kWaveformBaseSamplesPerPeak, nb - offset);
+                    float min_value = 0.0f;
+                    float max_value = 0.0f;
+                    double sum_squares = 0.0;
+                    for (int c = 0; c < kWaveformChannels; ++c) {
+                        const float *plane = reinterpret_cast<const float *>(chunk + c * plane_len);
+                        AudioPeakAccumulate(plane + offset, count, &min_value, &max_value,
+                                            &sum_squares);
+                    }
+                    base_level.min_peaks.push_back(PeakToS16(min_value));
+                    base_level.max_peaks.push_back(PeakToS16(max_value));
+                    base_level.rms_peaks.push_back(PeakToS16(static_cast<float>(
+                            sqrt(sum_squares / (count * kWaveformChannels)))));
+                }
+            }
+
+            // every coarser level folds kWaveformLevelFactor peaks of the previous one
+            for (int i = 1; i < kWaveformLevelCount; ++i) {
+                const AudioWaveformLevel &src = waveform->levels[i - 1];
+                AudioWaveformLevel &dst = waveform->levels[i];
+                dst.samples_per_peak = src.samples_per_peak * kWaveformLevelFactor;
+                for (size_t j = 0; j < src.min_peaks.size(); j += kWaveformLevelFactor) {
+                    size_t end = std::min(src.min_peaks.size(), j + kWaveformLevelFactor);
+                    int16_t min_value = src.min_peaks[j];
+                    int16_t max_value = src.max_peaks[j];
+                    double sum_squares = 0.0;
+                    for (size_t k = j; k < end; ++k) {
+                        min_value = std::min(min_value, src.min_peaks[k]);
+                        max_value = std::max(max_value, src.max_peaks[k]);
+                        sum_squares += (double) src.rms_peaks[k] * src.rms_peaks[k];
+                    }
+                    dst.min_peaks.push_back(min_value);
+                    dst.max_peaks.push_back(max_value);
+                    dst.rms_peaks.push_back(static_cast<int16_t>(sqrt(sum_squares / (end - j))));
+                }
+            }
+            return waveform;
+        }
+
+        bool AudioWaveformService::LoadPeaksFile(const std::string &peaks_path,
+                                                 AudioWaveform *waveform) {
+            FILE *file = fopen(peaks_path.c_str(), "rb");
+            if (!file) {
+                return false;
+            }
+            PeaksFileHeader header;
+            bool ok = fread(&header, sizeof(header), 1, file) == 1
+                      && memcmp(header.magic, kPeaksFileMagic, sizeof(kPeaksFileMagic)) == 0
+                      && header.version == kPeaksFileVersion
+                      && header.level_count <= kWaveformLevelCount;
+            if (ok) {
+                waveform->sample_rate = header.sample_rate;
+                waveform->nb_samples = header.nb_samples;
+                waveform->levels.resize(header.level_count);
+            }
+            for (uint32_t i = 0; ok && i < header.level_count; ++i) {
+                PeaksFileLevelHeader level_header;
+                ok = fread(&level_header, sizeof(level_header), 1, file) == 1;
+                if (!ok) {
+                    break;
+                }
+                AudioWaveformLevel &level = waveform->levels[i];
+                level.samples_per_peak = level_header.samples_per_peak;
+                level.min_peaks.resize(level_header.peak_count);
+                level.max_peaks.resize(level_header.peak_count);
+                level.rms_peaks.resize(level_header.peak_count);
+                ok = fread(level.min_peaks.data(), sizeof(int16_t), level_header.peak_count, file) ==
+                     level_header.peak_count
+                     && fread(level.max_peaks.data(), sizeof(int16_t), level_header.peak_count, file) ==
+                        level_header.peak_count
+                     && fread(level.rms_peaks.data(), sizeof(int16_t), level_header.peak_count, file) ==
+                        level_header.peak_count;
+            }
+            fclose(file);
+            if (!ok) {
+                LOGW("AudioWaveformService::LoadPeaksFile invalid peaks file:%s", peaks_path.c_str());
+            }
+            return ok;
+        }
+
+        bool AudioWaveformService::SavePeaksFile(const std::string &peaks_path,
+                                                 const AudioWaveform &waveform) {
+            std::string tmp_path = peaks_path + ".tmp";
+            FILE *file = fopen(tmp_path.c_str(), "wb");
+            if (!file) {
+                LOGE("AudioWaveformService::SavePeaksFile open failed path:%s", tmp_path.c_str());
+                return false;
+            }
+            PeaksFileHeader header;
+            memcpy(header.magic, kPeaksFileMagic, sizeof(kPeaksFileMagic));
+            header.version = kPeaksFileVersion;
+            header.sample_rate = static_cast<uint32_t>(waveform.sample_rate);
+            header.level_count = static_cast<uint32_t>(waveform.levels.size());
+            header.nb_samples = waveform.nb_samples;
+            bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+            for (const AudioWaveformLevel &level : waveform.levels) {
+                PeaksFileLevelHeader level_header;
+                level_header.samples_per_peak = static_cast<uint32_t>(level.samples_per_peak);
+                level_header.peak_count = static_cast<uint32_t>(level.min_peaks.size());
+                ok = ok && fwrite(&level_header, sizeof(level_header), 1, file) == 1
+                     && fwrite(level.min_peaks.data(), sizeof(int16_t), level_header.peak_count,
+                               file) == level_header.peak_count
+                     && fwrite(level.max_peaks.data(), sizeof(int16_t), level_header.peak_count,
+                               file) == level_header.peak_count
+                     && fwrite(level.rms_peaks.data(), sizeof(int16_t), level_header.peak_count,
+                               file) == level_header.peak_count;
+            }
+            ok = fclose(file) == 0 && ok;
+            if (!ok || rename(tmp_path.c_str(), peaks_path.c_str()) != 0) {
+                LOGE("AudioWaveformService::SavePeaksFile write failed path:%s", peaks_path.c_str());
+                remove(tmp_path.c_str());
+                return false;
+            }
+            return true;
+        }
+    }
+}
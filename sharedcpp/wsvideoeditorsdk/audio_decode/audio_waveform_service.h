@@ -0,0 +1,86 @@
+#ifndef SHAREDCPP_WS_VIDEO_EDITOR_AUDIO_WAVEFORM_SERVICE_H
+#define SHAREDCPP_WS_VIDEO_EDITOR_AUDIO_WAVEFORM_SERVICE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace whensunset {
+    namespace wsvideoeditor {
+
+        const int kDefaultWaveformThreadCount = 2;
+
+        // Peaks of one zoom level, one entry per samples_per_peak samples, normalized to int16.
+        struct AudioWaveformLevel {
+            int samples_per_peak = 0;
+            std::vector<int16_t> min_peaks;
+            std::vector<int16_t> max_peaks;
+            std::vector<int16_t> rms_peaks;
+        };
+
+        // Mipmapped peaks of one asset, levels[0] is the finest, every next level covers
+        // kWaveformLevelFactor times more samples per peak.
+        struct AudioWaveform {
+            int sample_rate = 0;
+            int64_t nb_samples = 0;
+            std::vector<AudioWaveformLevel> levels;
+
+            // Coarsest level that still has at least one peak per samples_per_pixel samples.
+            const AudioWaveformLevel *LevelForSamplesPerPixel(double samples_per_pixel) const;
+        };
+
+        // Computes waveforms for the timeline UI on a pool of background threads without touching
+        // the playback decoders. Results are persisted to compact peaks files in cache_dir keyed
+        // by path, size and mtime, so an asset is only analyzed once.
+        class AudioWaveformService {
+        public:
+            AudioWaveformService(const std::string &cache_dir,
+                                 int thread_count = kDefaultWaveformThreadCount);
+
+            virtual ~AudioWaveformService();
+
+            // Queues path for analysis, does nothing if it was requested before.
+            void Request(const std::string &path);
+
+            // Returns the waveform of path, nullptr while it is still being analyzed.
+            std::shared_ptr<const AudioWaveform> GetWaveform(const std::string &path);
+
+            void Stop();
+
+        private:
+            void WorkerThreadMain();
+
+            std::string PeaksPathFor(const std::string &path);
+
+            std::shared_ptr<AudioWaveform> Analyze(const std::string &path);
+
+            bool LoadPeaksFile(const std::string &peaks_path, AudioWaveform *waveform);
+
+            bool SavePeaksFile(const std::string &peaks_path, const AudioWaveform &waveform);
+
+            std::string cache_dir_;
+
+            std::mutex mutex_;
+
+            std::condition_variable cv_;
+
+            std::atomic<bool> released_{false};
+
+            std::deque<std::string> pending_paths_;
+
+            std::unordered_set<std::string> requested_paths_;
+
+            std::unordered_map<std::string, std::shared_ptr<const AudioWaveform>> waveforms_;
+
+            std::vector<std::thread> worker_threads_;
+        };
+    }
+}
+#endif
@@ -15,7 +15,8 @@ namespace whensunset {
     namespace wsvideoeditor {
 
         typedef std::function<void(int *get_length, unsigned char *buff, int size,
-                                   double *render_pos)> GetAudioDataCallback;
+                                   double *render_pos,
+                                   double *playback_rate)> GetAudioDataCallback;
 
         class AudioPlayer {
         public:
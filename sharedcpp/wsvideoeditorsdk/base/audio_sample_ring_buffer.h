@@ -2,135 +2,245 @@
 #define SHAREDCPP_WS_VIDEO_EDITOR_AUDIOSAMPLERINGBUFFER_H
 
 #include <assert.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
 #include <mutex>
 #include <condition_variable>
-#include <queue>
+#include <memory>
+#include <cstring>
+#include <algorithm>
+#include "media_time.h"
 
 namespace whensunset {
     namespace base {
 
-        template<typename T>
+        // Single producer / single consumer PCM FIFO between the audio decode thread (producer)
+        // and the audio output thread (consumer).
+        //
+        // Read and write positions are monotonic 64-bit byte indices, so the consumer never
+        // takes a lock: Get() and size() are wait-free. Every Put() writes a small header
+        // (payload length + start timestamp in MediaTicks) in front of its payload, which keeps
+        // the timestamps in band with the samples they describe. The header also carries the
+        // playback rate of the block, so a time-stretched block maps back to the timeline.
+        //
+        // Clear() is the flush used on seek: it advances flush_pos_ to the current write
+        // position. The producer treats everything before flush_pos_ as free, and the consumer
+        // skips to flush_pos_ on its next Get(). If a flush lands while the consumer is copying,
+        // the copied samples are discarded after the fact instead of being guarded by a lock.
         class AudioSampleRingBuffer {
         public:
 
-            AudioSampleRingBuffer(int capacity) : capacity_(capacity) {
-                assert(capacity_ > 0);
-                data_buffer_ = std::unique_ptr<T[]>(new(std::nothrow) T[capacity_]);
-                ts_buffer_ = std::unique_ptr<double[]>(new(std::nothrow) double[capacity_]);
-                if (!data_buffer_ || !ts_buffer_) {
+            // capacity is in bytes, bytes_per_sample covers all channels of one sample frame.
+            // audio_sample_rate is used to derive timestamps inside a block.
+            AudioSampleRingBuffer(int capacity, int bytes_per_sample = 4,
+                                  int audio_sample_rate = 44100)
+                    : capacity_(capacity), bytes_per_sample_(bytes_per_sample),
+                      audio_sample_rate_(audio_sample_rate) {
+                assert(capacity_ > kBlockHeaderSize);
+                assert(bytes_per_sample_ > 0 && audio_sample_rate_ > 0);
+                data_buffer_ = std::unique_ptr<uint8_t[]>(new(std::nothrow) uint8_t[capacity_]);
+                if (!data_buffer_) {
                     LOGE("OOM in AudioSampleRingBuffer constructor!!!");
                     abort();  // If OOM here, the App is in a hopeless state, just abort early, do not let errors propagate
                 }
-                head_ = 0;
-                size_ = 0;
-                not_full_cond_.notify_all();
             }
 
-            virtual ~AudioSampleRingBuffer() {
-                std::unique_lock<std::mutex> lock(mutex_);
-                data_buffer_.reset();
-                ts_buffer_.reset();
-            }
+            virtual ~AudioSampleRingBuffer() {}
 
+            // Buffered bytes, block headers included. Safe from any thread.
             int size() {
-                std::unique_lock<std::mutex> lock(mutex_);
-                return size_;
+                int64_t write_index = write_index_.load(std::memory_order_acquire);
+                int64_t begin = std::max(read_index_.load(std::memory_order_acquire),
+                                         flush_pos_.load(std::memory_order_acquire));
+                return static_cast<int>(std::max<int64_t>(0, write_index - begin));
             }
 
-            void Clear() {
-                std::unique_lock<std::mutex> lock(mutex_);
-                head_ = 0;
-                size_ = 0;
+            // Largest payload a single Put() can write right now without waiting, so the
+            // producer can refill the free space in one block. Safe from any thread.
+            int free_size() {
+                return std::max(0, capacity_ - size() - kBlockHeaderSize);
+            }
 
-                not_full_cond_.notify_all();
+            // Drops everything written so far. Safe from any thread; a block the producer is
+            // writing at the same moment survives, so the producer should also Clear() once it
+            // has moved to the new position.
+            void Clear() {
+                int64_t write_index = write_index_.load(std::memory_order_acquire);
+                int64_t flush_pos = flush_pos_.load(std::memory_order_relaxed);
+                while (flush_pos < write_index &&
+                       !flush_pos_.compare_exchange_weak(flush_pos, write_index,
+                                                         std::memory_order_acq_rel)) {
+                }
+                space_cond_.notify_all();
             }
 
             void Release() {
-                std::unique_lock<std::mutex> lock(mutex_);
-                head_ = 0;
-                size_ = 0;
-                is_released_ = true;
-                not_full_cond_.notify_all();
-                not_empty_cond_.notify_all();
+                is_released_.store(true, std::memory_order_release);
+                Clear();
             }
 
             void ReOpen() {
-                std::unique_lock<std::mutex> lock(mutex_);
-                head_ = 0;
-                size_ = 0;
-                is_released_ = false;
-                not_full_cond_.notify_all();
-                not_empty_cond_.notify_all();
+                Clear();
+                is_released_.store(false, std::memory_order_release);
             }
 
-            void Put(T data[], int length, double pos) {
+            // Producer only. Waits for space, polling the consumer position, until the block fits
+            // or the buffer is released. Every sample of the block advances pos by
+            // rate / audio_sample_rate.
+            void Put(const uint8_t data[], int length, MediaTicks pos, double rate = 1.0) {
                 assert(length % bytes_per_sample_ == 0);
-                std::unique_lock<std::mutex> lock(mutex_);
-                not_full_cond_.wait(lock,
-                                    [&] { return size_ + length <= capacity_ || is_released_; });
-                if (is_released_) {
+                int64_t need = length + kBlockHeaderSize;
+                if (length <= 0 || need > capacity_) {
                     return;
                 }
-
-                int tail = (head_ + size_) % capacity_;
-                for (int i = 0; i < length; ++i) {
-                    data_buffer_[tail % capacity_] = data[i];
-                    ts_buffer_[tail % capacity_] =
-                            pos + (i / bytes_per_sample_) / (double) audio_sample_rate_;
-                    tail++;
+                int64_t write_index = write_index_.load(std::memory_order_relaxed);
+                {
+                    std::unique_lock<std::mutex> lock(space_mutex_);
+                    while (!is_released_.load(std::memory_order_acquire) &&
+                           write_index + need - ReclaimedIndex() > capacity_) {
+                        space_cond_.wait_for(lock, std::chrono::milliseconds(kSpaceWaitIntervalMs));
+                    }
+                }
+                if (is_released_.load(std::memory_order_acquire)) {
+                    return;
                 }
-                size_ += length;
 
-                not_empty_cond_.notify_all();
+                BlockHeader header;
+                header.length = length;
+                header.pos = pos;
+                header.rate = static_cast<float>(rate);
+                CopyIn(write_index, reinterpret_cast<const uint8_t *>(&header), kBlockHeaderSize);
+                CopyIn(write_index + kBlockHeaderSize, data, length);
+                write_index_.store(write_index + need, std::memory_order_release);
             }
 
-            int Get(T data[], int length, double *pos, bool blocking) {
+            // Consumer only, never blocks. Returns the number of bytes copied and the timestamp
+            // of the first one in pos, and its playback rate in rate when it is not null.
+            int Get(uint8_t data[], int length, MediaTicks *pos, double *rate = nullptr) {
                 assert(length % bytes_per_sample_ == 0);
-                std::unique_lock<std::mutex> lock(mutex_);
-                if (blocking) {
-                    assert(length < capacity_);
-                    not_empty_cond_.wait(lock, [&] { return size_ >= length || is_released_; });
-                }
-                if (is_released_) {
+                if (is_released_.load(std::memory_order_acquire)) {
                     return 0;
                 }
-                if (size_ == 0) {
-                    return 0;
+                int64_t read_index = read_index_.load(std::memory_order_relaxed);
+                int64_t flush_pos = flush_pos_.load(std::memory_order_acquire);
+                if (read_index < flush_pos) {
+                    read_index = flush_pos;
+                    block_remaining_ = 0;
                 }
-
-                *pos = ts_buffer_[head_ % capacity_];
-
-                int get_length = length < size_ ? length : size_;
-                assert(get_length % bytes_per_sample_ == 0);
-                for (int i = 0; i < get_length; ++i) {
-                    data[i] = data_buffer_[(head_++) % capacity_];
+                int64_t start_index = read_index;
+                int64_t write_index = write_index_.load(std::memory_order_acquire);
+
+                int got_length = 0;
+                while (got_length < length) {
+                    if (block_remaining_ == 0) {
+                        if (write_index - read_index < kBlockHeaderSize) {
+                            break;
+                        }
+                        BlockHeader header;
+                        CopyOut(read_index, reinterpret_cast<uint8_t *>(&header), kBlockHeaderSize);
+                        read_index += kBlockHeaderSize;
+                        block_remaining_ = header.length;
+                        block_pos_ = header.pos;
+                        block_rate_ = header.rate;
+                        block_offset_ = 0;
+                    }
+                    int n = static_cast<int>(std::min<int64_t>(
+                            std::min(length - got_length, block_remaining_), write_index - read_index));
+                    if (n <= 0) {
+                        break;
+                    }
+                    if (got_length == 0) {
+                        *pos = block_pos_ + BlockOffsetTicks(block_offset_ / bytes_per_sample_);
+                        if (rate) {
+                            *rate = block_rate_;
+                        }
+                    }
+                    CopyOut(read_index, data + got_length, n);
+                    read_index += n;
+                    got_length += n;
+                    block_remaining_ -= n;
+                    block_offset_ += n;
                 }
-                size_ -= get_length;
 
-                not_full_cond_.notify_all();
-                return get_length;
+                if (flush_pos_.load(std::memory_order_acquire) > start_index) {
+                    // flushed while copying, the producer may already be overwriting this range
+                    block_remaining_ = 0;
+                    return 0;
+                }
+                read_index_.store(read_index, std::memory_order_release);
+                return got_length;
             }
 
             int capacity() {
-                std::unique_lock<std::mutex> lock(mutex_);
                 return capacity_;
             }
 
         private:
 
-            int capacity_;
-            int head_;
-            int size_;
-            bool is_released_ = false;
-            int bytes_per_sample_ = 4;
-            int audio_sample_rate_ = 44100;
+            struct BlockHeader {
+                int32_t length;
+                float rate = 1.0f;
+                MediaTicks pos;
+            };
+
+            static constexpr int kBlockHeaderSize = sizeof(BlockHeader);
+
+            static constexpr int kSpaceWaitIntervalMs = 5;
+
+            // Offset of the samples'th sample of the block being read from its start, computed
+            // from the block start so it is exact at rate 1 and rounds once otherwise.
+            MediaTicks BlockOffsetTicks(int samples) {
+                if (block_rate_ == 1.0) {
+                    return SamplesToTicks(samples, audio_sample_rate_);
+                }
+                return static_cast<MediaTicks>(std::llround(
+                        samples * block_rate_ * kTicksPerSecond / audio_sample_rate_));
+            }
+
+            int64_t ReclaimedIndex() {
+                return std::max(read_index_.load(std::memory_order_acquire),
+                                flush_pos_.load(std::memory_order_acquire));
+            }
+
+            void CopyIn(int64_t index, const uint8_t *src, int length) {
+                int offset = static_cast<int>(index % capacity_);
+                int first_part = std::min(length, capacity_ - offset);
+                memcpy(data_buffer_.get() + offset, src, first_part);
+                if (first_part < length) {
+                    memcpy(data_buffer_.get(), src + first_part, length - first_part);
+                }
+            }
+
+            void CopyOut(int64_t index, uint8_t *dst, int length) {
+                int offset = static_cast<int>(index % capacity_);
+                int first_part = std::min(length, capacity_ - offset);
+                memcpy(dst, data_buffer_.get() + offset, first_part);
+                if (first_part < length) {
+                    memcpy(dst + first_part, data_buffer_.get(), length - first_part);
+                }
+            }
+
+            const int capacity_;
+            const int bytes_per_sample_;
+            const int audio_sample_rate_;
+
+            std::unique_ptr<uint8_t[]> data_buffer_;
+
+            std::atomic<int64_t> write_index_{0};
+            std::atomic<int64_t> read_index_{0};
+            std::atomic<int64_t> flush_pos_{0};
+            std::atomic<bool> is_released_{false};
 
-            std::unique_ptr<T[]> data_buffer_;
-            std::unique_ptr<double[]> ts_buffer_;
+            // consumer side state of the block being read
+            int block_remaining_ = 0;
+            int block_offset_ = 0;
+            MediaTicks block_pos_ = 0;
+            double block_rate_ = 1.0;
 
-            std::mutex mutex_;
-            std::condition_variable not_empty_cond_;
-            std::condition_variable not_full_cond_;
+            // only the producer waits here, the consumer never touches it
+            std::mutex space_mutex_;
+            std::condition_variable space_cond_;
         };
     }
 }
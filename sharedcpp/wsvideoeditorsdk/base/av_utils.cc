@@ -1,5 +1,6 @@
 #include "av_utils.h"
 #include "platform_logger.h"
+#include <pthread.h>
 
 namespace whensunset {
     namespace wsvideoeditor {
@@ -1,7 +1,9 @@
 #ifndef SHAREDCPP_WS_VIDEO_EDITOR_AV_UTILS_H
 #define SHAREDCPP_WS_VIDEO_EDITOR_AV_UTILS_H
 
+#include <memory>
 #include <string>
+#include "media_time.h"
 
 extern "C" {
 #include "libavformat/avformat.h"
@@ -70,6 +72,21 @@ namespace whensunset {
 
         inline int64_t NoPtsToZero(int64_t pts) { return pts == AV_NOPTS_VALUE ? 0 : pts; };
 
+        /**
+         * 流时间戳和 MediaTicks 之间的转换，用 av_rescale_q_rnd 整数运算，四舍五入，不经过 double
+         */
+        inline base::MediaTicks StreamTsToTicks(int64_t ts, AVRational time_base) {
+            return av_rescale_q_rnd(ts, time_base, AV_TIME_BASE_Q,
+                                    static_cast<AVRounding>(AV_ROUND_NEAR_INF |
+                                                            AV_ROUND_PASS_MINMAX));
+        }
+
+        inline int64_t TicksToStreamTs(base::MediaTicks ticks, AVRational time_base) {
+            return av_rescale_q_rnd(ticks, AV_TIME_BASE_Q, time_base,
+                                    static_cast<AVRounding>(AV_ROUND_NEAR_INF |
+                                                            AV_ROUND_PASS_MINMAX));
+        }
+
         int FrameDisplayWidth(const AVFrame *frame);
 
         int FrameDisplayHeight(const AVFrame *frame);
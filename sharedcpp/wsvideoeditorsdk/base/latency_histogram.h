@@ -0,0 +1,95 @@
+#ifndef SHAREDCPP_WS_VIDEO_EDITOR_LATENCY_HISTOGRAM_H
+#define SHAREDCPP_WS_VIDEO_EDITOR_LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+
+namespace whensunset {
+    namespace base {
+
+        // Fixed bucket latency histogram in milliseconds. Adding a sample is a few compares, so
+        // it can be updated on the render thread. Not thread safe, the owner guards it.
+        class LatencyHistogram {
+        public:
+            static const int kBucketCount = 10;
+
+            void Add(double latency_ms) {
+                latency_ms = std::max(0.0, latency_ms);
+                const double *bounds = BucketUpperBoundsMs();
+                int bucket = 0;
+                while (bucket < kBucketCount - 1 && latency_ms > bounds[bucket]) {
+                    ++bucket;
+                }
+                ++buckets_[bucket];
+                ++count_;
+                sum_ms_ += latency_ms;
+                max_ms_ = std::max(max_ms_, latency_ms);
+            }
+
+            void Reset() {
+                *this = LatencyHistogram();
+            }
+
+            int64_t count() const {
+                return count_;
+            }
+
+            double mean_ms() const {
+                return count_ > 0 ? sum_ms_ / count_ : 0.0;
+            }
+
+            double max_ms() const {
+                return max_ms_;
+            }
+
+            // Upper bound of the bucket holding the p-th quantile, p in [0, 1]. The last bucket
+            // is open, max_ms() stands in for its bound.
+            double PercentileMs(double p) const {
+                if (count_ == 0) {
+                    return 0.0;
+                }
+                int64_t rank = std::max<int64_t>(1, static_cast<int64_t>(p * count_ + 0.5));
+                int64_t seen = 0;
+                const double *bounds = BucketUpperBoundsMs();
+                for (int i = 0; i < kBucketCount - 1; ++i) {
+                    seen += buckets_[i];
+                    if (seen >= rank) {
+                        return std::min(bounds[i], max_ms_);
+                    }
+                }
+                return max_ms_;
+            }
+
+            // "<=16ms:3 <=33ms:10 ... >2000ms:0", for logs
+            std::string ToString() const {
+                const double *bounds = BucketUpperBoundsMs();
+                std::string ret;
+                for (int i = 0; i < kBucketCount; ++i) {
+                    if (i > 0) {
+                        ret += " ";
+                    }
+                    int bound = static_cast<int>(bounds[i < kBucketCount - 1 ? i : i - 1]);
+                    ret += (i < kBucketCount - 1 ? "<=" : ">") + std::to_string(bound) + "ms:" +
+                           std::to_string(buckets_[i]);
+                }
+                return ret;
+            }
+
+        private:
+            // one display frame, two frames, then roughly doubling; the last bucket is open
+            static const double *BucketUpperBoundsMs() {
+                static const double kBounds[kBucketCount - 1] = {16, 33, 50, 100, 150, 250, 500,
+                                                                 1000, 2000};
+                return kBounds;
+            }
+
+            int64_t buckets_[kBucketCount] = {};
+            int64_t count_ = 0;
+            double sum_ms_ = 0.0;
+            double max_ms_ = 0.0;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef SHAREDCPP_WS_VIDEO_EDITOR_MEDIA_TIME_H
+#define SHAREDCPP_WS_VIDEO_EDITOR_MEDIA_TIME_H
+
+#include <stdint.h>
+#include <cmath>
+
+namespace whensunset {
+    namespace base {
+
+        // Timeline positions in integer microseconds, the same unit as AV_TIME_BASE, so a pts
+        // rescaled to AV_TIME_BASE_Q is already a MediaTicks. Sums and differences of ticks are
+        // exact; only the conversions below round, once, to the nearest tick.
+        typedef int64_t MediaTicks;
+
+        const MediaTicks kTicksPerSecond = 1000000;
+
+        // TIME_EPS in ticks, the tolerance for positions that went through a double on the way
+        const MediaTicks kTimeEpsTicks = 1000;
+
+        inline MediaTicks SecToTicks(double sec) {
+            return static_cast<MediaTicks>(std::llround(sec * kTicksPerSecond));
+        }
+
+        inline double TicksToSec(MediaTicks ticks) {
+            return ticks / static_cast<double>(kTicksPerSecond);
+        }
+
+        // Position of sample sample_index at sample_rate, rounded to the nearest tick. Callers
+        // count samples from an anchor and convert the total, so rounding never accumulates.
+        inline MediaTicks SamplesToTicks(int64_t sample_index, int sample_rate) {
+            int64_t scaled = sample_index * kTicksPerSecond;
+            int64_t half = sample_rate / 2;
+            return (scaled >= 0 ? scaled + half : scaled - half) / sample_rate;
+        }
+
+        inline int64_t TicksToSamples(MediaTicks ticks, int sample_rate) {
+            int64_t scaled = ticks * sample_rate;
+            int64_t half = kTicksPerSecond / 2;
+            return (scaled >= 0 ? scaled + half : scaled - half) / kTicksPerSecond;
+        }
+    }
+}
+
+#endif
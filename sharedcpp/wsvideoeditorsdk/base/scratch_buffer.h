@@ -0,0 +1,63 @@
+#ifndef SHAREDCPP_WS_VIDEO_EDITOR_SCRATCH_BUFFER_H
+#define SHAREDCPP_WS_VIDEO_EDITOR_SCRATCH_BUFFER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include "platform_logger.h"
+
+namespace whensunset {
+    namespace base {
+
+        // Number of heap allocations done by all ScratchBuffers, it stops growing once the
+        // buffers on a hot path have reached their steady state size.
+        inline std::atomic<int64_t> &ScratchBufferAllocationCount() {
+            static std::atomic<int64_t> allocation_count{0};
+            return allocation_count;
+        }
+
+        // Reusable scratch memory for per-chunk work on audio/video threads. It only grows,
+        // geometrically, so repeated Reserve() calls with similar sizes never allocate.
+        // Contents are not preserved when the buffer grows.
+        class ScratchBuffer {
+        public:
+            ScratchBuffer() {}
+
+            ScratchBuffer(const ScratchBuffer &) = delete;
+
+            ScratchBuffer &operator=(const ScratchBuffer &) = delete;
+
+            // Returns a buffer of at least size bytes, or nullptr on OOM.
+            uint8_t *Reserve(int size) {
+                if (size <= capacity_) {
+                    return data_.get();
+                }
+                int new_capacity = capacity_ * 2 > size ? capacity_ * 2 : size;
+                data_.reset(new(std::nothrow) uint8_t[new_capacity]);
+                if (!data_) {
+                    LOGE("ScratchBuffer::Reserve OOM size:%d", new_capacity);
+                    capacity_ = 0;
+                    return nullptr;
+                }
+                capacity_ = new_capacity;
+                ScratchBufferAllocationCount().fetch_add(1, std::memory_order_relaxed);
+                return data_.get();
+            }
+
+            uint8_t *data() {
+                return data_.get();
+            }
+
+            int capacity() const {
+                return capacity_;
+            }
+
+        private:
+            std::unique_ptr<uint8_t[]> data_;
+
+            int capacity_ = 0;
+        };
+    }
+}
+
+#endif
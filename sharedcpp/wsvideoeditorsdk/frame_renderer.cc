@@ -20,9 +20,11 @@ namespace whensunset {
             current_original_frame_texture_.reset();
         }
 
-        void FrameRenderer::SetEditorProject(const model::EditorProject &project) {
+        void FrameRenderer::SetEditorProject(ProjectSnapshot project,
+                                             SharedPreviewTimeline preview_timeline) {
             std::lock_guard<std::mutex> lk(render_mutex_);
-            project_ = project;
+            project_ = std::move(project);
+            preview_timeline_ = std::move(preview_timeline);
             project_changed_ = true;
         }
 
@@ -57,26 +59,30 @@ namespace whensunset {
             int project_width = 0;
             int project_height = 0;
             AVFrame *render_frame = current_frame_unit_.frame.get();
-            model::EditorProject project;
+            ProjectSnapshot project;
             {
                 std::lock_guard<std::mutex> lk(render_mutex_);
+                if (!project_ || !preview_timeline_) {
+                    return;
+                }
                 render_height = render_height_;
                 render_width = render_width_;
                 project = project_;
-                project_width = project.private_data().project_width();
-                project_height = project.private_data().project_height();
+                project_width = project->private_data().project_width();
+                project_height = project->private_data().project_height();
 
+                // 循环播放的时候帧的 pts 一直往后涨，用解码时记下的 project 中的时间找素材
                 double current_frame_real_render_pos = render_pos;
-                if (render_frame && render_frame->pts > 0) {
-                    current_frame_real_render_pos = render_frame->pts / (double(AV_TIME_BASE));
+                if (render_frame && current_frame_unit_.frame_timestamp_sec > 0) {
+                    current_frame_real_render_pos = current_frame_unit_.frame_timestamp_sec;
                 }
-                int showing_media_asset_index = GetMediaAssetIndexByRenderPos(project,
-                                                                              current_frame_real_render_pos);
+                int showing_media_asset_index = preview_timeline_->GetMediaAssetIndexByRenderPos(
+                        current_frame_real_render_pos);
                 if ((showing_media_asset_index != showing_media_asset_index_ && is_new_frame) ||
                     project_changed_) {
                     project_changed_ = false;
                     showing_media_asset_rotation_ = GetMediaAssetRotation(
-                            project.media_asset(showing_media_asset_index));
+                            project->media_asset(showing_media_asset_index));
                     showing_media_asset_index_ = showing_media_asset_index;
                 }
                 LOGI("FrameRenderer::RenderInner render_height:%d, render_width:%d, "
@@ -97,9 +103,9 @@ namespace whensunset {
                          showing_media_asset_rotation_) %
                         360,
                         ProjectMaxOutputShortEdge(
-                                project),
+                                *project),
                         ProjectMaxOutputLongEdge(
-                                project));
+                                *project));
                 if (!current_original_frame_texture_) {
                     return;
                 }
@@ -12,6 +12,8 @@
 #include "opengl/shader_program_pool.h"
 #include "ws_video_editor_sdk.pb.h"
 #include "av_utils.h"
+#include "project_snapshot.h"
+#include "preview_timeline.h"
 
 namespace whensunset {
     namespace wsvideoeditor {
@@ -21,7 +23,7 @@ namespace whensunset {
 
             virtual ~FrameRenderer();
 
-            void SetEditorProject(const model::EditorProject &project);
+            void SetEditorProject(ProjectSnapshot project, SharedPreviewTimeline preview_timeline);
 
             void SetRenderSize(int render_width, int render_height);
 
@@ -33,6 +35,13 @@ namespace whensunset {
                 return showing_media_asset_index_;
             }
 
+            /**
+             * 有没有可以画的帧，只在渲染线程调用
+             */
+            bool has_frame() {
+                return !!current_frame_unit_;
+            }
+
         private:
             WsFinalDrawProgram *GetWsFinalDrawProgram() {
                 std::lock_guard<std::mutex> lk(render_mutex_);
@@ -57,7 +66,9 @@ namespace whensunset {
 
             int showing_media_asset_rotation_;
 
-            model::EditorProject project_;
+            ProjectSnapshot project_;
+
+            SharedPreviewTimeline preview_timeline_;
 
             int render_height_;
 
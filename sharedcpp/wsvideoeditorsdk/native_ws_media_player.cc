@@ -12,6 +12,9 @@ namespace whensunset {
 
         const int HAVE_ENOUGH_AUDIO_DATA_THRESHOLD = AUDIO_BUFFER_SIZE * 4;
 
+        // 比解码线程最多领先渲染的距离大就行
+        const double kKeepDecodedMinDistance = 1.0;
+
         NativeWSMediaPlayer::NativeWSMediaPlayer() :
                 frame_renderer_(),
                 video_decode_service_(VideoDecodeServiceCreate(5)),
@@ -19,20 +22,25 @@ namespace whensunset {
                 time_message_center_(2){
 
             time_message_center_.SetProcessFunction([&](double pts) {
-                model::EditorProject project;
+                ProjectSnapshot project;
+                uint64_t project_version = 0;
                 {
                     std::lock_guard<std::mutex> lk(mutex_);
-                    if (seeking_ || project_.media_asset_size() == 0) {
+                    // 循环的时候时钟会超过 project 的时长，不会播放到结尾
+                    if (seeking_ || loop_armed_ || project_.media_asset_size() == 0) {
                         return;
                     }
-                    project = project_;
+                    project = project_snapshot_.Get(&project_version);
+                }
+                if (!project) {
+                    return;
                 }
 
-                bool played_to_end = (pts >= project_.private_data().project_duration() - PTS_EPS);
+                bool played_to_end = (pts >= project->private_data().project_duration() - PTS_EPS);
 
                 {
                     std::lock_guard<std::mutex> lk(mutex_);
-                    if (IsProjectTimelineChanged(project, project_)) {
+                    if (project_snapshot_.version() != project_version) {
                         return;
                     }
                     if (played_to_end && !ended_) {
@@ -46,17 +54,52 @@ namespace whensunset {
                     new(std::nothrow) AudioPlayByAndroid(&time_message_center_));
             audio_player_->SetRefClock(&audio_ref_clock_);
             audio_player_->SetAudioPlayGetObj(
-                    [=](int *get_length, unsigned char *buff, int size, double *render_pos) {
-                        *get_length = audio_decode_service_.GetAudio(buff, size, render_pos);
+                    [=](int *get_length, unsigned char *buff, int size, double *render_pos,
+                        double *playback_rate) {
+                        *get_length = audio_decode_service_.GetAudio(buff, size, render_pos,
+                                                                     playback_rate);
                     });
         }
 
         void NativeWSMediaPlayer::SetProject(const model::EditorProject &project) {
             std::unique_lock<std::mutex> lk(mutex_);
 
-            bool is_project_timeline_changed = IsProjectTimelineChanged(project, project_);
+            ProjectFingerprint project_fingerprint = FingerprintProject(project);
+            ProjectDiff diff = DiffProjects(project_fingerprint_, project_fingerprint);
+            project_fingerprint_ = std::move(project_fingerprint);
+            uint64_t poster_key = ProjectPosterKey(project_fingerprint_);
+            if (poster_key != poster_key_) {
+                poster_key_ = poster_key;
+                poster_frame_stored_ = PosterFrameCache::Instance().Contains(poster_key);
+            }
+            if (project.media_asset_size() > 0 &&
+                first_set_project_time_ == std::chrono::steady_clock::time_point()) {
+                first_set_project_time_ = std::chrono::steady_clock::now();
+            }
+            // 改动都在播放位置后面足够远的地方，已经解码好的帧和音频都还能用，不用从头开始
+            bool is_project_timeline_changed = diff.timeline_changed() &&
+                                               diff.first_timeline_change_pos <=
+                                               current_time_ + kKeepDecodedMinDistance;
+            LOGI("NativeWSMediaPlayer::SetProject inserted:%d, removed:%d, moved:%d, retimed:%d, "
+                 "volume_changed:%d, first_timeline_change_pos:%f",
+                 (int) diff.inserted.size(), (int) diff.removed.size(), (int) diff.moved.size(),
+                 (int) diff.retimed.size(), (int) diff.volume_changed.size(),
+                 diff.first_timeline_change_pos);
 
             project_ = project;
+            project_snapshot_.Publish(project);
+            ProjectSnapshot project_snapshot = project_snapshot_.Get();
+            preview_time_line_.reset(new(std::nothrow) PreviewTimeline(project));
+
+            bool is_loop_region_changed = ApplyLoopRegion();
+
+            UpdateClockMaster();
+
+            if (proxy_media_service_) {
+                proxy_media_service_->RequestProxies(project);
+            }
+
+            RequestAudioWaveforms(project);
 
             if (is_project_timeline_changed) {
                 double pos_sec = 0.0;
@@ -65,9 +108,11 @@ namespace whensunset {
                     pos_sec = 0;
                 }
 
-                video_decode_service_->SetProject(project, pos_sec);
+                video_decode_service_->SetProject(project, pos_sec, preview_time_line_);
+                audio_decode_service_.SetProject(project_snapshot, pos_sec);
 
                 current_time_ = pos_sec;
+                loop_armed_ = loop_enabled_ && pos_sec < loop_end_;
 
                 audio_player_->Pause();
                 audio_player_->Flush();
@@ -76,31 +121,57 @@ namespace whensunset {
 
                 RecalculateDecodeAndRenderState();
             } else {
-                video_decode_service_->UpdateProject(project);
+                video_decode_service_->UpdateProject(project, preview_time_line_);
 
-                audio_decode_service_.SetProject(project);
-            }
-            frame_renderer_.SetEditorProject(project);
+                audio_decode_service_.SetProject(project_snapshot);
 
-            preview_time_line_.reset(new(std::nothrow) PreviewTimeline(project));
+                if (is_loop_region_changed) {
+                    // 循环区间跟着 project 的时长变了，解码服务 seek 之后才用新的区间
+                    SeekInternal(current_time_);
+                }
+            }
+            frame_renderer_.SetEditorProject(project_snapshot, preview_time_line_);
         }
 
         void NativeWSMediaPlayer::DrawFrame() {
-            double current_time;
+            double current_time, clock_time;
             std::chrono::system_clock::time_point last_user_seek_time;
-            model::EditorProject project;
+            uint64_t poster_key = 0;
+            bool should_store_poster_frame = false;
+            bool use_poster_frame = false;
             {
                 std::lock_guard<std::mutex> lk(mutex_);
                 if (!attached_ || project_.media_asset_size() == 0) {
                     return;
                 }
-                project = project_;
-                current_time_ = current_time = GetRenderPos();
+                clock_time = GetRenderPos();
+                current_time_ = current_time = WrapLoopPos(clock_time);
+                poster_key = poster_key_;
+                use_poster_frame = poster_frame_cache_enabled_;
+                should_store_poster_frame = use_poster_frame && !poster_frame_stored_;
             }
 
             DecodedFramesUnit decoded_frames_unit = DecodedFramesUnitCreateNull();
-            decoded_frames_unit = video_decode_service_->GetRenderFrameAtPtsOrNull(
-                    current_time);
+            // 帧的 pts 和时钟一样，循环过的时长也算在里面
+            decoded_frames_unit = video_decode_service_->GetRenderFrameAtPtsOrNull(clock_time);
+            bool got_frame = !!decoded_frames_unit.frame;
+            bool from_poster_frame = false;
+            if (got_frame) {
+                if (should_store_poster_frame &&
+                    decoded_frames_unit.frame->pts < base::kTimeEpsTicks) {
+                    PosterFrameCache::Instance().Put(poster_key, decoded_frames_unit.frame.get());
+                    std::lock_guard<std::mutex> lk(mutex_);
+                    if (poster_key_ == poster_key) {
+                        poster_frame_stored_ = true;
+                    }
+                }
+            } else if (use_poster_frame && !frame_renderer_.has_frame() &&
+                       current_time < PTS_EPS) {
+                // 还没有解出帧的时候先画这个 project 上次的封面帧
+                decoded_frames_unit.frame = PosterFrameCache::Instance().Get(poster_key);
+                decoded_frames_unit.frame_media_asset_index = 0;
+                from_poster_frame = !!decoded_frames_unit.frame;
+            }
             if (!decoded_frames_unit.frame) {
                 LOGI("DrawFrame frame is empty");
             }
@@ -114,18 +185,29 @@ namespace whensunset {
                 std::lock_guard<std::mutex> lk(mutex_);
                 int video_buffered_frame_count = video_decode_service_->GetBufferedFrameCount();
                 int audio_buffered_data_size = audio_decode_service_.GetBufferedDataSize();
-
-                if ((!decoded_frames_unit.frame && video_buffered_frame_count <= 1 &&
-                     !video_decode_service_->ended()) || audio_buffered_data_size == 0) {
+                // the system clock does not wait for audio
+                bool audio_starving = audio_clock_master_ && audio_buffered_data_size == 0;
+                bool audio_enough = !audio_clock_master_ ||
+                                    audio_buffered_data_size >= HAVE_ENOUGH_AUDIO_DATA_THRESHOLD;
+                bool video_enough =
+                        video_buffered_frame_count >= HAVE_ENOUGH_VIDEO_DATA_THRESHOLD ||
+                        video_decode_service_->ended();
+
+                if (seeking_) {
+                    // seek 的时候上一帧一直显示着，ready state 不变，不用先掉到 kHaveMetaData
+                    if (UpdateSeekState(got_frame, video_enough && audio_enough)) {
+                        should_update_ready_state = true;
+                        target_ready_state = kHaveEnoughData;
+                    }
+                } else if ((!got_frame && video_buffered_frame_count <= 1 &&
+                            !video_decode_service_->ended()) || audio_starving) {
                     if (std::chrono::system_clock::now() - last_have_enough_data_time_ >
                         kReadyStateMinChangeInterval) {
                         should_update_ready_state = true;
                         target_ready_state = kHaveMetaData;
                     }
                 } else {
-                    if ((video_buffered_frame_count >= HAVE_ENOUGH_VIDEO_DATA_THRESHOLD ||
-                         video_decode_service_->ended()) &&
-                        audio_buffered_data_size >= HAVE_ENOUGH_AUDIO_DATA_THRESHOLD) {
+                    if (video_enough && audio_enough) {
                         should_update_ready_state = true;
                         target_ready_state = kHaveEnoughData;
                     } else {
@@ -137,24 +219,62 @@ namespace whensunset {
                     }
                 }
                 LOGI("NativeWSMediaPlayer::DrawFrame target_ready_state:%d, "
-                     "video_buffered_frame_count:%d, audio_buffered_data_size:%d",
-                     target_ready_state, video_buffered_frame_count, audio_buffered_data_size);
+                     "video_buffered_frame_count:%d, audio_buffered_data_size:%d, seeking_:%s",
+                     target_ready_state, video_buffered_frame_count, audio_buffered_data_size,
+                     BoTSt(seeking_).c_str());
             }
             if (should_update_ready_state) {
                 UpdateReadyState(target_ready_state);
             }
+            bool has_new_frame = !!decoded_frames_unit.frame;
             frame_renderer_.Render(current_time, std::move(decoded_frames_unit));
 
             glFinish();
+
+            if (has_new_frame) {
+                RecordFirstFrame(from_poster_frame);
+            }
+        }
+
+        void NativeWSMediaPlayer::RecordFirstFrame(bool from_poster_frame) {
+            std::lock_guard<std::mutex> lk(mutex_);
+            if (first_frame_drawn_) {
+                return;
+            }
+            first_frame_drawn_ = true;
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (first_set_project_time_ != std::chrono::steady_clock::time_point()) {
+                first_frame_stats_.set_project_to_first_frame_ms =
+                        std::chrono::duration<double, std::milli>(
+                                now - first_set_project_time_).count();
+            }
+            if (first_attach_time_ != std::chrono::steady_clock::time_point()) {
+                first_frame_stats_.attach_to_first_frame_ms =
+                        std::chrono::duration<double, std::milli>(
+                                now - first_attach_time_).count();
+            }
+            first_frame_stats_.from_poster_frame = from_poster_frame;
+            LOGI("NativeWSMediaPlayer::RecordFirstFrame set_project_to_first_frame_ms:%f, "
+                 "attach_to_first_frame_ms:%f, from_poster_frame:%s",
+                 first_frame_stats_.set_project_to_first_frame_ms,
+                 first_frame_stats_.attach_to_first_frame_ms, BoTSt(from_poster_frame).c_str());
         }
 
         void NativeWSMediaPlayer::UpdateReadyState(const PlayerReadyState &new_ready_state) {
             std::lock_guard<std::mutex> lk(mutex_);
+            if (seeking_) {
+                // DrawFrame 放开锁之后又开始了新的 seek，等这个 seek 完成再说
+                return;
+            }
             if (new_ready_state >= kHaveEnoughData && ready_state_ < kHaveEnoughData) {
                 last_have_enough_data_time_ = std::chrono::system_clock::now();
             }
             if (new_ready_state >= kHaveCurrentData && !paused_) {
-                audio_player_->Play();
+                if (audio_clock_master_) {
+                    audio_player_->Play();
+                } else {
+                    audio_ref_clock_.Start();
+                }
             }
 
             ready_state_ = new_ready_state;
@@ -163,6 +283,9 @@ namespace whensunset {
         void NativeWSMediaPlayer::OnAttachedToController(int width, int height) {
             std::lock_guard<std::mutex> lk(mutex_);
             attached_ = true;
+            if (first_attach_time_ == std::chrono::steady_clock::time_point()) {
+                first_attach_time_ = std::chrono::steady_clock::now();
+            }
             frame_renderer_.SetRenderSize(width, height);
             RecalculateDecodeAndRenderState();
         }
@@ -173,13 +296,29 @@ namespace whensunset {
                 return;
             }
             attached_ = false;
+            speculative_decode_ = false;
             frame_renderer_.ReleaseGLResource();
             RecalculateDecodeAndRenderState();
         }
 
+        void NativeWSMediaPlayer::SetSpeculativeDecodeEnabled(bool enabled) {
+            std::lock_guard<std::mutex> lk(mutex_);
+            speculative_decode_ = enabled;
+            RecalculateDecodeAndRenderState();
+        }
+
+        void NativeWSMediaPlayer::SetPosterFrameCacheEnabled(bool enabled) {
+            std::lock_guard<std::mutex> lk(mutex_);
+            poster_frame_cache_enabled_ = enabled;
+        }
+
         void NativeWSMediaPlayer::RecalculateDecodeAndRenderState() {
             bool should_render = attached_;
-            bool should_decode = attached_;
+            // 第一次 attach 之前就开始解码，surface 创建的同时解码器已经打开、seek 好、解出了
+            // 开头的几帧。视频帧队列和音频缓冲都有上限，填满之后解码线程就停下来等着，
+            // 所以只会提前解开头的几帧和几块音频
+            bool should_decode = attached_ ||
+                                 (speculative_decode_ && project_.media_asset_size() > 0);
 
             if (should_decode) {
                 ResumeDecode();
@@ -213,29 +352,150 @@ namespace whensunset {
         }
 
         void NativeWSMediaPlayer::ResumeDecode() {
+            bool video_restarted = false, audio_restarted = false;
             if (video_decode_service_->stopped()) {
-                video_decode_service_->SetProject(project_, current_time_);
+                video_decode_service_->SetProject(project_, current_time_, preview_time_line_);
                 video_decode_service_->Start();
+                video_restarted = true;
             }
 
-            if (audio_decode_service_.is_stopped()) {
-                audio_decode_service_.SetProject(project_, current_time_);
+            if (audio_clock_master_ && audio_decode_service_.is_stopped()) {
+                audio_decode_service_.SetProject(project_snapshot_.Get(), current_time_);
                 audio_ref_clock_.SetPts(current_time_);
                 audio_decode_service_.Start();
+                audio_restarted = true;
+            }
+
+            if (loop_armed_) {
+                // 循环过之后时钟和帧的 pts 都加上了循环过的时长，重新开始解码的服务是从 current_time_
+                // 开始的，另一个也要回到 current_time_
+                if (audio_restarted && !video_restarted) {
+                    video_decode_service_->Seek(current_time_);
+                } else if (video_restarted && !audio_restarted) {
+                    audio_ref_clock_.SetPts(current_time_);
+                }
             }
         }
 
+        void NativeWSMediaPlayer::UpdateClockMaster() {
+            bool audio_clock_master = ProjectHasAudibleAudio(project_);
+            if (audio_clock_master == audio_clock_master_) {
+                return;
+            }
+            LOGI("NativeWSMediaPlayer::UpdateClockMaster audio_clock_master:%s",
+                 BoTSt(audio_clock_master).c_str());
+            // both masters drive audio_ref_clock_, pausing the audio player also freezes it
+            double render_pos = audio_ref_clock_.GetRenderPos();
+            audio_player_->Pause();
+            audio_player_->Flush();
+            audio_clock_master_ = audio_clock_master;
+            if (audio_clock_master_) {
+                audio_ref_clock_.SetPts(render_pos);
+                if (attached_ || speculative_decode_) {
+                    ResumeDecode();
+                }
+            } else {
+                // silent project, no need to decode and play silence just to move the clock
+                audio_decode_service_.Stop();
+                audio_ref_clock_.SetPts(render_pos);
+                if (!paused_ && ready_state_ >= kHaveCurrentData) {
+                    audio_ref_clock_.Start();
+                }
+            }
+        }
+
+        double NativeWSMediaPlayer::GetSystemClockRenderPos() {
+            double render_pos = audio_ref_clock_.GetRenderPos();
+            double duration = project_.private_data().project_duration();
+            if (render_pos > duration && !loop_armed_) {
+                render_pos = duration;
+            }
+            // the audio player reports positions for the end of playback check, do it instead
+            time_message_center_.AddMessage(render_pos);
+            return render_pos;
+        }
+
         void NativeWSMediaPlayer::Seek(double current_time) {
             std::lock_guard<std::mutex> lk(mutex_);
+            if (project_.media_asset_size() == 0) {
+                LOGI("NativeWSMediaPlayer::Seek project is empty current_time:%f", current_time);
+                return;
+            }
+            current_time = std::max(0.0, std::min(current_time,
+                                                  project_.private_data().project_duration()));
+            std::chrono::steady_clock::time_point request_time = std::chrono::steady_clock::now();
+
+            if (seeking_ && !seek_frame_shown_) {
+                // 解码线程还在找上一个 seek 的第一帧，这时候再 seek 会把它打断，
+                // 只记下最后一次的位置，第一帧出来之后在 UpdateSeekState 里再 seek 过去
+                ++seek_stats_.coalesced_count;
+                if (std::fabs(current_time - current_time_) < PTS_EPS) {
+                    has_pending_seek_ = false;
+                } else {
+                    has_pending_seek_ = true;
+                    pending_seek_pos_ = current_time;
+                    pending_seek_time_ = request_time;
+                }
+                LOGI("NativeWSMediaPlayer::Seek coalesced current_time:%f, seeking to:%f",
+                     current_time, current_time_);
+                return;
+            }
+
+            has_pending_seek_ = false;
+            LOGI("NativeWSMediaPlayer::Seek current_time:%f", current_time);
+            SeekInternal(current_time, request_time);
+        }
+
+        bool NativeWSMediaPlayer::UpdateSeekState(bool got_frame, bool streams_ready) {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (got_frame && !seek_frame_shown_) {
+                seek_frame_shown_ = true;
+                seek_stats_.first_frame_latency.Add(
+                        std::chrono::duration<double, std::milli>(now - seek_request_time_).count());
+            }
+            if (!seek_frame_shown_) {
+                return false;
+            }
+            if (has_pending_seek_) {
+                has_pending_seek_ = false;
+                SeekInternal(pending_seek_pos_, pending_seek_time_);
+                return false;
+            }
+            if (!streams_ready) {
+                return false;
+            }
+
+            seeking_ = false;
+            seek_stats_.ready_latency.Add(
+                    std::chrono::duration<double, std::milli>(now - seek_request_time_).count());
+            LOGI("NativeWSMediaPlayer::UpdateSeekState seek done current_time_:%f, "
+                 "first_frame p50:%f p90:%f max:%f, ready p50:%f p90:%f max:%f, "
+                 "coalesced_count:%lld", current_time_,
+                 seek_stats_.first_frame_latency.PercentileMs(0.5),
+                 seek_stats_.first_frame_latency.PercentileMs(0.9),
+                 seek_stats_.first_frame_latency.max_ms(),
+                 seek_stats_.ready_latency.PercentileMs(0.5),
+                 seek_stats_.ready_latency.PercentileMs(0.9),
+                 seek_stats_.ready_latency.max_ms(),
+                 (long long) seek_stats_.coalesced_count);
+            return true;
         }
 
-        void NativeWSMediaPlayer::SeekInternal(double render_pos) {
+        void NativeWSMediaPlayer::SeekInternal(double render_pos,
+                                               std::chrono::steady_clock::time_point request_time) {
             audio_player_->Pause();
 
             audio_player_->Flush();
 
+            // 系统时钟主控的时候 AudioPlayer 停不住时钟，seek 完成之后再一起走
+            audio_ref_clock_.Pause();
+
             ended_ = false;
             seeking_ = true;
+            seek_frame_shown_ = false;
+            seek_request_time_ = request_time;
+            // 从 loop_end_ 之后开始播放的时候不循环，一直播到结尾
+            loop_armed_ = loop_enabled_ && render_pos < loop_end_;
 
             current_time_ = render_pos;
             video_decode_service_->Seek(render_pos);
@@ -250,6 +510,7 @@ namespace whensunset {
                 return;
             }
             if (ended_) {
+                has_pending_seek_ = false;
                 SeekInternal(0);
                 ended_ = false;
             }
@@ -269,6 +530,134 @@ namespace whensunset {
             paused_ = true;
         }
 
+        void NativeWSMediaPlayer::EnableProxyMedia(const std::string &cache_dir,
+                                                   double pixel_rate_threshold) {
+            std::lock_guard<std::mutex> lk(mutex_);
+            if (proxy_media_service_) {
+                return;
+            }
+            proxy_media_service_.reset(
+                    new(std::nothrow) ProxyMediaService(cache_dir, pixel_rate_threshold));
+            if (!proxy_media_service_) {
+                LOGE("NativeWSMediaPlayer::EnableProxyMedia OOM");
+                return;
+            }
+            video_decode_service_->SetProxyMediaService(proxy_media_service_.get());
+            proxy_media_service_->RequestProxies(project_);
+        }
+
+        void NativeWSMediaPlayer::EnableAudioPcmCache(const std::string &temp_dir,
+                                                      int64_t ram_budget_bytes) {
+            audio_decode_service_.EnablePcmCache(temp_dir, ram_budget_bytes);
+        }
+
+        void NativeWSMediaPlayer::EnableAudioWaveform(const std::string &cache_dir) {
+            std::lock_guard<std::mutex> lk(mutex_);
+            if (audio_waveform_service_) {
+                return;
+            }
+            audio_waveform_service_.reset(new(std::nothrow) AudioWaveformService(cache_dir));
+            if (!audio_waveform_service_) {
+                LOGE("NativeWSMediaPlayer::EnableAudioWaveform OOM");
+                return;
+            }
+            RequestAudioWaveforms(project_);
+        }
+
+        void NativeWSMediaPlayer::RequestAudioWaveform(const std::string &path) {
+            std::lock_guard<std::mutex> lk(mutex_);
+            if (audio_waveform_service_) {
+                audio_waveform_service_->Request(path);
+            }
+        }
+
+        std::shared_ptr<const AudioWaveform>
+        NativeWSMediaPlayer::GetAudioWaveform(const std::string &path) {
+            std::lock_guard<std::mutex> lk(mutex_);
+            if (!audio_waveform_service_) {
+                return nullptr;
+            }
+            return audio_waveform_service_->GetWaveform(path);
+        }
+
+        void NativeWSMediaPlayer::RequestAudioWaveforms(const model::EditorProject &project) {
+            if (!audio_waveform_service_) {
+                return;
+            }
+            for (const model::MediaAsset &asset : project.media_asset()) {
+                audio_waveform_service_->Request(asset.asset_path());
+            }
+        }
+
+        void NativeWSMediaPlayer::SetPlaybackRate(double playback_rate) {
+            std::lock_guard<std::mutex> lk(mutex_);
+            playback_rate = ClampPlaybackRate(playback_rate);
+            LOGI("NativeWSMediaPlayer::SetPlaybackRate playback_rate:%f", playback_rate);
+            video_decode_service_->SetPlaybackRate(playback_rate);
+            audio_decode_service_.SetPlaybackRate(playback_rate);
+            audio_ref_clock_.SetRate(playback_rate);
+        }
+
+        void NativeWSMediaPlayer::SetLoopRegion(double loop_start, double loop_end) {
+            std::lock_guard<std::mutex> lk(mutex_);
+            LOGI("NativeWSMediaPlayer::SetLoopRegion loop_start:%f, loop_end:%f", loop_start,
+                 loop_end);
+            loop_enabled_ = true;
+            requested_loop_start_ = loop_start;
+            requested_loop_end_ = loop_end;
+            if (ApplyLoopRegion() && project_.media_asset_size() > 0) {
+                // 解码服务 seek 之后才用新的区间，已经过了 loop_end_ 的话回到 loop_start_
+                double pos_sec = current_time_;
+                if (loop_end_ > loop_start_ && pos_sec >= loop_end_) {
+                    pos_sec = loop_start_;
+                }
+                has_pending_seek_ = false;
+                SeekInternal(pos_sec);
+            }
+        }
+
+        void NativeWSMediaPlayer::ClearLoopRegion() {
+            std::lock_guard<std::mutex> lk(mutex_);
+            if (!loop_enabled_) {
+                return;
+            }
+            LOGI("NativeWSMediaPlayer::ClearLoopRegion current_time_:%f", current_time_);
+            loop_enabled_ = false;
+            ApplyLoopRegion();
+            if (project_.media_asset_size() > 0) {
+                has_pending_seek_ = false;
+                SeekInternal(current_time_);
+            }
+        }
+
+        bool NativeWSMediaPlayer::ApplyLoopRegion() {
+            double duration = project_.private_data().project_duration();
+            double loop_start = 0.0, loop_end = 0.0;
+            if (loop_enabled_) {
+                loop_start = std::max(0.0, std::min(requested_loop_start_, duration));
+                loop_end = std::max(0.0, std::min(requested_loop_end_, duration));
+                // 太短的区间每一帧都在循环，当成不循环
+                if (loop_end - loop_start < PTS_EPS) {
+                    loop_start = loop_end = 0.0;
+                }
+            }
+            if (loop_start == loop_start_ && loop_end == loop_end_) {
+                return false;
+            }
+            loop_start_ = loop_start;
+            loop_end_ = loop_end;
+            video_decode_service_->SetLoopRegion(loop_start_, loop_end_);
+            audio_decode_service_.SetLoopRegion(loop_start_, loop_end_);
+            return true;
+        }
+
+        double NativeWSMediaPlayer::WrapLoopPos(double clock_pos) {
+            if (!loop_armed_ || clock_pos < loop_end_) {
+                return clock_pos;
+            }
+            return loop_start_ + fmod(clock_pos - loop_start_, loop_end_ - loop_start_);
+        }
+
         bool NativeWSMediaPlayer::paused() {
             std::lock_guard<std::mutex> lk(mutex_);
             return paused_;
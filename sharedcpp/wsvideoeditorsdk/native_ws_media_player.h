@@ -5,6 +5,7 @@
 #include "libffmpeg/config.h"
 #include <atomic>
 #include <wsvideoeditorsdk/audio_decode/audio_decode_service.h>
+#include <wsvideoeditorsdk/audio_decode/audio_waveform_service.h>
 
 #include "video_decode_service.h"
 #include "frame_renderer.h"
@@ -15,10 +16,50 @@
 #include "preview_timeline.h"
 #include "decode_service_common.h"
 #include "audio_player.h"
+#include "project_snapshot.h"
+#include "project_diff.h"
+#include "latency_histogram.h"
+#include "poster_frame_cache.h"
 
 namespace whensunset {
     namespace wsvideoeditor {
 
+        /**
+         * seek 的耗时统计，单位毫秒。first_frame_latency 是 seek 位置的第一帧解码出来的耗时，
+         * ready_latency 是音视频都准备好、可以继续播放的耗时。连续的 seek 被合并的时候，
+         * 从真正执行的那次 seek 调用开始算
+         */
+        struct SeekStats {
+            base::LatencyHistogram first_frame_latency;
+
+            base::LatencyHistogram ready_latency;
+
+            /**
+             * 被合并掉、没有真正让解码器 seek 的调用次数
+             */
+            int64_t coalesced_count = 0;
+        };
+
+        /**
+         * 第一帧的耗时统计，单位毫秒，还没有画出第一帧的时候是 -1
+         */
+        struct FirstFrameStats {
+            /**
+             * 第一次 SetProject 一个有素材的 project 到画出第一帧
+             */
+            double set_project_to_first_frame_ms = -1.0;
+
+            /**
+             * 第一次 attach 到画出第一帧
+             */
+            double attach_to_first_frame_ms = -1.0;
+
+            /**
+             * 第一帧是 PosterFrameCache 里的封面帧，不是解码出来的
+             */
+            bool from_poster_frame = false;
+        };
+
         class NativeWSMediaPlayer {
         public:
             NativeWSMediaPlayer();
@@ -33,14 +74,86 @@ namespace whensunset {
 
             void OnDetachedFromController();
 
+            /**
+             * seek 到 @current_time，上一个 seek 的第一帧还没出来的时候只记下最后一次的位置，
+             * 等第一帧出来再 seek 过去，拖动进度条的时候解码器不会被一直打断。
+             * seek 过程中继续显示上一帧，ready state 不变，音视频都准备好之后才继续播放
+             */
             void Seek(double current_time);
 
+            SeekStats seek_stats() {
+                std::lock_guard<std::mutex> lk(mutex_);
+                return seek_stats_;
+            }
+
+            FirstFrameStats first_frame_stats() {
+                std::lock_guard<std::mutex> lk(mutex_);
+                return first_frame_stats_;
+            }
+
             void Play();
 
             void Pause();
 
             bool paused();
 
+            /**
+             * 开启代理文件预览，像素率超过 @pixel_rate_threshold 的素材会在后台转码到 @cache_dir
+             */
+            void EnableProxyMedia(const std::string &cache_dir,
+                                  double pixel_rate_threshold = kDefaultProxyPixelRateThreshold);
+
+            /**
+             * 开启音频 PCM 缓存，短素材、循环素材和频繁 seek 的素材会被完整解码缓存起来，
+             * 内存预算用完之后缓存到 @temp_dir 下的 mmap 临时文件
+             */
+            void EnableAudioPcmCache(const std::string &temp_dir,
+                                     int64_t ram_budget_bytes = kDefaultPcmCacheRamBudget);
+
+            /**
+             * 开启音频波形，project 里的素材会在后台分析出多级波形，结果缓存到 @cache_dir，
+             * 之后 setProject 新加的素材也会自动分析
+             */
+            void EnableAudioWaveform(const std::string &cache_dir);
+
+            /**
+             * 分析 @path 的波形，已经请求过的话什么都不做，没有开启音频波形的时候忽略
+             */
+            void RequestAudioWaveform(const std::string &path);
+
+            /**
+             * @path 的波形，还没分析完或者没有开启音频波形的时候返回 nullptr
+             */
+            std::shared_ptr<const AudioWaveform> GetAudioWaveform(const std::string &path);
+
+            /**
+             * 设置播放速度，范围 [kMinPlaybackRate, kMaxPlaybackRate]，音频变速不变调，
+             * 视频按照变速后的时钟丢帧或者重复帧
+             */
+            void SetPlaybackRate(double playback_rate);
+
+            /**
+             * 循环播放 [loop_start, loop_end)，区间会被限制在 project 的时长内。播放到 loop_end 的时候
+             * 无缝接着播 loop_start：解码线程提前解好 loop_start 的音视频，不清空帧队列，
+             * 也不 flush 音频设备。设置的时候已经过了 loop_end 就回到 loop_start，之后 seek 到
+             * loop_end 之后的位置会一直播到结尾，下次 seek 或者从头播放的时候再开始循环
+             */
+            void SetLoopRegion(double loop_start, double loop_end);
+
+            void ClearLoopRegion();
+
+            /**
+             * 第一次 attach 之前提前解码，默认开着，关掉之后 attach 了才开始解码。
+             * 用来对比第一帧耗时，要在第一次 SetProject 之前调用
+             */
+            void SetSpeculativeDecodeEnabled(bool enabled);
+
+            /**
+             * 用 PosterFrameCache 里的封面帧当第一帧，默认开着，关掉之后既不读也不写缓存。
+             * 用来对比第一帧耗时
+             */
+            void SetPosterFrameCacheEnabled(bool enabled);
+
             const model::EditorProject &project() {
                 std::lock_guard<std::mutex> lk(mutex_);
                 return project_;
@@ -55,17 +168,33 @@ namespace whensunset {
                 return attached_;
             }
 
+            /**
+             * 播放时钟的位置，循环过的时长也算在里面，@WrapLoopPos() 之后才是在 project 中的位置
+             */
             double GetRenderPos() {
                 if (seeking_) {
                     return current_time_;
                 }
+                if (!audio_clock_master_) {
+                    return GetSystemClockRenderPos();
+                }
                 return audio_player_->GetCurrentTimeSec(project_);
             }
 
         private:
             void UpdateReadyState(const PlayerReadyState &new_ready_state);
 
-            void SeekInternal(double render_pos);
+            void SeekInternal(double render_pos,
+                              std::chrono::steady_clock::time_point request_time =
+                              std::chrono::steady_clock::now());
+
+            /**
+             * DrawFrame 在 seek 过程中调用，@got_frame 是这次拿到了新的帧，@streams_ready 是
+             * 音视频缓存都够了，seek 完成的时候返回 true
+             */
+            bool UpdateSeekState(bool got_frame, bool streams_ready);
+
+            void RecordFirstFrame(bool from_poster_frame);
 
             void PauseInternal();
 
@@ -79,28 +208,125 @@ namespace whensunset {
 
             void RecalculateDecodeAndRenderState();
 
+            void UpdateClockMaster();
+
+            double GetSystemClockRenderPos();
+
+            double WrapLoopPos(double clock_pos);
+
+            /**
+             * 把循环区间限制在 project 的时长内再设置给解码服务，区间变了返回 true
+             */
+            bool ApplyLoopRegion();
+
+            /**
+             * 开启了音频波形的时候请求 @project 里所有素材的波形，需要持有 mutex_
+             */
+            void RequestAudioWaveforms(const model::EditorProject &project);
+
             bool is_render_paused_ = true;
 
             bool attached_ = false;
 
+            /**
+             * 第一次 attach 之前就开始解码，detach 之后就不再提前解码了
+             */
+            bool speculative_decode_ = true;
+
             bool ended_ = false;
 
             bool paused_ = true;
 
             bool seeking_ = false;
 
+            /**
+             * 当前 seek 位置的第一帧已经拿到了
+             */
+            bool seek_frame_shown_ = false;
+
+            std::chrono::steady_clock::time_point seek_request_time_;
+
+            /**
+             * 当前 seek 的第一帧出来之前又来的 seek，只保留最后一次
+             */
+            bool has_pending_seek_ = false;
+
+            double pending_seek_pos_ = 0.0;
+
+            std::chrono::steady_clock::time_point pending_seek_time_;
+
+            SeekStats seek_stats_;
+
+            /**
+             * 调用方设置的循环区间，loop_start_/loop_end_ 是限制在 project 时长内之后的
+             */
+            bool loop_enabled_ = false;
+
+            double requested_loop_start_ = 0.0;
+
+            double requested_loop_end_ = 0.0;
+
+            double loop_start_ = 0.0;
+
+            double loop_end_ = 0.0;
+
+            /**
+             * 上次 seek 的位置在 loop_end_ 之前，播放到 loop_end_ 的时候会循环，不会播放到结尾
+             */
+            bool loop_armed_ = false;
+
+            /**
+             * project_ 开头那一帧在 PosterFrameCache 中的 key，poster_frame_stored_ 是已经存进去了
+             */
+            uint64_t poster_key_ = 0;
+
+            bool poster_frame_stored_ = false;
+
+            bool poster_frame_cache_enabled_ = true;
+
+            bool first_frame_drawn_ = false;
+
+            std::chrono::steady_clock::time_point first_set_project_time_;
+
+            std::chrono::steady_clock::time_point first_attach_time_;
+
+            FirstFrameStats first_frame_stats_;
+
+            /**
+             * 有能听到的音频的时候用音频设备的播放位置当主时钟，否则 audio_ref_clock_
+             * 按照单调时钟自己走，音频解码和输出都停掉
+             */
+            bool audio_clock_master_ = true;
+
             mutable std::mutex mutex_;
 
             double current_time_ = 0.0;
 
             FrameRenderer frame_renderer_;
 
+            std::unique_ptr<ProxyMediaService> proxy_media_service_;
+
+            std::unique_ptr<AudioWaveformService> audio_waveform_service_;
+
             std::unique_ptr<VideoDecodeService> video_decode_service_;
 
-            std::unique_ptr<PreviewTimeline> preview_time_line_;
+            /**
+             * project_ 的时间线，渲染和视频解码线程共用
+             */
+            SharedPreviewTimeline preview_time_line_;
 
             model::EditorProject project_;
 
+            /**
+             * project_ 发布出去的不可变快照，渲染线程和消息线程读它，不用拷贝 project_
+             */
+            ProjectSnapshotHolder project_snapshot_;
+
+            /**
+             * project_ 的摘要，SetProject 的时候和新的 project 比较
+             */
+            ProjectFingerprint project_fingerprint_;
+
             std::unique_ptr<AudioPlayer> audio_player_;
 
             AudioDecodeService audio_decode_service_;
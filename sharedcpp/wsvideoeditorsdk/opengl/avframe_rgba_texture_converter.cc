@@ -1,4 +1,5 @@
 #include "avframe_rgba_texture_converter.h"
+#include <algorithm>
 #include <memory>
 #include "ws_editor_video_sdk_utils.h"
 #include "base/platform_logger.h"
@@ -42,22 +43,51 @@ namespace whensunset {
                                                                        frame_height, rotation);
             }
 
+            // 输出的纹理比帧小的时候转换的同时缩小，上传的数据量也跟着变小，旋转还是交给 shader
+            int yuv_width = std::max(2, std::min(frame->width, frame_width) & ~1);
+            int yuv_height = std::max(2, std::min(frame->height, frame_height) & ~1);
+            AVFrame *yuv_frame = GetTmpYuvFrame(yuv_width, yuv_height);
+            if (!yuv_frame) {
+                return UniqueWsTextureCreateNull();
+            }
+            yuv_frame->color_range = frame->color_range;
+            yuv_frame->colorspace = frame->colorspace;
+
+            int ret = libyuv_converter_.Convert(frame, yuv_frame);
+            if (ret == AVERROR(ENOSYS)) {
+                sws_context_ = sws_getCachedContext(sws_context_,
+                                                    frame->width, frame->height,
+                                                    (AVPixelFormat) frame->format,
+                                                    yuv_width, yuv_height, AV_PIX_FMT_YUV420P,
+                                                    SWS_FAST_BILINEAR, NULL, NULL, NULL);
+                if (!sws_context_) {
+                    LOGE("AVFrameRgbaTextureConverter::Convert sws_getCachedContext failed "
+                         "format:%d", frame->format);
+                    return UniqueWsTextureCreateNull();
+                }
+                ret = sws_scale(sws_context_, (const uint8_t *const *) frame->data,
+                                frame->linesize, 0, frame->height, yuv_frame->data,
+                                yuv_frame->linesize);
+            }
+            if (ret < 0) {
+                LOGE("AVFrameRgbaTextureConverter::Convert convert to yuv420p failed format:%d, "
+                     "ret:%d", frame->format, ret);
+                return UniqueWsTextureCreateNull();
+            }
+            return shader_program_pool_->GetYuv420ToRgbProgram()->Run(yuv_frame, frame_width,
+                                                                      frame_height, rotation);
+        }
 
-            sws_context_ = sws_getCachedContext(sws_context_,
-                                                frame->width, frame->height,
-                                                (AVPixelFormat) frame->format,
-                                                frame->width, frame->height, AV_PIX_FMT_YUV420P,
-                                                SWS_FAST_BILINEAR, NULL, NULL, NULL);
-            if (!tmp_yuv_frame_) {
-                tmp_yuv_frame_.reset(
-                        AllocVideoFrame(AV_PIX_FMT_YUV420P, frame->width, frame->height));
+        AVFrame *AVFrameRgbaTextureConverter::GetTmpYuvFrame(int width, int height) {
+            if (!tmp_yuv_frame_ || tmp_yuv_frame_->width != width ||
+                tmp_yuv_frame_->height != height) {
+                tmp_yuv_frame_.reset(AllocVideoFrame(AV_PIX_FMT_YUV420P, width, height));
+                if (!tmp_yuv_frame_) {
+                    LOGE("AVFrameRgbaTextureConverter::GetTmpYuvFrame OOM width:%d, height:%d",
+                         width, height);
+                }
             }
-            sws_scale(sws_context_, (const uint8_t *const *) frame->data, frame->linesize, 0,
-                      frame->height,
-                      tmp_yuv_frame_->data, tmp_yuv_frame_->linesize);
-            return shader_program_pool_->GetYuv420ToRgbProgram()->Run(tmp_yuv_frame_.get(),
-                                                                      frame_width, frame_height,
-                                                                      rotation);
+            return tmp_yuv_frame_.get();
         }
     }
 }
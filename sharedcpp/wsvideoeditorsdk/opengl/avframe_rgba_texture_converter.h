@@ -3,6 +3,7 @@
 
 #include "shader_program_pool.h"
 #include "av_utils.h"
+#include "libyuv_i420_converter.h"
 
 extern "C" {
 #include "libswscale/swscale.h"
@@ -21,10 +22,21 @@ namespace whensunset {
             ~AVFrameRgbaTextureConverter();
 
         private:
+            /**
+             * 返回 @width x @height 的 I420 临时帧，分辨率变了就重新分配
+             */
+            AVFrame *GetTmpYuvFrame(int width, int height);
+
             ShaderProgramPool *shader_program_pool_;
 
             SwsContext *sws_context_ = nullptr;
 
+            /**
+             * Yuv420ToRgbProgram 不能直接画的格式先转换到 tmp_yuv_frame_，
+             * libyuv 支持的格式用 libyuv，其他的用 sws_scale
+             */
+            LibyuvI420Converter libyuv_converter_;
+
             UniqueAVFramePtr tmp_yuv_frame_{nullptr, FreeAVFrame};
 
         };
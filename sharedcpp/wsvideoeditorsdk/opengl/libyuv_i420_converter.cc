@@ -0,0 +1,144 @@
+#include "libyuv_i420_converter.h"
+#include "libyuv/convert.h"
+#include "libyuv/scale.h"
+#include "base/platform_logger.h"
+
+namespace whensunset {
+    namespace wsvideoeditor {
+
+        bool LibyuvI420Converter::IsSupported(int pix_fmt) {
+            switch (pix_fmt) {
+                case AV_PIX_FMT_NV12:
+                case AV_PIX_FMT_NV21:
+                case AV_PIX_FMT_YUV422P:
+                case AV_PIX_FMT_YUVJ422P:
+                case AV_PIX_FMT_YUV444P:
+                case AV_PIX_FMT_YUVJ444P:
+                case AV_PIX_FMT_ARGB:
+                case AV_PIX_FMT_0RGB:
+                case AV_PIX_FMT_ABGR:
+                case AV_PIX_FMT_0BGR:
+                case AV_PIX_FMT_BGRA:
+                case AV_PIX_FMT_BGR0:
+                case AV_PIX_FMT_RGBA:
+                case AV_PIX_FMT_RGB0:
+                case AV_PIX_FMT_RGB24:
+                case AV_PIX_FMT_BGR24:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        int LibyuvI420Converter::Convert(const AVFrame *src, AVFrame *dst) {
+            if (!IsSupported(src->format)) {
+                return AVERROR(ENOSYS);
+            }
+            if (dst->width == src->width && dst->height == src->height) {
+                return ConvertSameSize(src, dst);
+            }
+
+            if (!full_size_frame_ || full_size_frame_->width != src->width ||
+                full_size_frame_->height != src->height) {
+                full_size_frame_.reset(
+                        AllocVideoFrame(AV_PIX_FMT_YUV420P, src->width, src->height));
+                if (!full_size_frame_) {
+                    LOGE("LibyuvI420Converter::Convert OOM width:%d, height:%d", src->width,
+                         src->height);
+                    return AVERROR(ENOMEM);
+                }
+            }
+            int ret = ConvertSameSize(src, full_size_frame_.get());
+            if (ret < 0) {
+                return ret;
+            }
+            ret = libyuv::I420Scale(full_size_frame_->data[0], full_size_frame_->linesize[0],
+                                    full_size_frame_->data[1], full_size_frame_->linesize[1],
+                                    full_size_frame_->data[2], full_size_frame_->linesize[2],
+                                    src->width, src->height,
+                                    dst->data[0], dst->linesize[0],
+                                    dst->data[1], dst->linesize[1],
+                                    dst->data[2], dst->linesize[2],
+                                    dst->width, dst->height, libyuv::kFilterBilinear);
+            return ret < 0 ? AVERROR(EINVAL) : 0;
+        }
+
+        int LibyuvI420Converter::ConvertSameSize(const AVFrame *src, AVFrame *dst) {
+            uint8_t *dst_y = dst->data[0], *dst_u = dst->data[1], *dst_v = dst->data[2];
+            int dst_stride_y = dst->linesize[0], dst_stride_u = dst->linesize[1],
+                    dst_stride_v = dst->linesize[2];
+            int width = src->width, height = src->height;
+            int ret = 0;
+            // libyuv 的 RGB 格式名是按照小端 32 位整数从高位到低位起的，
+            // 和 ffmpeg 按照内存字节顺序起的名字正好相反
+            switch (src->format) {
+                case AV_PIX_FMT_NV12:
+                    ret = libyuv::NV12ToI420(src->data[0], src->linesize[0], src->data[1],
+                                             src->linesize[1], dst_y, dst_stride_y, dst_u,
+                                             dst_stride_u, dst_v, dst_stride_v, width, height);
+                    break;
+                case AV_PIX_FMT_NV21:
+                    ret = libyuv::NV21ToI420(src->data[0], src->linesize[0], src->data[1],
+                                             src->linesize[1], dst_y, dst_stride_y, dst_u,
+                                             dst_stride_u, dst_v, dst_stride_v, width, height);
+                    break;
+                case AV_PIX_FMT_YUV422P:
+                case AV_PIX_FMT_YUVJ422P:
+                    ret = libyuv::I422ToI420(src->data[0], src->linesize[0], src->data[1],
+                                             src->linesize[1], src->data[2], src->linesize[2],
+                                             dst_y, dst_stride_y, dst_u, dst_stride_u, dst_v,
+                                             dst_stride_v, width, height);
+                    break;
+                case AV_PIX_FMT_YUV444P:
+                case AV_PIX_FMT_YUVJ444P:
+                    ret = libyuv::I444ToI420(src->data[0], src->linesize[0], src->data[1],
+                                             src->linesize[1], src->data[2], src->linesize[2],
+                                             dst_y, dst_stride_y, dst_u, dst_stride_u, dst_v,
+                                             dst_stride_v, width, height);
+                    break;
+                case AV_PIX_FMT_ARGB:
+                case AV_PIX_FMT_0RGB:
+                    ret = libyuv::BGRAToI420(src->data[0], src->linesize[0], dst_y, dst_stride_y,
+                                             dst_u, dst_stride_u, dst_v, dst_stride_v, width,
+                                             height);
+                    break;
+                case AV_PIX_FMT_ABGR:
+                case AV_PIX_FMT_0BGR:
+                    ret = libyuv::RGBAToI420(src->data[0], src->linesize[0], dst_y, dst_stride_y,
+                                             dst_u, dst_stride_u, dst_v, dst_stride_v, width,
+                                             height);
+                    break;
+                case AV_PIX_FMT_BGRA:
+                case AV_PIX_FMT_BGR0:
+                    ret = libyuv::ARGBToI420(src->data[0], src->linesize[0], dst_y, dst_stride_y,
+                                             dst_u, dst_stride_u, dst_v, dst_stride_v, width,
+                                             height);
+                    break;
+                case AV_PIX_FMT_RGBA:
+                case AV_PIX_FMT_RGB0:
+                    ret = libyuv::ABGRToI420(src->data[0], src->linesize[0], dst_y, dst_stride_y,
+                                             dst_u, dst_stride_u, dst_v, dst_stride_v, width,
+                                             height);
+                    break;
+                case AV_PIX_FMT_RGB24:
+                    ret = libyuv::RAWToI420(src->data[0], src->linesize[0], dst_y, dst_stride_y,
+                                            dst_u, dst_stride_u, dst_v, dst_stride_v, width,
+                                            height);
+                    break;
+                case AV_PIX_FMT_BGR24:
+                    ret = libyuv::RGB24ToI420(src->data[0], src->linesize[0], dst_y, dst_stride_y,
+                                              dst_u, dst_stride_u, dst_v, dst_stride_v, width,
+                                              height);
+                    break;
+                default:
+                    return AVERROR(ENOSYS);
+            }
+            if (ret < 0) {
+                LOGE("LibyuvI420Converter::ConvertSameSize failed format:%d, width:%d, height:%d",
+                     src->format, width, height);
+                return AVERROR(EINVAL);
+            }
+            return 0;
+        }
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef SHAREDCPP_WS_VIDEO_EDITOR_OPENGL_LIBYUV_I420_CONVERTER_H
+#define SHAREDCPP_WS_VIDEO_EDITOR_OPENGL_LIBYUV_I420_CONVERTER_H
+
+#include "av_utils.h"
+
+namespace whensunset {
+    namespace wsvideoeditor {
+
+        /**
+         * 用 libyuv 把 Yuv420ToRgbShaderProgram 不能直接画的帧转换成 I420，libyuv 的行函数有 NEON 实现，
+         * 比 sws_scale 快得多。支持 NV12/NV21、YUV422P、YUV444P、ARGB/ABGR/RGB0 等 32 位 RGB 和 RGB24/BGR24
+         */
+        class LibyuvI420Converter final {
+        public:
+            static bool IsSupported(int pix_fmt);
+
+            /**
+             * 把 @src 转换到 @dst 里，@dst 必须是已经分配好内存的 AV_PIX_FMT_YUV420P 帧，
+             * 宽高比 @src 小的时候同时双线性缩放，上传纹理的数据量也跟着变小
+             * @return 0 成功，AVERROR(ENOSYS) 表示不支持 @src 的格式，其他负数是转换失败
+             */
+            int Convert(const AVFrame *src, AVFrame *dst);
+
+        private:
+            int ConvertSameSize(const AVFrame *src, AVFrame *dst);
+
+            /**
+             * 需要缩放的时候先转换成原始大小的 I420 放在这里
+             */
+            UniqueAVFramePtr full_size_frame_{nullptr, FreeAVFrame};
+        };
+    }
+}
+
+#endif
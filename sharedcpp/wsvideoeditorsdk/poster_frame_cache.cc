@@ -0,0 +1,62 @@
+#include "poster_frame_cache.h"
+#include "platform_logger.h"
+
+namespace whensunset {
+    namespace wsvideoeditor {
+
+        PosterFrameCache &PosterFrameCache::Instance() {
+            static PosterFrameCache instance;
+            return instance;
+        }
+
+        void PosterFrameCache::Put(uint64_t key, const AVFrame *frame) {
+            if (key == 0 || !frame) {
+                return;
+            }
+            UniqueAVFramePtr poster_frame{av_frame_clone(frame), FreeAVFrame};
+            if (!poster_frame) {
+                LOGE("PosterFrameCache::Put OOM");
+                return;
+            }
+            std::lock_guard<std::mutex> lk(mutex_);
+            for (auto it = frames_.begin(); it != frames_.end(); ++it) {
+                if (it->first == key) {
+                    frames_.erase(it);
+                    break;
+                }
+            }
+            frames_.emplace_front(key, std::move(poster_frame));
+            while (frames_.size() > kPosterFrameCacheCapacity) {
+                frames_.pop_back();
+            }
+            LOGI("PosterFrameCache::Put key:%llu, size:%d", (unsigned long long) key,
+                 (int) frames_.size());
+        }
+
+        UniqueAVFramePtr PosterFrameCache::Get(uint64_t key) {
+            std::lock_guard<std::mutex> lk(mutex_);
+            for (auto it = frames_.begin(); it != frames_.end(); ++it) {
+                if (it->first != key) {
+                    continue;
+                }
+                UniqueAVFramePtr poster_frame{av_frame_clone(it->second.get()), FreeAVFrame};
+                if (!poster_frame) {
+                    LOGE("PosterFrameCache::Get OOM");
+                }
+                frames_.splice(frames_.begin(), frames_, it);
+                return poster_frame;
+            }
+            return UniqueAVFramePtrCreateNull();
+        }
+
+        bool PosterFrameCache::Contains(uint64_t key) {
+            std::lock_guard<std::mutex> lk(mutex_);
+            for (const auto &entry : frames_) {
+                if (entry.first == key) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    }
+}
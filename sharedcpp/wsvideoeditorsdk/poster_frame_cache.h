@@ -0,0 +1,45 @@
+#ifndef SHAREDCPP_WS_VIDEO_EDITOR_POSTER_FRAME_CACHE_H
+#define SHAREDCPP_WS_VIDEO_EDITOR_POSTER_FRAME_CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <utility>
+#include "av_utils.h"
+
+namespace whensunset {
+    namespace wsvideoeditor {
+
+        const int kPosterFrameCacheCapacity = 3;
+
+        /**
+         * 进程内共享的 project 封面帧缓存，key 是 ProjectPosterKey，保存 project 开头的那一帧。
+         * 重新打开同一个 project 的时候，attach 之后第一次 DrawFrame 不用等解码就有帧可以画。
+         * 解码出来的帧是引用计数的，存一帧只是多一个引用，只保留最近用过的几个 project
+         */
+        class PosterFrameCache {
+        public:
+            static PosterFrameCache &Instance();
+
+            void Put(uint64_t key, const AVFrame *frame);
+
+            /**
+             * 返回 @key 对应的帧的一个引用，没有的时候返回空
+             */
+            UniqueAVFramePtr Get(uint64_t key);
+
+            bool Contains(uint64_t key);
+
+        private:
+            PosterFrameCache() = default;
+
+            std::mutex mutex_;
+
+            /**
+             * 最近用过的在前面
+             */
+            std::list<std::pair<uint64_t, UniqueAVFramePtr>> frames_;
+        };
+    }
+}
+#endif
@@ -1,22 +1,59 @@
+#include <algorithm>
 #include "constants.h"
-#include "ws_editor_video_sdk_utils.h"
 #include "preview_timeline.h"
-#include "frame_renderer.h"
 
 namespace whensunset {
     namespace wsvideoeditor {
+        // 素材在时间线上实际使用的区间，只取第一个剪裁区间，并且限制在文件时长以内，没有剪裁的话就是整个文件
+        model::TimeRange MediaAssetClippedRange(const model::MediaAsset &asset) {
+            double file_duration = asset.media_asset_file_holder().duration();
+            model::TimeRange clipped_range;
+            clipped_range.set_start(0.0);
+            clipped_range.set_duration(file_duration);
+            if (asset.clipped_time_range_size() == 0 || file_duration < TIME_EPS) {
+                return clipped_range;
+            }
+            const model::TimeRange &range = asset.clipped_time_range(0);
+            double start = fmin(fmax(range.start(), 0.0), file_duration);
+            double duration = file_duration - start;
+            if (range.duration() > TIME_EPS) {
+                duration = fmin(range.duration(), duration);
+            }
+            clipped_range.set_start(start);
+            clipped_range.set_duration(duration);
+            clipped_range.set_id(range.id());
+            return clipped_range;
+        }
+
         std::vector<MediaAssetSegment>
         CalculateMediaAssetToSegment(const model::EditorProject &project) {
             std::vector<MediaAssetSegment> segments;
-            int startPos = 0;
+            segments.reserve(project.media_asset_size());
+            // 每个素材的时长单独取整成 tick 再累加，素材再多开始时间也不会漂
+            base::MediaTicks start_ticks = 0;
             for (int i = 0; i < project.media_asset_size(); ++i) {
-                const model::MediaAsset mediaAsset = project.media_asset(i);
-                double duration = mediaAsset.media_asset_file_holder().duration();
+                const model::MediaAsset &mediaAsset = project.media_asset(i);
+                model::TimeRange clipped_range = MediaAssetClippedRange(mediaAsset);
+                base::MediaTicks duration_ticks = base::SecToTicks(clipped_range.duration());
                 segments.push_back(
-                        MediaAssetSegment(i, mediaAsset.asset_id(), startPos, startPos + duration));
-                startPos += duration;
+                        MediaAssetSegment(i, mediaAsset.asset_id(), start_ticks,
+                                          start_ticks + duration_ticks,
+                                          base::SecToTicks(clipped_range.start())));
+                start_ticks += duration_ticks;
             }
             return segments;
         }
+
+        int PreviewTimeline::GetSegmentIndexFromRenderTicks(base::MediaTicks render_ticks) const {
+            // 第一个结束时间大于 render_ticks 的片段，它的开始时间也要在 render_ticks 附近才算包含
+            int index = static_cast<int>(std::upper_bound(segment_end_pos_.begin(),
+                                                          segment_end_pos_.end(), render_ticks) -
+                                         segment_end_pos_.begin());
+            if (index < segments_.size() &&
+                render_ticks + base::kTimeEpsTicks > segments_[index].start_ticks()) {
+                return index;
+            }
+            return static_cast<int>(segments_.size()) - 1;
+        }
     }
 }
@@ -3,8 +3,10 @@
 
 #include "platform_logger.h"
 #include "constants.h"
+#include "media_time.h"
 #include <math.h>
 #include <wsvideoeditorsdk/prebuilt_protobuf/ws_video_editor_sdk.pb.h>
+#include <memory>
 #include <vector>
 #include <string>
 
@@ -13,12 +15,14 @@ namespace whensunset {
 
         class MediaAssetSegment {
         public:
-            MediaAssetSegment(int asset_index = 0, int64_t asset_id = 0, double start_pos = 0.0,
-                              double end_pos = 0.0) {
+            MediaAssetSegment(int asset_index = 0, int64_t asset_id = 0,
+                              base::MediaTicks start_ticks = 0, base::MediaTicks end_ticks = 0,
+                              base::MediaTicks clipped_start_ticks = 0) {
                 media_asset_index_ = asset_index;
                 asset_id_ = asset_id;
-                start_pos_ = start_pos;
-                end_pos_ = end_pos;
+                start_ticks_ = start_ticks;
+                end_ticks_ = end_ticks;
+                clipped_start_ticks_ = clipped_start_ticks;
             }
 
             int64_t asset_id() const {
@@ -29,22 +33,38 @@ namespace whensunset {
                 return media_asset_index_;
             }
 
+            base::MediaTicks start_ticks() const {
+                return start_ticks_;
+            }
+
+            base::MediaTicks end_ticks() const {
+                return end_ticks_;
+            }
+
+            base::MediaTicks clipped_start_ticks() const {
+                return clipped_start_ticks_;
+            }
+
             double start_pos() const {
-                return start_pos_;
+                return base::TicksToSec(start_ticks_);
             }
 
             double end_pos() const {
-                return end_pos_;
+                return base::TicksToSec(end_ticks_);
+            }
+
+            double clipped_start_pos() const {
+                return base::TicksToSec(clipped_start_ticks_);
             }
 
             double preview_duration() const {
-                return end_pos_ - start_pos_;
+                return base::TicksToSec(end_ticks_ - start_ticks_);
             }
 
             std::string ToString() {
                 return ("media_asset_index_:" + std::to_string(media_asset_index_) + ",asset_id_:" +
-                        std::to_string(asset_id_) + ",start_pos_:" + std::to_string(start_pos_) +
-                        ",end_pos_:" + std::to_string(end_pos_));
+                        std::to_string(asset_id_) + ",start_ticks_:" +
+                        std::to_string(start_ticks_) + ",end_ticks_:" + std::to_string(end_ticks_));
             }
 
         private:
@@ -55,17 +75,28 @@ namespace whensunset {
             /**
              * 当前片段在整个 project 中的开始时间
              */
-            double start_pos_;
+            base::MediaTicks start_ticks_;
 
             /**
              * 当前片段在整个 project 中的结束事件
              */
-            double end_pos_;
+            base::MediaTicks end_ticks_;
+
+            /**
+             * 当前片段的剪裁区间在素材文件中的开始时间
+             */
+            base::MediaTicks clipped_start_ticks_;
         };
 
+        model::TimeRange MediaAssetClippedRange(const model::MediaAsset &asset);
+
         std::vector<MediaAssetSegment>
         CalculateMediaAssetToSegment(const model::EditorProject &project);
 
+        /**
+         * project 的时间线索引，每个素材一个片段，按照开始时间排好序，按时间查找都是二分。
+         * 创建之后不会再改，同一个 project 只建一次，播放器、渲染和解码线程共用一份
+         */
         class PreviewTimeline {
         public:
             PreviewTimeline(const model::EditorProject &project) {
@@ -73,37 +104,44 @@ namespace whensunset {
                     LOGE("PreviewTimeline error media asset size is 0");
                 } else {
                     segments_ = CalculateMediaAssetToSegment(project);
-                    accumulated_duration_.push_back(0);
-                    for (int i = 0; i < segments_.size(); ++i) {
-                        accumulated_duration_.push_back(
-                                accumulated_duration_.back() + segments_[i].preview_duration());
+                    segment_end_pos_.reserve(segments_.size());
+                    for (const MediaAssetSegment &segment : segments_) {
+                        segment_end_pos_.push_back(segment.end_ticks());
                     }
                 }
             }
 
-            MediaAssetSegment GetSegmentFromRenderPos(double render_pos) {
+            /**
+             * 包含 @render_pos 的片段，开始位置有 kTimeEpsTicks 的容差，超出时间线的时候返回最后一个片段
+             */
+            MediaAssetSegment GetSegmentFromRenderPos(double render_pos) const {
                 if (segments_.empty()) {
                     return MediaAssetSegment();
                 }
-                for (int i = 0; i < segments_.size(); i++) {
-                    if ((render_pos + TIME_EPS) > segments_[i].start_pos() &&
-                        render_pos < segments_[i].end_pos()) {
-                        return segments_[i];
-                    }
+                return segments_[GetSegmentIndexFromRenderTicks(base::SecToTicks(render_pos))];
+            }
+
+            int GetSegmentIndexFromRenderPos(double render_pos) const {
+                return GetSegmentIndexFromRenderTicks(base::SecToTicks(render_pos));
+            }
+
+            int GetSegmentIndexFromRenderTicks(base::MediaTicks render_ticks) const;
+
+            int GetMediaAssetIndexByRenderPos(double render_pos) const {
+                if (segments_.empty()) {
+                    return -1;
                 }
-                return segments_.back();
+                return segments_[GetSegmentIndexFromRenderPos(render_pos)].media_asset_index();
             }
 
-            bool IsLastSegment(MediaAssetSegment current_segment) {
+            bool IsLastSegment(const MediaAssetSegment &current_segment) const {
                 if (segments_.empty()) {
                     return false;
                 }
-                MediaAssetSegment last_segment = segments_.back();
-                return fabs(last_segment.start_pos() - current_segment.start_pos()) < TIME_EPS &&
-                       fabs(last_segment.end_pos() - current_segment.end_pos()) < TIME_EPS;
+                return GetSegmentIndexInTimeline(current_segment) == segments_.size() - 1;
             }
 
-            MediaAssetSegment GetNextSegmentInTimeline(MediaAssetSegment current_segment) {
+            MediaAssetSegment GetNextSegmentInTimeline(const MediaAssetSegment &current_segment) const {
                 if (segments_.empty()) {
                     return MediaAssetSegment();
                 }
@@ -114,21 +152,98 @@ namespace whensunset {
                 return segments_[segment_index + 1];
             }
 
+            MediaAssetSegment
+            GetPreviousSegmentInTimeline(const MediaAssetSegment &current_segment) const {
+                if (segments_.empty()) {
+                    return MediaAssetSegment();
+                }
+                int segment_index = GetSegmentIndexInTimeline(current_segment);
+                if (segment_index <= 0) {
+                    return segments_.back();
+                }
+                return segments_[segment_index - 1];
+            }
+
+            /**
+             * 下标为 @asset_index 的素材在 project 中的开始时间
+             */
+            double MediaAssetStartPos(int asset_index) const {
+                if (asset_index < 0 || asset_index >= segments_.size()) {
+                    return 0.0;
+                }
+                return segments_[asset_index].start_pos();
+            }
+
+            /**
+             * project 时间和素材文件时间之间的转换，按 tick 加减，不会有误差
+             */
+            base::MediaTicks
+            ProjectTicksToAssetTicks(base::MediaTicks project_ticks, int asset_index) const {
+                if (asset_index < 0 || asset_index >= segments_.size()) {
+                    return 0;
+                }
+                const MediaAssetSegment &segment = segments_[asset_index];
+                return project_ticks - segment.start_ticks() + segment.clipped_start_ticks();
+            }
+
+            base::MediaTicks
+            AssetTicksToProjectTicks(base::MediaTicks asset_ticks, int asset_index) const {
+                if (asset_index < 0 || asset_index >= segments_.size()) {
+                    return 0;
+                }
+                const MediaAssetSegment &segment = segments_[asset_index];
+                return asset_ticks - segment.clipped_start_ticks() + segment.start_ticks();
+            }
+
+            double ProjectRenderPosToAssetRenderPos(double project_pts, int asset_index) const {
+                return base::TicksToSec(
+                        ProjectTicksToAssetTicks(base::SecToTicks(project_pts), asset_index));
+            }
+
+            double AssetRenderPosToProjectRenderPos(double asset_pts, int asset_index) const {
+                return base::TicksToSec(
+                        AssetTicksToProjectTicks(base::SecToTicks(asset_pts), asset_index));
+            }
+
+            double duration() const {
+                return base::TicksToSec(duration_ticks());
+            }
+
+            base::MediaTicks duration_ticks() const {
+                return segment_end_pos_.empty() ? 0 : segment_end_pos_.back();
+            }
+
+            int segment_count() const {
+                return static_cast<int>(segments_.size());
+            }
+
         private:
-            int GetSegmentIndexInTimeline(MediaAssetSegment current_segment) {
-                for (int i = 0; i < segments_.size(); i++) {
-                    if (fabs(segments_[i].start_pos() - current_segment.start_pos()) < TIME_EPS &&
-                        fabs(segments_[i].end_pos() - current_segment.end_pos()) < TIME_EPS) {
-                        return i;
-                    }
+            /**
+             * 每个素材正好一个片段，片段的下标就是素材的下标，asset_id 对不上说明片段是别的时间线的，
+             * 再按开始时间找
+             */
+            int GetSegmentIndexInTimeline(const MediaAssetSegment &current_segment) const {
+                int index = current_segment.media_asset_index();
+                if (index >= 0 && index < segments_.size() &&
+                    segments_[index].asset_id() == current_segment.asset_id()) {
+                    return index;
+                }
+                int found = GetSegmentIndexFromRenderTicks(current_segment.start_ticks());
+                if (segments_[found].asset_id() == current_segment.asset_id()) {
+                    return found;
                 }
                 return -1;
             }
 
             std::vector<MediaAssetSegment> segments_;
-            std::vector<double> accumulated_duration_;
+
+            /**
+             * segments_ 的结束时间，片段首尾相接所以是有序的，用来二分查找
+             */
+            std::vector<base::MediaTicks> segment_end_pos_;
         };
 
+        typedef std::shared_ptr<const PreviewTimeline> SharedPreviewTimeline;
 
     }  // namespace wsvideoeditor
 }  // namespace whensunset
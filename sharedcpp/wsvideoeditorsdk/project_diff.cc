@@ -0,0 +1,137 @@
+#include "project_diff.h"
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <unordered_map>
+#include "constants.h"
+#include "ws_editor_video_sdk_utils.h"
+
+namespace whensunset {
+    namespace wsvideoeditor {
+
+        const uint64_t kFnvOffsetBasis = 14695981039346656037ULL;
+
+        const uint64_t kFnvPrime = 1099511628211ULL;
+
+        static uint64_t HashBytes(uint64_t hash, const void *data, size_t size) {
+            const uint8_t *bytes = static_cast<const uint8_t *>(data);
+            for (size_t i = 0; i < size; ++i) {
+                hash = (hash ^ bytes[i]) * kFnvPrime;
+            }
+            return hash;
+        }
+
+        template<typename T>
+        static uint64_t HashValue(uint64_t hash, const T &value) {
+            return HashBytes(hash, &value, sizeof(value));
+        }
+
+        static uint64_t HashString(uint64_t hash, const std::string &value) {
+            // 长度也算进去，避免两个字符串拼起来相同
+            hash = HashValue(hash, value.size());
+            return HashBytes(hash, value.data(), value.size());
+        }
+
+        ProjectFingerprint FingerprintProject(const model::EditorProject &project) {
+            ProjectFingerprint fingerprint;
+            // input_media_assets_number 每次 LoadProject 都会被重置成素材个数，不能算进来，
+            // 素材个数的变化交给逐个素材的 diff 去报告
+            fingerprint.project_hash = HashValue(kFnvOffsetBasis, project.project_id());
+            fingerprint.assets.reserve(project.media_asset_size());
+            double start_pos = 0.0;
+            for (const model::MediaAsset &asset : project.media_asset()) {
+                AssetFingerprint asset_fingerprint;
+                asset_fingerprint.asset_id = asset.asset_id();
+
+                uint64_t content_hash = HashString(kFnvOffsetBasis, asset.asset_path());
+                content_hash = HashValue(content_hash, asset.media_asset_scale_type());
+                asset_fingerprint.content_hash = HashValue(content_hash, asset.alpha_info());
+
+                // 用实际生效的剪裁区间，文件时长变了也算剪裁区间变了
+                model::TimeRange clipped_range = MediaAssetClippedRange(asset);
+                uint64_t clip_hash = HashValue(kFnvOffsetBasis, clipped_range.start());
+                asset_fingerprint.clip_hash = HashValue(clip_hash, clipped_range.duration());
+
+                asset_fingerprint.volume = asset.volume();
+                asset_fingerprint.start_pos = start_pos;
+                asset_fingerprint.duration = clipped_range.duration();
+                start_pos += clipped_range.duration();
+                fingerprint.assets.push_back(asset_fingerprint);
+            }
+            return fingerprint;
+        }
+
+        uint64_t ProjectPosterKey(const ProjectFingerprint &fingerprint) {
+            if (fingerprint.assets.empty()) {
+                return 0;
+            }
+            const AssetFingerprint &first_asset = fingerprint.assets.front();
+            uint64_t key = HashValue(kFnvOffsetBasis, fingerprint.project_hash);
+            key = HashValue(key, first_asset.content_hash);
+            return HashValue(key, first_asset.clip_hash);
+        }
+
+        ProjectDiff DiffProjects(const ProjectFingerprint &old_fingerprint,
+                                 const ProjectFingerprint &new_fingerprint) {
+            ProjectDiff diff;
+            if (old_fingerprint.project_hash != new_fingerprint.project_hash) {
+                diff.project_changed = true;
+                diff.first_timeline_change_pos = 0.0;
+                return diff;
+            }
+
+            // asset_id -> 旧 project 中还没有配对的下标
+            std::unordered_map<uint64_t, std::vector<int>> old_indexes;
+            for (int i = static_cast<int>(old_fingerprint.assets.size()) - 1; i >= 0; --i) {
+                old_indexes[old_fingerprint.assets[i].asset_id].push_back(i);
+            }
+            std::vector<bool> old_matched(old_fingerprint.assets.size(), false);
+
+            for (int i = 0; i < new_fingerprint.assets.size(); ++i) {
+                const AssetFingerprint &new_asset = new_fingerprint.assets[i];
+                auto old_index = old_indexes.find(new_asset.asset_id);
+                const AssetFingerprint *old_asset = nullptr;
+                int old_asset_index = -1;
+                if (old_index != old_indexes.end() && !old_index->second.empty()) {
+                    old_asset_index = old_index->second.back();
+                    old_asset = &old_fingerprint.assets[old_asset_index];
+                    if (old_asset->content_hash == new_asset.content_hash) {
+                        old_index->second.pop_back();
+                        old_matched[old_asset_index] = true;
+                    } else {
+                        old_asset = nullptr;
+                    }
+                }
+                if (!old_asset) {
+                    diff.inserted.push_back(new_asset.asset_id);
+                    diff.first_timeline_change_pos = std::min(diff.first_timeline_change_pos,
+                                                              new_asset.start_pos);
+                    continue;
+                }
+                double change_pos = std::min(old_asset->start_pos, new_asset.start_pos);
+                if (old_asset->clip_hash != new_asset.clip_hash) {
+                    diff.retimed.push_back(new_asset.asset_id);
+                    diff.first_timeline_change_pos = std::min(diff.first_timeline_change_pos,
+                                                              change_pos);
+                } else if (old_asset_index != i ||
+                           std::fabs(old_asset->start_pos - new_asset.start_pos) > TIME_EPS) {
+                    diff.moved.push_back(new_asset.asset_id);
+                    diff.first_timeline_change_pos = std::min(diff.first_timeline_change_pos,
+                                                              change_pos);
+                }
+                if (std::fabs(old_asset->volume - new_asset.volume) > 1e-3) {
+                    diff.volume_changed.push_back(new_asset.asset_id);
+                }
+            }
+
+            for (int i = 0; i < old_fingerprint.assets.size(); ++i) {
+                if (!old_matched[i]) {
+                    diff.removed.push_back(old_fingerprint.assets[i].asset_id);
+                    diff.first_timeline_change_pos = std::min(diff.first_timeline_change_pos,
+                                                              old_fingerprint.assets[i].start_pos);
+                }
+            }
+            return diff;
+        }
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef SHAREDCPP_WS_VIDEO_EDITOR_PROJECT_DIFF_H
+#define SHAREDCPP_WS_VIDEO_EDITOR_PROJECT_DIFF_H
+
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+#include <wsvideoeditorsdk/prebuilt_protobuf/ws_video_editor_sdk.pb.h>
+
+namespace whensunset {
+    namespace wsvideoeditor {
+
+        /**
+         * 一个素材在 project 中的摘要，比较两个 project 的时候只比较摘要
+         */
+        struct AssetFingerprint {
+            uint64_t asset_id = 0;
+
+            /**
+             * 路径、填充方式、alpha 信息的 hash，变了就当成删掉旧素材插入了新素材
+             */
+            uint64_t content_hash = 0;
+
+            /**
+             * 剪裁区间的 hash
+             */
+            uint64_t clip_hash = 0;
+
+            double volume = 0.0;
+
+            /**
+             * 在整个 project 中的开始时间和时长
+             */
+            double start_pos = 0.0;
+
+            double duration = 0.0;
+        };
+
+        struct ProjectFingerprint {
+            /**
+             * project_id 的 hash，变了就是整个 project 都变了
+             */
+            uint64_t project_hash = 0;
+
+            std::vector<AssetFingerprint> assets;
+        };
+
+        /**
+         * 两个 project 之间的变化，列表里都是 asset_id
+         */
+        struct ProjectDiff {
+            /**
+             * project_id 之类的整体信息变了，其他列表没有意义
+             */
+            bool project_changed = false;
+
+            std::vector<uint64_t> inserted;
+
+            std::vector<uint64_t> removed;
+
+            /**
+             * 自己没变，但是在时间线上的位置或者顺序变了
+             */
+            std::vector<uint64_t> moved;
+
+            /**
+             * 剪裁区间变了
+             */
+            std::vector<uint64_t> retimed;
+
+            std::vector<uint64_t> volume_changed;
+
+            /**
+             * 时间线上这个位置之前的内容两个 project 完全一样，没有时间线变化的时候是 DBL_MAX
+             */
+            double first_timeline_change_pos = DBL_MAX;
+
+            bool timeline_changed() const {
+                return project_changed || !inserted.empty() || !removed.empty() ||
+                       !moved.empty() || !retimed.empty();
+            }
+
+            bool empty() const {
+                return !timeline_changed() && volume_changed.empty();
+            }
+        };
+
+        ProjectFingerprint FingerprintProject(const model::EditorProject &project);
+
+        /**
+         * project 开头那一帧的 key，project 和第一个素材的内容、剪裁区间都没变的时候不变，
+         * 没有素材的时候是 0
+         */
+        uint64_t ProjectPosterKey(const ProjectFingerprint &fingerprint);
+
+        /**
+         * O(n) 比较两个摘要，同一个 asset_id 出现多次的时候按照顺序一一对应
+         */
+        ProjectDiff DiffProjects(const ProjectFingerprint &old_fingerprint,
+                                 const ProjectFingerprint &new_fingerprint);
+    }
+}
+#endif
@@ -0,0 +1,75 @@
+#ifndef SHAREDCPP_WS_VIDEO_EDITOR_PROJECT_SNAPSHOT_H
+#define SHAREDCPP_WS_VIDEO_EDITOR_PROJECT_SNAPSHOT_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include "ws_video_editor_sdk.pb.h"
+#include "platform_logger.h"
+
+namespace whensunset {
+    namespace wsvideoeditor {
+
+        /**
+         * 发布之后就不会再改的 project，多个线程共享同一份，不用每次都深拷贝
+         */
+        typedef std::shared_ptr<const model::EditorProject> ProjectSnapshot;
+
+        /**
+         * 保存当前的 project 快照，SetProject 的时候拷贝一次发布出去，热路径上只拷贝 shared_ptr。
+         * 每次发布版本号加一，判断 project 有没有变化只需要比较版本号
+         */
+        class ProjectSnapshotHolder {
+        public:
+            ProjectSnapshotHolder() : current_(new(std::nothrow) VersionedProject) {}
+
+            /**
+             * 发布 @project 的一份拷贝，返回新的版本号，OOM 的时候保留之前的快照
+             */
+            uint64_t Publish(const model::EditorProject &project) {
+                std::shared_ptr<VersionedProject> next(new(std::nothrow) VersionedProject);
+                if (!next) {
+                    LOGE("ProjectSnapshotHolder::Publish OOM");
+                    return version();
+                }
+                next->project = project;
+                next->version = next_version_.fetch_add(1) + 1;
+                std::atomic_store(&current_, std::shared_ptr<const VersionedProject>(next));
+                return next->version;
+            }
+
+            /**
+             * 当前的快照，@version 不为空的时候同时返回这个快照的版本号
+             */
+            ProjectSnapshot Get(uint64_t *version = nullptr) const {
+                std::shared_ptr<const VersionedProject> current = std::atomic_load(&current_);
+                if (!current) {
+                    if (version) {
+                        *version = 0;
+                    }
+                    return nullptr;
+                }
+                if (version) {
+                    *version = current->version;
+                }
+                return ProjectSnapshot(current, &current->project);
+            }
+
+            uint64_t version() const {
+                std::shared_ptr<const VersionedProject> current = std::atomic_load(&current_);
+                return current ? current->version : 0;
+            }
+
+        private:
+            struct VersionedProject {
+                model::EditorProject project;
+                uint64_t version = 0;
+            };
+
+            std::shared_ptr<const VersionedProject> current_;
+
+            std::atomic<uint64_t> next_version_{0};
+        };
+    }
+}
+#endif
@@ -1,32 +1,212 @@
 #ifndef SHAREDCPP_WS_VIDEO_EDITOR_REF_CLOCK_H
 #define SHAREDCPP_WS_VIDEO_EDITOR_REF_CLOCK_H
 
-#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include "ws_editor_video_sdk_utils.h"
+#include "media_time.h"
 #include <cmath>
+#include <cstdlib>
 
 namespace whensunset {
     namespace wsvideoeditor {
 
+        // 主时钟和观测值相差超过这个值就直接跳过去，否则慢慢追
+        const double kRefClockResyncThreshold = 0.1;
+
+        // 主时钟落后于观测值时每次追上的比例
+        const double kRefClockSlewFactor = 0.125;
+
+        /**
+         * 播放时钟，保存 (锚点 tick, 锚点单调时间, 速度)，运行中的时候按单调时钟外推，
+         * 两次 SetPts/Sync 之间也是平滑的，而不是跟着 AudioTrack 的播放位置一格一格地跳。
+         * 锚点和单调时钟都是微秒，外推是整数运算，只有速度不是 1 的时候取整一次。
+         *
+         * 读是无锁的 seqlock：写者把序号改成奇数，写完再改成偶数，读者读到的前后序号
+         * 不一致或者是奇数就重读。渲染、音频、解码线程可以随便读，不会互相阻塞。
+         *
+         * 没有 Start 过的时钟就是一个原子的 pts，AudioDecodeService 的写入位置就是这么用的。
+         * 只 Start 不 Sync 就是系统时钟主控，Sync 音频播放位置就是音频主控。
+         */
         class RefClock {
         public:
-            RefClock() : render_pos_(0.0) {}
+            RefClock() = default;
 
             virtual ~RefClock() {};
 
             double GetRenderPos() {
-                std::lock_guard<std::mutex> lk(mutex_);
-                return render_pos_;
+                return base::TicksToSec(GetRenderTicks());
+            }
+
+            base::MediaTicks GetRenderTicks() {
+                while (true) {
+                    uint32_t seq = seq_.load(std::memory_order_acquire);
+                    if (seq & 1) {
+                        continue;
+                    }
+                    base::MediaTicks anchor_ticks = anchor_ticks_.load(std::memory_order_relaxed);
+                    int64_t anchor_time_us = anchor_time_us_.load(std::memory_order_relaxed);
+                    double rate = rate_.load(std::memory_order_relaxed);
+                    bool running = running_.load(std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (seq_.load(std::memory_order_relaxed) == seq) {
+                        return Extrapolate(anchor_ticks, anchor_time_us, rate, running, NowUs());
+                    }
+                }
             }
 
+            /**
+             * 把时钟放到 @render_pos，运行状态不变，之前的观测值作废
+             */
             void SetPts(double render_pos) {
-                std::lock_guard<std::mutex> lk(mutex_);
-                render_pos_ = render_pos;
+                SetTicks(base::SecToTicks(render_pos));
+            }
+
+            void SetTicks(base::MediaTicks render_ticks) {
+                int64_t now_us = NowUs();
+                uint32_t seq = BeginWrite();
+                Anchor(render_ticks, now_us);
+                has_last_sync_ = false;
+                EndWrite(seq);
+            }
+
+            /**
+             * 设置外推速度，已经走过的时间按照之前的速度算
+             */
+            void SetRate(double rate) {
+                int64_t now_us = NowUs();
+                uint32_t seq = BeginWrite();
+                Anchor(ExtrapolateLocked(now_us), now_us);
+                rate_.store(rate, std::memory_order_relaxed);
+                EndWrite(seq);
+            }
+
+            /**
+             * 从当前位置开始按照单调时钟走
+             */
+            void Start() {
+                int64_t now_us = NowUs();
+                uint32_t seq = BeginWrite();
+                if (!running_.load(std::memory_order_relaxed)) {
+                    Anchor(anchor_ticks_.load(std::memory_order_relaxed), now_us);
+                    running_.store(true, std::memory_order_relaxed);
+                }
+                EndWrite(seq);
+            }
+
+            /**
+             * 停在当前外推出来的位置
+             */
+            void Pause() {
+                int64_t now_us = NowUs();
+                uint32_t seq = BeginWrite();
+                if (running_.load(std::memory_order_relaxed)) {
+                    Anchor(ExtrapolateLocked(now_us), now_us);
+                    running_.store(false, std::memory_order_relaxed);
+                }
+                has_last_sync_ = false;
+                EndWrite(seq);
+            }
+
+            /**
+             * 用主时钟源 (音频设备) 的观测位置 @master_pts 校准。观测值是一格一格变的，
+             * 而且是真实位置的下界：观测值第一次变化的时候开始走，之后观测值超前就直接
+             * 追上去，落后一点 (还没跳到下一格) 只按 kRefClockSlewFactor 慢慢往回拉，
+             * 差太多的时候直接跳过去
+             */
+            void Sync(double master_pts) {
+                base::MediaTicks master_ticks = base::SecToTicks(master_pts);
+                int64_t now_us = NowUs();
+                uint32_t seq = BeginWrite();
+                bool changed = !has_last_sync_ ||
+                               std::llabs(master_ticks - last_sync_ticks_) > base::kTimeEpsTicks;
+                if (!running_.load(std::memory_order_relaxed)) {
+                    Anchor(master_ticks, now_us);
+                    if (has_last_sync_ && changed) {
+                        running_.store(true, std::memory_order_relaxed);
+                    }
+                } else if (changed) {
+                    base::MediaTicks clock_ticks = ExtrapolateLocked(now_us);
+                    base::MediaTicks error = master_ticks - clock_ticks;
+                    if (error > 0 || error < -base::SecToTicks(kRefClockResyncThreshold)) {
+                        Anchor(master_ticks, now_us);
+                    } else {
+                        Anchor(clock_ticks + std::llround(error * kRefClockSlewFactor), now_us);
+                    }
+                }
+                has_last_sync_ = true;
+                last_sync_ticks_ = master_ticks;
+                EndWrite(seq);
+            }
+
+            bool running() {
+                return running_.load(std::memory_order_acquire);
             }
 
         private:
-            double render_pos_ = 0.0;
-            std::mutex mutex_;
+            static int64_t NowUs() {
+                return std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()).count();
+            }
+
+            // 单调时钟也是微秒，正常速度下直接加上经过的时间
+            static base::MediaTicks
+            Extrapolate(base::MediaTicks anchor_ticks, int64_t anchor_time_us, double rate,
+                        bool running, int64_t now_us) {
+                if (!running || now_us <= anchor_time_us) {
+                    return anchor_ticks;
+                }
+                int64_t elapsed_us = now_us - anchor_time_us;
+                if (rate == 1.0) {
+                    return anchor_ticks + elapsed_us;
+                }
+                return anchor_ticks + std::llround(elapsed_us * rate);
+            }
+
+            // 写者之间靠 CAS 抢奇数序号互斥
+            uint32_t BeginWrite() {
+                uint32_t seq = seq_.load(std::memory_order_relaxed);
+                while (true) {
+                    if (seq & 1) {
+                        seq = seq_.load(std::memory_order_relaxed);
+                        continue;
+                    }
+                    if (seq_.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire,
+                                                   std::memory_order_relaxed)) {
+                        break;
+                    }
+                }
+                std::atomic_thread_fence(std::memory_order_release);
+                return seq;
+            }
+
+            void EndWrite(uint32_t seq) {
+                seq_.store(seq + 2, std::memory_order_release);
+            }
+
+            // 以下只在 BeginWrite/EndWrite 之间调用
+            base::MediaTicks ExtrapolateLocked(int64_t now_us) {
+                return Extrapolate(anchor_ticks_.load(std::memory_order_relaxed),
+                                   anchor_time_us_.load(std::memory_order_relaxed),
+                                   rate_.load(std::memory_order_relaxed),
+                                   running_.load(std::memory_order_relaxed), now_us);
+            }
+
+            void Anchor(base::MediaTicks ticks, int64_t now_us) {
+                anchor_ticks_.store(ticks, std::memory_order_relaxed);
+                anchor_time_us_.store(now_us, std::memory_order_relaxed);
+            }
+
+            std::atomic<uint32_t> seq_{0};
+            std::atomic<int64_t> anchor_ticks_{0};
+            std::atomic<int64_t> anchor_time_us_{0};
+            std::atomic<double> rate_{1.0};
+            std::atomic<bool> running_{false};
+
+            // 只有写者访问
+            bool has_last_sync_ = false;
+            base::MediaTicks last_sync_ticks_ = 0;
         };
     }
 }
@@ -14,6 +14,11 @@ namespace whensunset {
         struct DecodePositionChangeRequest {
             double render_pos;
 
+            /**
+             * render_pos 是播放时钟上的位置，循环播放的时候包含已经循环过的时长，不是 seek
+             */
+            bool from_playback_clock = false;
+
             DecodePositionChangeRequest(double render_pos = 0.0, double playback_pts = -1.0)
                     : render_pos(render_pos) {}
         };
@@ -0,0 +1,375 @@
+#include <sys/stat.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include "proxy_media_service.h"
+#include "video_decode_context.h"
+#include "ws_editor_video_sdk_utils.h"
+#include "platform_logger.h"
+#include "av_utils.h"
+
+extern "C" {
+#include "libswscale/swscale.h"
+#include "libavutil/opt.h"
+}
+
+#pragma clang diagnostic push
+// Deprecated FFmpeg APIs must be used for maintaining backwards compatibility with FFmpeg 3.0
+// Ignoring such warnings when compiling against newer FFmpeg versions
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+
+namespace whensunset {
+    namespace wsvideoeditor {
+
+        // 代理文件的 GOP 长度，短 GOP 可以让 seek 之后追帧的代价很小
+        const int kProxyGopSize = 8;
+
+        const double kProxyFallbackFps = 30.0;
+
+        ProxyMediaService::ProxyMediaService(const std::string &cache_dir,
+                                             double pixel_rate_threshold,
+                                             int proxy_short_edge)
+                : cache_dir_(cache_dir), pixel_rate_threshold_(pixel_rate_threshold),
+                  proxy_short_edge_(proxy_short_edge) {
+            if (!cache_dir_.empty() && cache_dir_.back() != '/') {
+                cache_dir_ += "/";
+            }
+            transcode_thread_ = std::thread(&ProxyMediaService::TranscodeThreadMain, this);
+            LOGI("ProxyMediaService cache_dir:%s, pixel_rate_threshold:%f, proxy_short_edge:%d",
+                 cache_dir_.c_str(), pixel_rate_threshold_, proxy_short_edge_);
+        }
+
+        ProxyMediaService::~ProxyMediaService() {
+            Stop();
+            LOGI("~ProxyMediaService");
+        }
+
+        void ProxyMediaService::Stop() {
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                released_ = true;
+                pending_paths_.clear();
+            }
+            cv_.notify_all();
+            if (transcode_thread_.joinable()) {
+                transcode_thread_.join();
+            }
+        }
+
+        void ProxyMediaService::RequestProxies(const model::EditorProject &project) {
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                if (released_) {
+                    return;
+                }
+                for (const model::MediaAsset &asset : project.media_asset()) {
+                    const std::string &asset_path = asset.asset_path();
+                    if (asset_path.empty() || requested_paths_.count(asset_path)) {
+                        continue;
+                    }
+                    requested_paths_.insert(asset_path);
+                    pending_paths_.push_back(asset_path);
+                    LOGI("ProxyMediaService::RequestProxies asset_path:%s", asset_path.c_str());
+                }
+            }
+            cv_.notify_all();
+        }
+
+        std::string ProxyMediaService::GetProxyPath(const std::string &asset_path) {
+            std::lock_guard<std::mutex> lk(mutex_);
+            auto iter = proxy_paths_.find(asset_path);
+            if (iter == proxy_paths_.end()) {
+                return "";
+            }
+            return iter->second;
+        }
+
+        void ProxyMediaService::TranscodeThreadMain() {
+            SetCurrentThreadName("EditorProxyTranscode");
+            while (true) {
+                std::string asset_path;
+                {
+                    std::unique_lock<std::mutex> lk(mutex_);
+                    cv_.wait(lk, [this] {
+                        return released_ || !pending_paths_.empty();
+                    });
+                    if (released_) {
+                        break;
+                    }
+                    asset_path = pending_paths_.front();
+                    pending_paths_.pop_front();
+                }
+
+                if (!NeedProxy(asset_path)) {
+                    continue;
+                }
+                std::string proxy_path = ProxyPathFor(asset_path);
+                if (proxy_path.empty()) {
+                    continue;
+                }
+
+                struct stat proxy_stat;
+                int ret = 0;
+                if (stat(proxy_path.c_str(), &proxy_stat) != 0 || proxy_stat.st_size <= 0) {
+                    std::string tmp_path = proxy_path + ".tmp";
+                    ret = Transcode(asset_path, tmp_path);
+                    if (ret >= 0 && rename(tmp_path.c_str(), proxy_path.c_str()) != 0) {
+                        ret = AVERROR(errno);
+                    }
+                    if (ret < 0) {
+                        remove(tmp_path.c_str());
+                        LOGE("ProxyMediaService::TranscodeThreadMain transcode failed asset_path:%s, ret:%s",
+                             asset_path.c_str(), av_err2str(ret));
+                        continue;
+                    }
+                }
+
+                std::lock_guard<std::mutex> lk(mutex_);
+                proxy_paths_[asset_path] = proxy_path;
+                LOGI("ProxyMediaService::TranscodeThreadMain proxy ready asset_path:%s, proxy_path:%s",
+                     asset_path.c_str(), proxy_path.c_str());
+            }
+            LOGI("ProxyMediaService::TranscodeThreadMain end");
+        }
+
+        bool ProxyMediaService::NeedProxy(const std::string &asset_path) {
+            std::string ext = ExtName(asset_path);
+            if (ext == "jpg" || ext == "png") {
+                return false;
+            }
+            AVFormatContext *fmt_ctx = nullptr;
+            if (avformat_open_input(&fmt_ctx, asset_path.c_str(), NULL, NULL) < 0) {
+                return false;
+            }
+            bool need_proxy = false;
+            if (avformat_find_stream_info(fmt_ctx, NULL) >= 0) {
+                int stream_index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1,
+                                                       nullptr, 0);
+                if (stream_index >= 0) {
+                    AVStream *stream = fmt_ctx->streams[stream_index];
+                    double fps = av_q2d(av_guess_frame_rate(fmt_ctx, stream, NULL));
+                    if (fps <= 0) {
+                        fps = kProxyFallbackFps;
+                    }
+                    double pixel_rate = (double) stream->codec->width * stream->codec->height * fps;
+                    int short_edge = std::min(stream->codec->width, stream->codec->height);
+                    need_proxy = pixel_rate > pixel_rate_threshold_ && short_edge > proxy_short_edge_;
+                    LOGI("ProxyMediaService::NeedProxy asset_path:%s, pixel_rate:%f, need_proxy:%s",
+                         asset_path.c_str(), pixel_rate, BoTSt(need_proxy).c_str());
+                }
+            }
+            avformat_close_input(&fmt_ctx);
+            return need_proxy;
+        }
+
+        std::string ProxyMediaService::ProxyPathFor(const std::string &asset_path) {
+            struct stat file_stat;
+            if (stat(asset_path.c_str(), &file_stat) != 0) {
+                LOGE("ProxyMediaService::ProxyPathFor stat failed asset_path:%s",
+                     asset_path.c_str());
+                return "";
+            }
+            std::string key = asset_path + "_" + std::to_string((long long) file_stat.st_size) +
+                              "_" + std::to_string((long long) file_stat.st_mtime) + "_" +
+                              std::to_string(proxy_short_edge_);
+            return cache_dir_ + "proxy_" + std::to_string(std::hash<std::string>()(key)) + ".mp4";
+        }
+
+        int ProxyMediaService::Transcode(const std::string &src_path,
+                                         const std::string &dst_path) {
+            VideoDecodeContext ctx;
+            int ret = ctx.OpenFile(src_path);
+            if (ret < 0) {
+                return ret;
+            }
+
+            // 优先使用 libx264，没有编进来的话退回 MJPEG（全 I 帧）
+            AVCodec *encoder = avcodec_find_encoder_by_name("libx264");
+            bool is_h264 = encoder != nullptr;
+            if (!encoder) {
+                encoder = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+            }
+            if (!encoder) {
+                LOGE("ProxyMediaService::Transcode no encoder");
+                return AVERROR_ENCODER_NOT_FOUND;
+            }
+
+            AVFormatContext *ofmt_ctx = nullptr;
+            if ((ret = avformat_alloc_output_context2(&ofmt_ctx, NULL, is_h264 ? "mp4" : "mov",
+                                                      dst_path.c_str())) < 0) {
+                LOGE("ProxyMediaService::Transcode alloc output ret:%s", av_err2str(ret));
+                return ret;
+            }
+            std::unique_ptr<AVFormatContext, void (*)(AVFormatContext *)> ofmt_ctx_holder{
+                    ofmt_ctx, [](AVFormatContext *ctx) {
+                        if (ctx->streams && ctx->nb_streams > 0 && ctx->streams[0]->codec) {
+                            avcodec_close(ctx->streams[0]->codec);
+                        }
+                        if (ctx->pb && !(ctx->oformat->flags & AVFMT_NOFILE)) {
+                            avio_closep(&ctx->pb);
+                        }
+                        avformat_free_context(ctx);
+                    }};
+
+            AVStream *in_stream = ctx.video_stream_;
+            AVStream *out_stream = avformat_new_stream(ofmt_ctx, encoder);
+            if (!out_stream) {
+                LOGE("ProxyMediaService::Transcode OOM 1");
+                return AVERROR(ENOMEM);
+            }
+
+            int proxy_width = 0, proxy_height = 0;
+            LimitWidthAndHeight(ctx.codec_context_->width, ctx.codec_context_->height,
+                                proxy_short_edge_, proxy_short_edge_ * 16 / 9,
+                                &proxy_width, &proxy_height);
+
+            AVCodecContext *enc_ctx = out_stream->codec;
+            enc_ctx->width = proxy_width;
+            enc_ctx->height = proxy_height;
+            enc_ctx->sample_aspect_ratio = ctx.codec_context_->sample_aspect_ratio;
+            enc_ctx->time_base = in_stream->time_base;
+            enc_ctx->gop_size = kProxyGopSize;
+            enc_ctx->max_b_frames = 0;
+            if (is_h264) {
+                enc_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+                av_opt_set(enc_ctx->priv_data, "preset", "ultrafast", 0);
+                av_opt_set(enc_ctx->priv_data, "tune", "fastdecode", 0);
+                av_opt_set(enc_ctx->priv_data, "crf", "26", 0);
+            } else {
+                enc_ctx->pix_fmt = AV_PIX_FMT_YUVJ420P;
+                enc_ctx->flags |= AV_CODEC_FLAG_QSCALE;
+                enc_ctx->global_quality = FF_QP2LAMBDA * 6;
+            }
+            if (ofmt_ctx->oformat->flags & AVFMT_GLOBALHEADER) {
+                enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+            }
+            if ((ret = avcodec_open2(enc_ctx, encoder, NULL)) < 0) {
+                LOGE("ProxyMediaService::Transcode open encoder ret:%s", av_err2str(ret));
+                return ret;
+            }
+            out_stream->time_base = in_stream->time_base;
+            // 旋转角度等信息和原始文件保持一致
+            av_dict_copy(&out_stream->metadata, in_stream->metadata, 0);
+
+            if ((ret = avio_open(&ofmt_ctx->pb, dst_path.c_str(), AVIO_FLAG_WRITE)) < 0) {
+                LOGE("ProxyMediaService::Transcode open file ret:%s", av_err2str(ret));
+                return ret;
+            }
+            if ((ret = avformat_write_header(ofmt_ctx, NULL)) < 0) {
+                LOGE("ProxyMediaService::Transcode write header ret:%s", av_err2str(ret));
+                return ret;
+            }
+
+            std::unique_ptr<SwsContext, void (*)(SwsContext *)> sws_ctx{nullptr, sws_freeContext};
+            UniqueAVFramePtr scaled_frame{
+                    AllocVideoFrame(enc_ctx->pix_fmt, proxy_width, proxy_height), FreeAVFrame};
+            UniqueAVFramePtr decoded_frame{av_frame_alloc(), FreeAVFrame};
+            UniqueAVPacketPtr packet{av_packet_alloc(), FreeAVPacket};
+            if (!scaled_frame || !decoded_frame || !packet) {
+                LOGE("ProxyMediaService::Transcode OOM 2");
+                return AVERROR(ENOMEM);
+            }
+
+            int64_t last_pts = AV_NOPTS_VALUE;
+            int got_output = 0;
+            bool draining = false;
+            while (!released_) {
+                if (!draining) {
+                    ret = av_read_frame(ctx.format_context_, packet.get());
+                    if (ret == AVERROR_EOF) {
+                        draining = true;
+                        packet->data = nullptr;
+                        packet->size = 0;
+                    } else if (ret < 0) {
+                        return ret;
+                    } else if (packet->stream_index != ctx.video_stream_idx_) {
+                        av_packet_unref(packet.get());
+                        continue;
+                    }
+                }
+                int got_frame = 0;
+                ret = avcodec_decode_video2(ctx.codec_context_, decoded_frame.get(), &got_frame,
+                                            packet.get());
+                av_packet_unref(packet.get());
+                if (ret < 0 && !draining) {
+                    // 单个损坏的包不影响整个代理文件
+                    LOGW("ProxyMediaService::Transcode decode ret:%s", av_err2str(ret));
+                    continue;
+                }
+                if (!got_frame) {
+                    if (draining) {
+                        break;
+                    }
+                    continue;
+                }
+
+                int64_t pts = av_frame_get_best_effort_timestamp(decoded_frame.get());
+                if (pts == AV_NOPTS_VALUE || (last_pts != AV_NOPTS_VALUE && pts <= last_pts)) {
+                    av_frame_unref(decoded_frame.get());
+                    continue;
+                }
+                last_pts = pts;
+
+                sws_ctx.reset(sws_getCachedContext(sws_ctx.release(),
+                                                   decoded_frame->width, decoded_frame->height,
+                                                   (AVPixelFormat) decoded_frame->format,
+                                                   proxy_width, proxy_height, enc_ctx->pix_fmt,
+                                                   SWS_FAST_BILINEAR, NULL, NULL, NULL));
+                if (!sws_ctx || (ret = av_frame_make_writable(scaled_frame.get())) < 0) {
+                    LOGE("ProxyMediaService::Transcode sws failed");
+                    return ret < 0 ? ret : AVERROR(EINVAL);
+                }
+                sws_scale(sws_ctx.get(), decoded_frame->data, decoded_frame->linesize, 0,
+                          decoded_frame->height, scaled_frame->data, scaled_frame->linesize);
+                scaled_frame->pts = pts;
+                av_frame_unref(decoded_frame.get());
+
+                if ((ret = EncodeAndWriteFrame(ofmt_ctx, enc_ctx, scaled_frame.get(),
+                                               &got_output)) < 0) {
+                    return ret;
+                }
+            }
+            if (released_) {
+                return AVERROR_EXIT;
+            }
+
+            do {
+                if ((ret = EncodeAndWriteFrame(ofmt_ctx, enc_ctx, nullptr, &got_output)) < 0) {
+                    return ret;
+                }
+            } while (got_output);
+
+            if ((ret = av_write_trailer(ofmt_ctx)) < 0) {
+                LOGE("ProxyMediaService::Transcode write trailer ret:%s", av_err2str(ret));
+                return ret;
+            }
+            LOGI("ProxyMediaService::Transcode done src_path:%s, size:%dx%d, h264:%s",
+                 src_path.c_str(), proxy_width, proxy_height, BoTSt(is_h264).c_str());
+            return 0;
+        }
+
+        int ProxyMediaService::EncodeAndWriteFrame(AVFormatContext *ofmt_ctx,
+                                                   AVCodecContext *enc_ctx, AVFrame *frame,
+                                                   int *got_packet) {
+            AVPacket packet;
+            av_init_packet(&packet);
+            packet.data = nullptr;
+            packet.size = 0;
+            *got_packet = 0;
+            int ret = avcodec_encode_video2(enc_ctx, &packet, frame, got_packet);
+            if (ret < 0) {
+                LOGE("ProxyMediaService::EncodeAndWriteFrame encode ret:%s", av_err2str(ret));
+                return ret;
+            }
+            if (!*got_packet) {
+                return 0;
+            }
+            packet.stream_index = 0;
+            av_packet_rescale_ts(&packet, enc_ctx->time_base, ofmt_ctx->streams[0]->time_base);
+            ret = av_interleaved_write_frame(ofmt_ctx, &packet);
+            av_packet_unref(&packet);
+            return ret;
+        }
+    }
+}
+#pragma clang diagnostic pop
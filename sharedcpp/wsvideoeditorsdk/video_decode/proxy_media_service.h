@@ -0,0 +1,114 @@
+#ifndef SHAREDCPP_WS_VIDEO_EDITOR_PROXY_MEDIA_SERVICE_H
+#define SHAREDCPP_WS_VIDEO_EDITOR_PROXY_MEDIA_SERVICE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <wsvideoeditorsdk/prebuilt_protobuf/ws_video_editor_sdk.pb.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+};
+
+namespace whensunset {
+    namespace wsvideoeditor {
+
+        /**
+         * 默认超过 1080p30 的素材才生成代理文件，单位是 像素/秒
+         */
+        const double kDefaultProxyPixelRateThreshold = 1920.0 * 1080.0 * 30.0;
+
+        /**
+         * 代理文件的短边长度
+         */
+        const int kDefaultProxyShortEdge = 360;
+
+        /**
+         * 在后台把高分辨率/高帧率的素材转码成低分辨率、短 GOP、无 B 帧的代理文件，
+         * 预览的时候 @VideoDecodeService 用代理文件解码，导出仍然使用原始文件
+         */
+        class ProxyMediaService {
+        public:
+            ProxyMediaService(const std::string &cache_dir,
+                              double pixel_rate_threshold = kDefaultProxyPixelRateThreshold,
+                              int proxy_short_edge = kDefaultProxyShortEdge);
+
+            virtual ~ProxyMediaService();
+
+            /**
+             * 为 @project 中所有还没处理过的素材排队生成代理文件，可以重复调用
+             * @param project
+             */
+            void RequestProxies(const model::EditorProject &project);
+
+            /**
+             * 获取 @asset_path 对应的代理文件路径
+             * @param asset_path
+             * @return 代理文件还没生成好或者不需要代理的时候返回空字符串
+             */
+            std::string GetProxyPath(const std::string &asset_path);
+
+            /**
+             * 停止后台转码，正在转码的文件会被丢弃
+             */
+            void Stop();
+
+        private:
+            /**
+             * 后台转码线程
+             */
+            void TranscodeThreadMain();
+
+            /**
+             * 判断 @asset_path 的像素率是否超过了阈值
+             */
+            bool NeedProxy(const std::string &asset_path);
+
+            /**
+             * 代理文件的路径，由原始文件的路径、大小、修改时间决定
+             */
+            std::string ProxyPathFor(const std::string &asset_path);
+
+            int Transcode(const std::string &src_path, const std::string &dst_path);
+
+            int EncodeAndWriteFrame(AVFormatContext *ofmt_ctx, AVCodecContext *enc_ctx,
+                                    AVFrame *frame, int *got_packet);
+
+            std::string cache_dir_;
+
+            double pixel_rate_threshold_;
+
+            int proxy_short_edge_;
+
+            std::mutex mutex_;
+
+            std::condition_variable cv_;
+
+            std::atomic<bool> released_{false};
+
+            /**
+             * 等待转码的原始文件路径
+             */
+            std::deque<std::string> pending_paths_;
+
+            /**
+             * 已经排过队的原始文件路径，避免重复转码
+             */
+            std::unordered_set<std::string> requested_paths_;
+
+            /**
+             * 原始文件路径 -> 已经生成好的代理文件路径
+             */
+            std::unordered_map<std::string, std::string> proxy_paths_;
+
+            std::thread transcode_thread_;
+        };
+    }
+}
+#endif
@@ -2,6 +2,7 @@
 #include "video_decode_service.h"
 #include "constants.h"
 #include <cmath>
+#include <cstdlib>
 
 extern "C" {
 #include "libswscale/swscale.h"
@@ -13,8 +14,27 @@ namespace whensunset {
 
         const double kMaxBiasOfLastFrame = 0.1;
 
+        // 取第一帧的时候帧的 pts 和 0 最多差这么多
+        const base::MediaTicks kFirstFrameMaxBiasTicks = 5000;
+
+        // 解码到离循环区间末尾这么近的时候开始提前解循环开始位置的第一帧
+        const base::MediaTicks kLoopHeadPrepareDistanceTicks = base::kTicksPerSecond;
+
+        /**
+         * 帧在文件中的 tick 转换成在 project 中的 tick，剪裁区间之前的部分会变成负数
+         */
+        static base::MediaTicks FrameTicksToProjectTicks(VideoDecodeContext *ctx,
+                                                         const PreviewTimeline &preview_timeline,
+                                                         int64_t frame_ticks, int asset_index) {
+            base::MediaTicks stream_start_ticks = StreamTsToTicks(
+                    NoPtsToZero(ctx->video_stream_->start_time), ctx->video_stream_->time_base);
+            return preview_timeline.AssetTicksToProjectTicks(frame_ticks - stream_start_ticks,
+                                                             asset_index);
+        }
+
         void VideoDecodeService::SetProject(const model::EditorProject &project,
-                                            double render_pos) {
+                                            double render_pos,
+                                            SharedPreviewTimeline preview_timeline) {
             std::lock_guard<std::mutex> pop_frame_lk(pop_frame_mutex_);
             std::lock_guard<std::mutex> lk(member_param_mutex_);
 
@@ -22,6 +42,7 @@ namespace whensunset {
                 return;
             }
             project_ = project;
+            preview_timeline_ = std::move(preview_timeline);
             project_changed_ = true;
             ended_ = false;
             decoded_unit_queue_.Clear();
@@ -30,13 +51,15 @@ namespace whensunset {
             LOGI("VideoDecodeService::SetProject render_pos:%f", render_pos);
         }
 
-        void VideoDecodeService::UpdateProject(const model::EditorProject &project) {
+        void VideoDecodeService::UpdateProject(const model::EditorProject &project,
+                                               SharedPreviewTimeline preview_timeline) {
             {
                 std::lock_guard<std::mutex> lk(member_param_mutex_);
                 if (released_) {
                     return;
                 }
                 project_ = project;
+                preview_timeline_ = std::move(preview_timeline);
                 project_changed_ = true;
                 LOGI("VideoDecodeService::UpdateProject");
             }
@@ -68,24 +91,87 @@ namespace whensunset {
                 media_file_holder->streams_size() > media_file_holder->media_strema_index()) {
                 video_stream = media_file_holder->streams(media_file_holder->media_strema_index());
             }
+            ProxyMediaService *proxy_media_service = nullptr;
+            {
+                std::lock_guard<std::mutex> lk(member_param_mutex_);
+                proxy_media_service = proxy_media_service_;
+            }
+            if (proxy_media_service) {
+                std::string proxy_path = proxy_media_service->GetProxyPath(asset->asset_path());
+                if (!proxy_path.empty()) {
+                    file_path = proxy_path;
+                }
+            }
             ret = ctx.OpenFile(file_path);
             ctx.origin_path_ = asset->asset_path();
             LOGI("VideoDecodeService::OpenMediaAsset file_path:%s", file_path.c_str());
             return ret;
         }
 
+        UniqueAVFramePtr
+        VideoDecodeService::PrepareLoopHead(VideoDecodeContext *ctx, model::EditorProject &project,
+                                            const PreviewTimeline &preview_timeline,
+                                            base::MediaTicks loop_start_ticks, int *asset_index) {
+            double loop_start_sec = base::TicksToSec(loop_start_ticks);
+            MediaAssetSegment segment = preview_timeline.GetSegmentFromRenderPos(loop_start_sec);
+            *asset_index = segment.media_asset_index();
+            int ret = OpenMediaAsset(*ctx, project.mutable_media_asset(*asset_index));
+            if (ret >= 0) {
+                ret = SeekInner(ctx, preview_timeline.ProjectRenderPosToAssetRenderPos(
+                        loop_start_sec, *asset_index));
+            }
+            if (ret < 0) {
+                LOGE("VideoDecodeService::PrepareLoopHead open or seek failed loop_start_sec:%f, ret:%d",
+                     loop_start_sec, ret);
+                return UniqueAVFramePtrCreateNull();
+            }
+            double media_asset_frame_rate = fmin(av_q2d(ctx->video_stream_->avg_frame_rate),
+                                                 project.private_data().project_fps());
+            double catch_up_to_sec = loop_start_sec - 1.0 / media_asset_frame_rate -
+                                     kMaxBiasOfLastFrame;
+            while (true) {
+                UniqueAVFramePtr frame = ReadOneFrame(ctx, &ret);
+                if (ret < 0 || (ctx->is_drain_loop_ && !frame)) {
+                    LOGE("VideoDecodeService::PrepareLoopHead no frame loop_start_sec:%f, ret:%d",
+                         loop_start_sec, ret);
+                    return UniqueAVFramePtrCreateNull();
+                }
+                if (!frame) {
+                    continue;
+                }
+                frame->pts = FrameTicksToProjectTicks(ctx, preview_timeline, frame->pts,
+                                                      *asset_index);
+                // 和 seek 之后的第一帧一样，追上 seek 位置之前的帧都不要
+                if (base::TicksToSec(frame->pts) <= catch_up_to_sec - PTS_EPS) {
+                    continue;
+                }
+                if (frame->pts >= loop_start_ticks) {
+                    frame->pts = loop_start_ticks;
+                }
+                LOGI("VideoDecodeService::PrepareLoopHead loop_start_sec:%f, asset_index:%d",
+                     loop_start_sec, *asset_index);
+                return frame;
+            }
+        }
+
         void VideoDecodeService::DecodeThreadMain() {
             SetCurrentThreadName("EditorTrackVideoDecode");
             model::EditorProject project;
+            SharedPreviewTimeline preview_timeline;
             {
                 std::unique_lock<std::mutex> lk(member_param_mutex_);
                 project = project_;
+                preview_timeline = preview_timeline_;
+            }
+            if (!preview_timeline) {
+                preview_timeline.reset(new(std::nothrow) PreviewTimeline(project));
             }
-            std::unique_ptr<PreviewTimeline> preview_timeline{
-                    new(std::nothrow) PreviewTimeline(project)};
             std::unique_ptr<VideoDecodeContext> ctx_current(
                     new(std::nothrow)VideoDecodeContext());
-            if (!ctx_current || !preview_timeline) {
+            // 提前解循环开始位置用的解码器，循环的时候和 ctx_current 交换
+            std::unique_ptr<VideoDecodeContext> ctx_loop_head(
+                    new(std::nothrow)VideoDecodeContext());
+            if (!ctx_current || !ctx_loop_head || !preview_timeline) {
                 LOGE("VideoDecodeService::DecodeThreadMain OOM 1");
                 return;
             }
@@ -94,6 +180,12 @@ namespace whensunset {
             int ret = 0, decoding_asset_index = 0;
             bool is_first_frame_decoded_after_seek = false;
             double seek_pos_sec = 0.0, catch_up_to_sec_after_seek = 0.0;
+            double last_pushed_frame_sec = 0.0, playback_rate = 1.0;
+            // loop_offset_ticks 是已经循环过的时长，加到推进队列的帧的 pts 上
+            base::MediaTicks loop_start_ticks = 0, loop_end_ticks = 0, loop_offset_ticks = 0;
+            bool loop_armed = false, loop_head_tried = false;
+            UniqueAVFramePtr loop_head_frame = UniqueAVFramePtrCreateNull();
+            int loop_head_asset_index = 0;
             LOGI("VideoDecodeService::DecodeThreadMain start decode loop current_segment:%s",
                  current_segment.ToString().c_str());
             while (true) {
@@ -116,12 +208,25 @@ namespace whensunset {
                         project = project_;
                         project_changed = true;
                         project_changed_ = false;
-                        preview_timeline.reset(new(std::nothrow)PreviewTimeline(project));
+                        preview_timeline = preview_timeline_;
+                        if (!preview_timeline) {
+                            preview_timeline.reset(new(std::nothrow)PreviewTimeline(project));
+                        }
+                        loop_head_frame.reset();
+                        loop_head_tried = false;
                         LOGI("VideoDecodeService::DecodeThreadMain project changed");
                     }
 
+                    if (loop_start_ticks != loop_start_ticks_ || loop_end_ticks != loop_end_ticks_) {
+                        loop_start_ticks = loop_start_ticks_;
+                        loop_end_ticks = loop_end_ticks_;
+                        loop_head_frame.reset();
+                        loop_head_tried = false;
+                    }
+
                     changed_render_pos = changed_render_pos_;
                     changed_render_pos_ = -1;
+                    playback_rate = playback_rate_;
                     LOGI("VideoDecodeService::DecodeThreadMain changed_render_pos:%f, project_changed:%s, stopped_:%s",
                          changed_render_pos, BoTSt(project_changed).c_str(),
                          BoTSt(stopped_).c_str());
@@ -137,6 +242,11 @@ namespace whensunset {
                     }
 
                     is_first_frame_decoded_after_seek = true;
+                    // 提前解好的循环开始帧不受 seek 影响，还能接着用
+                    loop_offset_ticks = 0;
+                    loop_head_tried = !!loop_head_frame;
+                    loop_armed = loop_end_ticks > loop_start_ticks &&
+                                 base::SecToTicks(changed_render_pos) < loop_end_ticks;
                     current_segment = preview_timeline->GetSegmentFromRenderPos(changed_render_pos);
                     int seek_to_asset_index = current_segment.media_asset_index();
                     bool decoding_asset_changed = false;
@@ -161,12 +271,12 @@ namespace whensunset {
                             ctx_current->video_stream_->avg_frame_rate);
                     media_asset_frame_rate = fmin(media_asset_frame_rate,
                                                   project.private_data().project_fps());
+                    seek_pos_sec = changed_render_pos;
                     catch_up_to_sec_after_seek =
                             changed_render_pos - 1.0 / media_asset_frame_rate - kMaxBiasOfLastFrame;
 
-                    double asset_render_pos = ProjectRenderPosToAssetRenderPos(project,
-                                                                               changed_render_pos,
-                                                                               decoding_asset_index);
+                    double asset_render_pos = preview_timeline->ProjectRenderPosToAssetRenderPos(
+                            changed_render_pos, decoding_asset_index);
                     LOGI("VideoDecodeService::DecodeThreadMain rpc seek failed media_asset_frame_rate:%f, catch_up_to_sec_after_seek:%f, asset_render_pos:%d",
                          media_asset_frame_rate, catch_up_to_sec_after_seek, asset_render_pos);
                     if (SeekInner(ctx_current.get(), asset_render_pos) < 0) {
@@ -188,11 +298,14 @@ namespace whensunset {
 
                 double end_offset = current_segment.end_pos();
                 double frame_timestamp_sec_in_track = 0.0;
+                bool segment_finished = false, loop_wrap = false;
 
-                av_q2d(ctx_current->video_stream_->avg_frame_rate);
                 frame = ReadOneFrame(ctx_current.get(), &ret);
                 if (ret >= 0 && frame) {
-                    frame_timestamp_sec_in_track = frame->pts * 1.0 / AV_TIME_BASE;
+                    // frame->pts 已经是 AV_TIME_BASE 的 tick，全程整数运算
+                    frame->pts = FrameTicksToProjectTicks(ctx_current.get(), *preview_timeline,
+                                                          frame->pts, decoding_asset_index);
+                    frame_timestamp_sec_in_track = base::TicksToSec(frame->pts);
                     got_frame = 1;
                 }
                 LOGI("VideoDecodeService::DecodeThreadMain got_frame:%d, end_offset:%f, frame_timestamp_sec_in_track:%f, ret:%d",
@@ -206,20 +319,36 @@ namespace whensunset {
                 }
 
                 if (frame) {
-                    double frame_sec = frame->pts * 1.0 / AV_TIME_BASE;
+                    double frame_sec = base::TicksToSec(frame->pts);
                     if (frame_sec <= catch_up_to_sec_after_seek - PTS_EPS) {
                         LOGE("VideoDecodeService::DecodeThreadMain fv error frame_sec need bigger than catch_up_to_sec_after_seek frame_sec:%f, catch_up_to_sec_after_seek:%f",
                              frame_sec, catch_up_to_sec_after_seek);
-                    } else if (frame_sec > end_offset) {
+                    } else if (loop_armed && frame->pts >= loop_end_ticks) {
+                        // 到了循环区间的末尾，这一帧不要了，接着放循环开始位置的帧
+                        loop_wrap = true;
+                        LOGI("VideoDecodeService::DecodeThreadMain fv reach loop end frame_sec:%f",
+                             frame_sec);
+                    } else if (frame->pts > current_segment.end_ticks()) {
+                        // 到了剪裁区间的末尾就直接结束当前片段，不需要把文件剩下的部分读完
                         if (ctx_current->codec_context_ &&
                             avcodec_is_open(ctx_current->codec_context_)) {
                             avcodec_flush_buffers(ctx_current->codec_context_);
                         }
+                        segment_finished = true;
                         LOGI("VideoDecodeService::DecodeThreadMain fv is last frame in this media asset");
+                    } else if (!is_first_frame_decoded_after_seek && playback_rate > 1.0 &&
+                               project.private_data().project_fps() > 0 &&
+                               frame_sec - last_pushed_frame_sec <
+                               (playback_rate - 0.5) / project.private_data().project_fps() -
+                               PTS_EPS) {
+                        // 快放时按照缩放后的时钟每秒最多显示 project_fps 帧，多出来的帧直接丢掉
+                        LOGI("VideoDecodeService::DecodeThreadMain fv drop frame for playback_rate:%f, frame_sec:%f, last_pushed_frame_sec:%f",
+                             playback_rate, frame_sec, last_pushed_frame_sec);
                     } else {
                         if (is_first_frame_decoded_after_seek && frame_sec >= seek_pos_sec) {
-                            frame->pts = static_cast<int64_t>(seek_pos_sec * AV_TIME_BASE);
+                            frame->pts = base::SecToTicks(seek_pos_sec);
                         }
+                        frame->pts += loop_offset_ticks;
 
                         DecodedFramesUnit unit = DecodedFramesUnitCreateNull();
                         unit.frame = std::move(frame);
@@ -228,13 +357,62 @@ namespace whensunset {
                         unit.frame_media_asset_index = decoding_asset_index;
                         decoded_unit_queue_.PushBack(std::move(unit));
                         is_first_frame_decoded_after_seek = false;
+                        last_pushed_frame_sec = frame_sec;
                         LOGI("VideoDecodeService::DecodeThreadMain fv frame_sec:%f, seek_pos_sec:%f, frame_timestamp_sec_in_track:%f, decoding_asset_index%d",
                              frame_sec, seek_pos_sec, frame_timestamp_sec_in_track,
                              decoding_asset_index);
                     }
                 }
 
-                if (ctx_current->is_drain_loop_ && !got_frame) {
+                if (loop_armed && !loop_head_frame && !loop_head_tried && got_frame &&
+                    base::SecToTicks(frame_timestamp_sec_in_track) >=
+                    loop_end_ticks - kLoopHeadPrepareDistanceTicks) {
+                    loop_head_tried = true;
+                    loop_head_frame = PrepareLoopHead(ctx_loop_head.get(), project,
+                                                      *preview_timeline, loop_start_ticks,
+                                                      &loop_head_asset_index);
+                }
+
+                bool reach_loop_end = loop_wrap ||
+                                      (((ctx_current->is_drain_loop_ && !got_frame) ||
+                                        segment_finished) &&
+                                       current_segment.end_ticks() >=
+                                       loop_end_ticks - base::kTimeEpsTicks);
+                if (loop_armed && reach_loop_end) {
+                    if (!loop_head_frame && !loop_head_tried) {
+                        loop_head_frame = PrepareLoopHead(ctx_loop_head.get(), project,
+                                                          *preview_timeline, loop_start_ticks,
+                                                          &loop_head_asset_index);
+                    }
+                    loop_head_tried = false;
+                    if (loop_head_frame) {
+                        // 换到已经 seek 好的解码器接着解，不清空帧队列，pts 接着往后涨
+                        std::swap(ctx_current, ctx_loop_head);
+                        decoding_asset_index = loop_head_asset_index;
+                        current_segment = preview_timeline->GetSegmentFromRenderPos(
+                                base::TicksToSec(loop_start_ticks));
+                        loop_offset_ticks += loop_end_ticks - loop_start_ticks;
+                        seek_pos_sec = base::TicksToSec(loop_start_ticks);
+                        last_pushed_frame_sec = base::TicksToSec(loop_head_frame->pts);
+                        catch_up_to_sec_after_seek = last_pushed_frame_sec;
+                        is_first_frame_decoded_after_seek = false;
+
+                        DecodedFramesUnit unit = DecodedFramesUnitCreateNull();
+                        unit.frame_timestamp_sec = last_pushed_frame_sec;
+                        loop_head_frame->pts += loop_offset_ticks;
+                        unit.frame = std::move(loop_head_frame);
+                        unit.frame_file = project.media_asset(decoding_asset_index).asset_path();
+                        unit.frame_media_asset_index = decoding_asset_index;
+                        decoded_unit_queue_.PushBack(std::move(unit));
+                        LOGI("VideoDecodeService::DecodeThreadMain loop to loop_start_sec:%f, loop_offset_ticks:%lld",
+                             seek_pos_sec, (long long) loop_offset_ticks);
+                        continue;
+                    }
+                    LOGE("VideoDecodeService::DecodeThreadMain loop head failed, play on without loop");
+                    loop_armed = false;
+                }
+
+                if ((ctx_current->is_drain_loop_ && !got_frame) || segment_finished) {
                     if (preview_timeline->IsLastSegment(current_segment)) {
                         DecodeEofHandle();
                         LOGI("VideoDecodeService::DecodeThreadMain afd this is last asset");
@@ -245,15 +423,25 @@ namespace whensunset {
 
                         std::string file_path = CachedMediaFileHolder(project.mutable_media_asset(
                                 decoding_asset_index))->path();
-                        if (OpenMediaAsset(*ctx_current, project.mutable_media_asset(
-                                decoding_asset_index))) {
-                            double pos_sec = ProjectRenderPosToAssetRenderPos(project,
-                                                                              current_segment.start_pos(),
-                                                                              decoding_asset_index);
+                        ret = OpenMediaAsset(*ctx_current, project.mutable_media_asset(
+                                decoding_asset_index));
+                        if (ret >= 0) {
+                            // 直接 seek 到剪裁区间的开始位置，同一个文件的下一个片段也需要 seek
+                            double pos_sec = preview_timeline->ProjectRenderPosToAssetRenderPos(
+                                    current_segment.start_pos(), decoding_asset_index);
                             ret = SeekInner(ctx_current.get(), pos_sec);
                             LOGI("VideoDecodeService::DecodeThreadMain open media asset pos_sec:%f, ret:%d",
                                  pos_sec, ret);
                         }
+                        if (ret >= 0) {
+                            double media_asset_frame_rate = fmin(
+                                    av_q2d(ctx_current->video_stream_->avg_frame_rate),
+                                    project.private_data().project_fps());
+                            is_first_frame_decoded_after_seek = true;
+                            seek_pos_sec = current_segment.start_pos();
+                            catch_up_to_sec_after_seek = seek_pos_sec - 1.0 / media_asset_frame_rate -
+                                                         kMaxBiasOfLastFrame;
+                        }
                         LOGI("VideoDecodeService::DecodeThreadMain afd jump to next asset next_segment:%s, file_path:%s",
                              current_segment.ToString().c_str(), file_path.c_str());
                         if (ret < 0) {
@@ -273,6 +461,7 @@ namespace whensunset {
                 });
             }
             ctx_current->Release();
+            ctx_loop_head->Release();
             LOGI("VideoDecodeService::DecodeThreadMain decode loop end");
         }
 
@@ -350,7 +539,8 @@ namespace whensunset {
          */
         int VideoDecodeService::SeekInner(VideoDecodeContext *ctx, double render_pos) {
             ctx->is_drain_loop_ = false;
-            int64_t target_dts = (int64_t) (render_pos / av_q2d(ctx->video_stream_->time_base))
+            int64_t target_dts = TicksToStreamTs(base::SecToTicks(render_pos),
+                                                 ctx->video_stream_->time_base)
                                  + NoPtsToZero(ctx->video_stream_->first_dts);
             int ret = av_seek_frame(ctx->format_context_, ctx->video_stream_idx_, target_dts,
                                     AVSEEK_FLAG_BACKWARD);
@@ -377,19 +567,20 @@ namespace whensunset {
 
         DecodedFramesUnit
         VideoDecodeService::GetRenderFrameAtPtsInternal(double render_sec) {
-            int64_t render_pos = (int64_t) (render_sec * AV_TIME_BASE + 0.5);
+            // 队列里帧的 pts 都是 project 中的 tick，比较全部用整数
+            const base::MediaTicks render_pos = base::SecToTicks(render_sec);
             DecodedFramesUnit ret = DecodedFramesUnitCreateNull();
-            LOGI("VideoDecodeService::GetRenderFrameAtPtsInternal render_sec:%f, render_pos:%d",
-                 render_sec, render_pos);
-            if (std::fabs(render_sec - 0.0) < PTS_EPS && decoded_unit_queue_.Size() >= 1) {
+            LOGI("VideoDecodeService::GetRenderFrameAtPtsInternal render_sec:%f, render_pos:%lld",
+                 render_sec, (long long) render_pos);
+            if (render_pos < base::kTimeEpsTicks && decoded_unit_queue_.Size() >= 1) {
                 bool got_frame = false;
                 auto result = decoded_unit_queue_.PopFrontIf(
                         [&](const std::vector<DecodedFramesUnit> &units) {
                             if (units.size() < 1) {
                                 return false;
                             }
-                            double first_pts = units[0].frame->pts / (double) AV_TIME_BASE;
-                            if (std::fabs(first_pts - render_sec) < 0.005) {
+                            base::MediaTicks first_pts = units[0].frame->pts;
+                            if (std::llabs(first_pts - render_pos) < kFirstFrameMaxBiasTicks) {
                                 got_frame = true;
                                 return true;
                             }
@@ -408,7 +599,6 @@ namespace whensunset {
                 bool should_use_first_frame = false;
                 auto result = decoded_unit_queue_.PopFrontIf(
                         [&](const std::vector<DecodedFramesUnit> &units) {
-                            render_pos = (int64_t) (render_sec * AV_TIME_BASE + 0.5);
                             if (units.size() <= 1) {
                                 return false;
                             }
@@ -418,8 +608,9 @@ namespace whensunset {
                             should_discard_first_frame = (second_pts <= render_pos);
                             should_use_first_frame = (first_pts <= render_pos &&
                                                       render_pos < second_pts);
-                            LOGI("VideoDecodeService::GetRenderFrameAtPtsInternal first_pts:%d, second_pts:%d, render_pos:%d",
-                                 first_pts, second_pts, render_pos);
+                            LOGI("VideoDecodeService::GetRenderFrameAtPtsInternal first_pts:%lld, second_pts:%lld, render_pos:%lld",
+                                 (long long) first_pts, (long long) second_pts,
+                                 (long long) render_pos);
                             return should_discard_first_frame || should_use_first_frame;
                         });
                 if (should_discard_first_frame) {
@@ -12,6 +12,7 @@
 #include "video_decode_context.h"
 #include "av_utils.h"
 #include "preview_timeline.h"
+#include "proxy_media_service.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -40,8 +41,10 @@ namespace whensunset {
              * 设置 @project 只在需要初始化的时候调用
              * @param project
              * @param render_pos
+             * @param preview_timeline @project 的时间线，为空的时候解码线程自己建一个
              */
-            void SetProject(const model::EditorProject &project, double render_pos);
+            void SetProject(const model::EditorProject &project, double render_pos,
+                            SharedPreviewTimeline preview_timeline = nullptr);
 
             /**
              * 开始解码
@@ -51,8 +54,10 @@ namespace whensunset {
             /**
              * 更新 @project 在解码过程中如果 @project 改变了，可以调用
              * @param project
+             * @param preview_timeline @project 的时间线，为空的时候解码线程自己建一个
              */
-            void UpdateProject(const model::EditorProject &project);
+            void UpdateProject(const model::EditorProject &project,
+                               SharedPreviewTimeline preview_timeline = nullptr);
 
             DecodedFramesUnit GetRenderFrameAtPtsOrNull(double render_sec);
 
@@ -79,6 +84,37 @@ namespace whensunset {
                 return decoded_unit_queue_.Size();
             }
 
+            /**
+             * 设置代理文件服务，设置之后打开素材时如果代理文件已经生成好了就用代理文件解码，
+             * 只有预览需要设置，导出不设置就会一直使用原始文件
+             * @param proxy_media_service 不持有，调用方保证生命周期比 @VideoDecodeService 长
+             */
+            inline void SetProxyMediaService(ProxyMediaService *proxy_media_service) {
+                std::lock_guard<std::mutex> lk(member_param_mutex_);
+                proxy_media_service_ = proxy_media_service;
+            }
+
+            /**
+             * 设置播放速度，快放时解码线程按照缩放后的时钟丢帧，不再把显示不出来的帧放进队列，
+             * 慢放时渲染端会重复显示上一帧
+             */
+            inline void SetPlaybackRate(double playback_rate) {
+                std::lock_guard<std::mutex> lk(member_param_mutex_);
+                playback_rate_ = playback_rate;
+            }
+
+            /**
+             * 设置循环区间 [loop_start, loop_end)，loop_end <= loop_start 的时候取消循环，Seek 之后生效。
+             * 解码到 loop_end 直接接着放 loop_start 的帧，不清空帧队列，帧的 pts 加上已经循环过的时长，
+             * 一直递增，渲染端按照递增的时钟取帧就行。快到 loop_end 的时候用另一个解码器提前解好
+             * loop_start 的第一帧，循环的时候不用等 seek
+             */
+            inline void SetLoopRegion(double loop_start, double loop_end) {
+                std::lock_guard<std::mutex> lk(member_param_mutex_);
+                loop_start_ticks_ = base::SecToTicks(loop_start);
+                loop_end_ticks_ = base::SecToTicks(loop_end);
+            }
+
         private:
             DecodedFramesUnit GetRenderFrameAtPtsInternal(double render_sec);
 
@@ -101,6 +137,15 @@ namespace whensunset {
 
             int OpenMediaAsset(VideoDecodeContext &ctx, model::MediaAsset *trackAsset);
 
+            /**
+             * 在 @ctx 中打开 @loop_start_ticks 所在的素材，seek 过去并解出这个位置的第一帧
+             * @param asset_index 返回帧所在素材的下标
+             * @return pts 已经转换成 project 中的 tick 的帧，失败返回空
+             */
+            UniqueAVFramePtr PrepareLoopHead(VideoDecodeContext *ctx, model::EditorProject &project,
+                                             const PreviewTimeline &preview_timeline,
+                                             base::MediaTicks loop_start_ticks, int *asset_index);
+
             inline bool HasMediaAsset() { return project_.media_asset_size() > 0; }
 
             /**
@@ -143,6 +188,18 @@ namespace whensunset {
              */
             double changed_render_pos_ = -1;
 
+            /**
+             * 播放速度，1.0 为原速
+             */
+            double playback_rate_ = 1.0;
+
+            /**
+             * 循环区间，loop_end_ticks_ <= loop_start_ticks_ 的时候不循环
+             */
+            base::MediaTicks loop_start_ticks_ = 0;
+
+            base::MediaTicks loop_end_ticks_ = 0;
+
             /**
              * 帧队列
              */
@@ -150,6 +207,13 @@ namespace whensunset {
 
             model::EditorProject project_;
 
+            /**
+             * 调用方传进来的 @project_ 的时间线
+             */
+            SharedPreviewTimeline preview_timeline_;
+
+            ProxyMediaService *proxy_media_service_ = nullptr;
+
             std::mutex pop_frame_mutex_;
 
             std::thread decode_thread_;
@@ -1,6 +1,7 @@
 #include "ws_video_editor_sdk.pb.h"
 #include "preview_timeline.h"
 #include "ws_editor_video_sdk_utils.h"
+#include <float.h>
 
 extern "C" {
 #include "libavformat/avformat.h"
@@ -188,7 +189,7 @@ namespace whensunset {
                 if (asset.media_asset_file_holder().streams_size() == 0) {
                     continue;
                 }
-                total_duration += asset.media_asset_file_holder().duration();
+                total_duration += MediaAssetClippedRange(asset).duration();
             }
 
             return total_duration;
@@ -301,15 +302,6 @@ namespace whensunset {
             return ret;
         }
 
-        double
-        CalcMediaAssetStartTime(const model::EditorProject &project, int media_asset_index) {
-            double start_time = 0.0;
-            for (int i = 0; i < min(media_asset_index, project.media_asset_size()); i++) {
-                start_time += project.media_asset(i).media_asset_file_holder().duration();
-            }
-            return start_time;
-        }
-
         bool operator==(const model::TimeRange &lhs, const model::TimeRange &rhs) {
             return lhs.start() == rhs.start() && lhs.duration() == rhs.duration();
         }
@@ -318,17 +310,6 @@ namespace whensunset {
             return !(lhs == rhs);
         }
 
-        double ProjectRenderPosToAssetRenderPos(const model::EditorProject &project,
-                                                double project_pts,
-                                                int asset_index) {
-            if (asset_index < 0 || asset_index >= project.media_asset_size()) {
-                return 0.0;
-            }
-            double asset_pts = project_pts - CalcMediaAssetStartTime(project, asset_index);
-            return asset_pts;
-        }
-
-
         model::MediaFileHolder *CachedMediaFileHolder(model::MediaAsset *asset) {
             if (!asset->has_media_asset_file_holder() ||
                 asset->media_asset_file_holder().path() == ""
@@ -356,73 +337,15 @@ namespace whensunset {
             return LongEdge720p;
         }
 
-        int GetMediaAssetIndexByRenderPos(const model::EditorProject &project, double render_pos) {
-            double sum = 0.0;
-            for (int i = 0; i < project.media_asset_size(); ++i) {
-                double duration = project.media_asset(i).media_asset_file_holder().duration();
-
-                if (sum < render_pos && render_pos < sum + duration) {
-                    return i;
-                }
-                sum += duration;
-            }
-            return project.media_asset_size() - 1;
-        }
-
-        bool IsAudioVolumeChanged(const model::EditorProject &old_prj,
-                                  const model::EditorProject &new_prj) {
-            if (old_prj.media_asset_size() != new_prj.media_asset_size()) {
-                return true;
-            }
-            for (int i = 0; i < old_prj.media_asset_size(); ++i) {
-                if (fabs(old_prj.media_asset(i).volume() - new_prj.media_asset(i).volume()) >
-                    1e-3) {
-                    return true;
-                }
-            }
-            return false;
-        }
-
-        bool IsAudioAssetsChanged(const model::EditorProject &old_prj,
-                                  const model::EditorProject &new_prj) {
-            if (IsProjectTimelineChanged(old_prj, new_prj)) {
-                return true;
-            }
-
-            for (int i = 0; i < old_prj.media_asset_size(); i++) {
-                for (int j = 0; j < new_prj.media_asset_size(); j++) {
-                    model::MediaAsset new_prj_track_asset = new_prj.media_asset(j);
-                    model::MediaAsset old_prj_track_asset = old_prj.media_asset(i);
-                    if (old_prj_track_asset.asset_id() == new_prj_track_asset.asset_id()) {
-                        return true;
-                    }
+        bool ProjectHasAudibleAudio(const model::EditorProject &project) {
+            for (const model::MediaAsset &asset : project.media_asset()) {
+                if (!(asset.volume() > 0.0)) {
+                    continue;
                 }
-            }
-            return false;
-        }
-
-        bool IsProjectTimelineChanged(const model::EditorProject &old_prj,
-                                      const model::EditorProject &new_prj) {
-
-            if (new_prj.media_asset_size() != old_prj.media_asset_size()) {
-                return true;
-            }
-            return IsProjectInputTrackAssetsChanged(old_prj, new_prj);
-        }
-
-        bool IsProjectInputTrackAssetsChanged(const model::EditorProject &old_prj,
-                                              const model::EditorProject &new_prj) {
-            if (new_prj.project_id() != old_prj.project_id()) {
-                return true;
-            }
-            if (new_prj.private_data().input_media_assets_number() !=
-                old_prj.private_data().input_media_assets_number()) {
-                return true;
-            }
-            for (int i = 0; i < new_prj.private_data().input_media_assets_number(); ++i) {
-                const model::MediaAsset &new_asset = new_prj.media_asset(i);
-                const model::MediaAsset &old_asset = old_prj.media_asset(i);
-                if (new_asset.asset_path() != old_asset.asset_path()) {
+                // 没有解析过的素材当作有声音
+                if (!asset.has_media_asset_file_holder() ||
+                    asset.media_asset_file_holder().path() == "" ||
+                    asset.media_asset_file_holder().audio_strema_index() >= 0) {
                     return true;
                 }
             }